@@ -0,0 +1,512 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ann_baseline.h"
+#include "dsp_helper.h"
+
+#define ANN_ROW_ALIGN 64
+#define ALIGN_ROW(n) (((n) + ANN_ROW_ALIGN - 1) & ~(ANN_ROW_ALIGN - 1))
+
+// TFLite schema ids this loader understands
+#define TFLITE_TENSOR_INT32     2
+#define TFLITE_TENSOR_INT8      9
+#define TFLITE_OP_FULLY_CONNECTED 9
+#define TFLITE_OP_RESHAPE       22
+#define TFLITE_ACT_NONE         0
+#define TFLITE_ACT_RELU         1
+#define TFLITE_ACT_RELU_N1_TO_1 2
+#define TFLITE_ACT_RELU6        3
+
+// Bounds-checked view of a flatbuffer. Positions are byte offsets into data;
+// 0 doubles as "absent" since no table or vector can start at offset 0.
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    int bad;
+} Fb_Reader;
+
+static uint32_t fb_u32(Fb_Reader *fb, size_t pos) {
+    uint32_t value;
+    if (pos + 4 > fb->size) {
+        fb->bad = 1;
+        return 0;
+    }
+    memcpy(&value, fb->data + pos, 4);
+    return value;
+}
+
+static uint16_t fb_u16(Fb_Reader *fb, size_t pos) {
+    uint16_t value;
+    if (pos + 2 > fb->size) {
+        fb->bad = 1;
+        return 0;
+    }
+    memcpy(&value, fb->data + pos, 2);
+    return value;
+}
+
+static uint8_t fb_u8(Fb_Reader *fb, size_t pos) {
+    if (pos >= fb->size) {
+        fb->bad = 1;
+        return 0;
+    }
+    return fb->data[pos];
+}
+
+// Follow the uoffset stored at pos
+static size_t fb_deref(Fb_Reader *fb, size_t pos) {
+    if (!pos) {
+        return 0;
+    }
+    size_t target = pos + fb_u32(fb, pos);
+    if (target >= fb->size) {
+        fb->bad = 1;
+        return 0;
+    }
+    return target;
+}
+
+// Position of field index of the table at pos, 0 when the field is not set
+static size_t fb_field(Fb_Reader *fb, size_t table, int index) {
+    if (!table) {
+        return 0;
+    }
+    size_t vtable = table - (size_t)(int64_t)(int32_t)fb_u32(fb, table);
+    uint16_t vtable_bytes = fb_u16(fb, vtable);
+    if (fb->bad || (size_t)(4 + 2 * index) >= vtable_bytes) {
+        return 0;
+    }
+    uint16_t offset = fb_u16(fb, vtable + 4 + 2 * index);
+    return offset ? table + offset : 0;
+}
+
+// Elements of the vector referenced by field, *count of them
+static size_t fb_vector(Fb_Reader *fb, size_t field, size_t element_bytes, uint32_t *count) {
+    size_t vector = fb_deref(fb, field);
+    *count = vector ? fb_u32(fb, vector) : 0;
+    if (vector && (size_t)*count * element_bytes > fb->size - vector - 4) {
+        fb->bad = 1;
+        *count = 0;
+    }
+    return vector ? vector + 4 : 0;
+}
+
+// Table at element index of a vector of tables
+static size_t fb_vector_table(Fb_Reader *fb, size_t field, uint32_t index) {
+    uint32_t count;
+    size_t elements = fb_vector(fb, field, 4, &count);
+    if (index >= count) {
+        fb->bad = 1;
+        return 0;
+    }
+    return fb_deref(fb, elements + 4 * (size_t)index);
+}
+
+static int32_t fb_int_field(Fb_Reader *fb, size_t table, int index, int32_t fallback) {
+    size_t field = fb_field(fb, table, index);
+    return field ? (int32_t)fb_u32(fb, field) : fallback;
+}
+
+static int fb_byte_field(Fb_Reader *fb, size_t table, int index, int fallback) {
+    size_t field = fb_field(fb, table, index);
+    return field ? (int)(int8_t)fb_u8(fb, field) : fallback;
+}
+
+// What the loader needs from one tensor of the model
+typedef struct {
+    int type;
+    int num_dims;
+    int dims[4];
+    const uint8_t *data;    // constant buffer, NULL for activations
+    size_t data_bytes;
+    uint32_t num_scales;
+    size_t scales;          // float[num_scales]
+    uint32_t num_zero_points;
+    size_t zero_points;     // int64[num_zero_points]
+} Tflite_Tensor;
+
+static int read_tensor(Fb_Reader *fb, size_t model, size_t subgraph, int index, Tflite_Tensor *tensor) {
+    memset(tensor, 0, sizeof(*tensor));
+    if (index < 0) {
+        return 1;
+    }
+    size_t table = fb_vector_table(fb, fb_field(fb, subgraph, 0), (uint32_t)index);
+    uint32_t num_dims;
+    size_t dims = fb_vector(fb, fb_field(fb, table, 0), 4, &num_dims);
+    if (num_dims > 4) {
+        return 1;
+    }
+    tensor->num_dims = (int)num_dims;
+    for (uint32_t d = 0; d < num_dims; d++) {
+        tensor->dims[d] = (int32_t)fb_u32(fb, dims + 4 * d);
+    }
+    tensor->type = fb_byte_field(fb, table, 1, 0);
+
+    uint32_t buffer_index = (uint32_t)fb_int_field(fb, table, 2, 0);
+    size_t buffer = fb_vector_table(fb, fb_field(fb, model, 4), buffer_index);
+    uint32_t data_bytes;
+    size_t data = fb_vector(fb, fb_field(fb, buffer, 0), 1, &data_bytes);
+    tensor->data = data_bytes ? fb->data + data : NULL;
+    tensor->data_bytes = data_bytes;
+
+    size_t quantization = fb_deref(fb, fb_field(fb, table, 4));
+    tensor->scales = fb_vector(fb, fb_field(fb, quantization, 2), 4, &tensor->num_scales);
+    tensor->zero_points = fb_vector(fb, fb_field(fb, quantization, 3), 8, &tensor->num_zero_points);
+    return fb->bad;
+}
+
+static float tensor_scale(Fb_Reader *fb, const Tflite_Tensor *tensor, int channel) {
+    float scale;
+    uint32_t bits = fb_u32(fb, tensor->scales + 4 * (size_t)(tensor->num_scales > 1 ? channel : 0));
+    memcpy(&scale, &bits, 4);
+    return scale;
+}
+
+static int32_t tensor_zero_point(Fb_Reader *fb, const Tflite_Tensor *tensor, int channel) {
+    if (!tensor->num_zero_points) {
+        return 0;
+    }
+    size_t pos = tensor->zero_points + 8 * (size_t)(tensor->num_zero_points > 1 ? channel : 0);
+    return (int32_t)fb_u32(fb, pos);  // low word of the little-endian int64
+}
+
+static int is_int8_activation(const Tflite_Tensor *tensor) {
+    return tensor->type == TFLITE_TENSOR_INT8 && tensor->num_scales == 1 && !tensor->data;
+}
+
+// Real multiplier -> Q0.31 multiplier and power-of-two exponent (TFLite QuantizeMultiplier)
+static void quantize_multiplier(double real, int32_t *multiplier, int *shift) {
+    if (real <= 0.0) {
+        *multiplier = 0;
+        *shift = 0;
+        return;
+    }
+    double fraction = frexp(real, shift);
+    int64_t fixed = (int64_t)llround(fraction * (double)(1ll << 31));
+    if (fixed == (1ll << 31)) {
+        fixed /= 2;
+        (*shift)++;
+    }
+    if (*shift < -31) {
+        *shift = 0;
+        fixed = 0;
+    }
+    *multiplier = (int32_t)fixed;
+}
+
+static int32_t quantize_activation(double value, double scale, int32_t zero_point) {
+    return zero_point + (int32_t)lround(value / scale);
+}
+
+static int activation_range(int activation, double scale, int32_t zero_point, int32_t *act_min, int32_t *act_max) {
+    int32_t low = -128;
+    int32_t high = 127;
+    switch (activation) {
+    case TFLITE_ACT_NONE:
+        break;
+    case TFLITE_ACT_RELU:
+        low = zero_point;
+        break;
+    case TFLITE_ACT_RELU_N1_TO_1:
+        low = quantize_activation(-1.0, scale, zero_point);
+        high = quantize_activation(1.0, scale, zero_point);
+        break;
+    case TFLITE_ACT_RELU6:
+        low = zero_point;
+        high = quantize_activation(6.0, scale, zero_point);
+        break;
+    default:
+        return 1;
+    }
+    *act_min = low > -128 ? low : -128;
+    *act_max = high < 127 ? high : 127;
+    return 0;
+}
+
+// One FULLY_CONNECTED operator into layer; input is the tensor feeding it
+static int load_fully_connected(Fb_Reader *fb, size_t model, size_t subgraph, size_t op,
+                                const Tflite_Tensor *input, int output_index, Ann_Layer *layer) {
+    uint32_t num_inputs;
+    size_t inputs = fb_vector(fb, fb_field(fb, op, 1), 4, &num_inputs);
+    Tflite_Tensor weights, bias, output;
+    int has_bias = num_inputs > 2 && (int32_t)fb_u32(fb, inputs + 8) >= 0;
+
+    if (num_inputs < 2 || read_tensor(fb, model, subgraph, (int32_t)fb_u32(fb, inputs + 4), &weights)
+        || read_tensor(fb, model, subgraph, output_index, &output)
+        || (has_bias && read_tensor(fb, model, subgraph, (int32_t)fb_u32(fb, inputs + 8), &bias))) {
+        return 1;
+    }
+    int num_outputs = weights.num_dims == 2 ? weights.dims[0] : 0;
+    int input_size = weights.num_dims == 2 ? weights.dims[1] : 0;
+    if (num_outputs < 1 || input_size != input->dims[input->num_dims - 1]
+        || weights.type != TFLITE_TENSOR_INT8 || weights.data_bytes != (size_t)num_outputs * input_size
+        || (weights.num_scales != 1 && weights.num_scales != (uint32_t)num_outputs)
+        || !is_int8_activation(&output) || output.dims[output.num_dims - 1] != num_outputs
+        || (has_bias && (bias.type != TFLITE_TENSOR_INT32 || bias.data_bytes != (size_t)num_outputs * 4))) {
+        return 1;
+    }
+
+    // FullyConnectedOptions: fused_activation_function, weights_format (0 = DEFAULT)
+    size_t options = fb_deref(fb, fb_field(fb, op, 4));
+    int activation = fb_byte_field(fb, options, 0, TFLITE_ACT_NONE);
+    if (fb_byte_field(fb, options, 1, 0) != 0) {
+        return 1;
+    }
+
+    double input_scale = tensor_scale(fb, input, 0);
+    int32_t input_zero_point = tensor_zero_point(fb, input, 0);
+    double output_scale = tensor_scale(fb, &output, 0);
+
+    layer->input_size = input_size;
+    layer->num_outputs = num_outputs;
+    layer->row_stride = ALIGN_ROW(input_size);
+    layer->output_offset = tensor_zero_point(fb, &output, 0);
+    if (activation_range(activation, output_scale, layer->output_offset, &layer->act_min, &layer->act_max)) {
+        return 1;
+    }
+    layer->weights = aligned_alloc(ANN_ROW_ALIGN, (size_t)num_outputs * layer->row_stride);
+    layer->bias = malloc(num_outputs * sizeof(int32_t));
+    layer->multiplier = malloc(num_outputs * sizeof(int32_t));
+    layer->shift = malloc(num_outputs * sizeof(int));
+    if (!layer->weights || !layer->bias || !layer->multiplier || !layer->shift) {
+        perror("Failed to allocate ANN layer");
+        return 1;
+    }
+
+    for (int o = 0; o < num_outputs; o++) {
+        const int8_t *src = (const int8_t *)weights.data + (size_t)o * input_size;
+        int8_t *row = layer->weights + (size_t)o * layer->row_stride;
+        int32_t row_sum = 0;
+        if (tensor_zero_point(fb, &weights, o) != 0) {
+            return 1;
+        }
+        memcpy(row, src, input_size);
+        memset(row + input_size, 0, layer->row_stride - input_size);
+        for (int i = 0; i < input_size; i++) {
+            row_sum += src[i];
+        }
+
+        // sum((x - zp) * w) + b == sum(x * w) + (b - zp * sum(w))
+        int32_t b = 0;
+        if (has_bias) {
+            memcpy(&b, bias.data + 4 * (size_t)o, 4);
+        }
+        layer->bias[o] = b - input_zero_point * row_sum;
+        quantize_multiplier(input_scale * tensor_scale(fb, &weights, o) / output_scale,
+                            &layer->multiplier[o], &layer->shift[o]);
+    }
+    return fb->bad;
+}
+
+static int parse_tflite(Fb_Reader *fb, Ann_Network *ann) {
+    if (fb->size < 8 || memcmp(fb->data + 4, "TFL3", 4) != 0) {
+        return 1;
+    }
+    size_t model = fb_u32(fb, 0);  // root table
+    size_t subgraph = fb_vector_table(fb, fb_field(fb, model, 2), 0);
+    uint32_t num_ops, num_io;
+    size_t ops = fb_vector(fb, fb_field(fb, subgraph, 3), 4, &num_ops);
+
+    size_t io = fb_vector(fb, fb_field(fb, subgraph, 1), 4, &num_io);
+    int current = num_io == 1 ? (int32_t)fb_u32(fb, io) : -1;
+    Tflite_Tensor tensor;
+    if (read_tensor(fb, model, subgraph, current, &tensor) || !is_int8_activation(&tensor)) {
+        return 1;
+    }
+    // Pixels are scaled to [0, 1] before quantization, as in training
+    double input_scale = tensor_scale(fb, &tensor, 0);
+    int32_t input_zero_point = tensor_zero_point(fb, &tensor, 0);
+    for (int p = 0; p < 256; p++) {
+        int32_t q = quantize_activation(p / 255.0, input_scale, input_zero_point);
+        ann->input_lut[p] = (int8_t)(q < -128 ? -128 : q > 127 ? 127 : q);
+    }
+    ann->max_width = tensor.dims[tensor.num_dims - 1];
+
+    ann->layers = calloc(num_ops ? num_ops : 1, sizeof(Ann_Layer));
+    if (!ann->layers) {
+        perror("Failed to allocate ANN layers");
+        return 1;
+    }
+    for (uint32_t k = 0; k < num_ops; k++) {
+        size_t op = fb_deref(fb, ops + 4 * (size_t)k);
+        uint32_t num_inputs, num_outputs;
+        size_t inputs = fb_vector(fb, fb_field(fb, op, 1), 4, &num_inputs);
+        size_t outputs = fb_vector(fb, fb_field(fb, op, 2), 4, &num_outputs);
+        if (num_inputs < 1 || num_outputs != 1 || (int32_t)fb_u32(fb, inputs) != current) {
+            return 1;
+        }
+
+        // OperatorCode: deprecated_builtin_code (int8), ..., builtin_code (int32)
+        uint32_t opcode_index = (uint32_t)fb_int_field(fb, op, 0, 0);
+        size_t opcode = fb_vector_table(fb, fb_field(fb, model, 1), opcode_index);
+        int code = fb_int_field(fb, opcode, 3, 0);
+        int deprecated = fb_byte_field(fb, opcode, 0, 0);
+        code = code > deprecated ? code : deprecated;
+
+        int output_index = (int32_t)fb_u32(fb, outputs);
+        if (code == TFLITE_OP_RESHAPE) {
+            // A flatten between dense layers only renames the activation
+            Tflite_Tensor output;
+            if (read_tensor(fb, model, subgraph, output_index, &output) || !is_int8_activation(&output)
+                || tensor_scale(fb, &output, 0) != tensor_scale(fb, &tensor, 0)
+                || tensor_zero_point(fb, &output, 0) != tensor_zero_point(fb, &tensor, 0)) {
+                return 1;
+            }
+        } else if (code == TFLITE_OP_FULLY_CONNECTED) {
+            Ann_Layer *layer = &ann->layers[ann->num_layers++];
+            if (load_fully_connected(fb, model, subgraph, op, &tensor, output_index, layer)) {
+                return 1;
+            }
+            if (layer->num_outputs > ann->max_width) {
+                ann->max_width = layer->num_outputs;
+            }
+        } else {
+            fprintf(stderr, "Error: unsupported TFLite operator %d in the ANN model\n", code);
+            return 1;
+        }
+        current = output_index;
+        if (read_tensor(fb, model, subgraph, current, &tensor)) {
+            return 1;
+        }
+    }
+
+    io = fb_vector(fb, fb_field(fb, subgraph, 2), 4, &num_io);
+    if (ann->num_layers < 1 || num_io != 1 || (int32_t)fb_u32(fb, io) != current) {
+        return 1;
+    }
+    return fb->bad;
+}
+
+int load_ann_tflite(const char *filename, Ann_Network *ann) {
+    memset(ann, 0, sizeof(*ann));
+
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        perror("Failed to open ANN model");
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+    if (!data || fread(data, 1, (size_t)size, file) != (size_t)size) {
+        fprintf(stderr, "Error: cannot read ANN model %s\n", filename);
+        free(data);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    dsp_init_dispatch();
+    Fb_Reader fb = { data, (size_t)size, 0 };
+    int status = parse_tflite(&fb, ann);
+    free(data);
+    if (status) {
+        fprintf(stderr, "Error: %s is not an int8 fully connected TFLite model\n", filename);
+        free_ann(ann);
+        return 1;
+    }
+
+    ann->max_width = ALIGN_ROW(ann->max_width);
+    for (int k = 0; k < 2; k++) {
+        ann->activations[k] = aligned_alloc(ANN_ROW_ALIGN, ann->max_width);
+        if (!ann->activations[k]) {
+            perror("Failed to allocate ANN activations");
+            free_ann(ann);
+            return 1;
+        }
+        memset(ann->activations[k], 0, ann->max_width);
+    }
+    return 0;
+}
+
+void free_ann(Ann_Network *ann) {
+    for (int l = 0; l < ann->num_layers; l++) {
+        free(ann->layers[l].weights);
+        free(ann->layers[l].bias);
+        free(ann->layers[l].multiplier);
+        free(ann->layers[l].shift);
+    }
+    free(ann->layers);
+    free(ann->activations[0]);
+    free(ann->activations[1]);
+    memset(ann, 0, sizeof(*ann));
+}
+
+// TFLite MultiplyByQuantizedMultiplier: saturating rounding doubling high
+// multiply, then a rounding right shift
+static int32_t requantize(int32_t acc, int32_t multiplier, int shift) {
+    int left = shift > 0 ? shift : 0;
+    int right = shift > 0 ? 0 : -shift;
+    int64_t x = (int64_t)acc * ((int64_t)1 << left);
+    int32_t a = x > INT32_MAX ? INT32_MAX : x < INT32_MIN ? INT32_MIN : (int32_t)x;
+
+    int32_t high;
+    if (a == INT32_MIN && multiplier == INT32_MIN) {
+        high = INT32_MAX;
+    } else {
+        int64_t ab = (int64_t)a * multiplier;
+        int64_t nudge = ab >= 0 ? (1 << 30) : (1 - (1 << 30));
+        high = (int32_t)((ab + nudge) / ((int64_t)1 << 31));
+    }
+
+    int32_t mask = (int32_t)(((int64_t)1 << right) - 1);
+    int32_t remainder = high & mask;
+    int32_t threshold = (mask >> 1) + (high < 0);
+    return (high >> right) + (remainder > threshold);
+}
+
+int ann_inference(Ann_Network *ann, const uint8_t *pixels) {
+    int8_t *in = ann->activations[0];
+    int8_t *out = ann->activations[1];
+    const Ann_Layer *first = &ann->layers[0];
+
+    for (int i = 0; i < first->input_size; i++) {
+        in[i] = ann->input_lut[pixels[i]];
+    }
+    for (int l = 0; l < ann->num_layers; l++) {
+        const Ann_Layer *layer = &ann->layers[l];
+        for (int o = 0; o < layer->num_outputs; o++) {
+            // Rows are zero padded, so the kernel runs whole vectors over row_stride
+            int32_t acc = q7_dot_q7_kernel(layer->weights + (size_t)o * layer->row_stride, in, layer->row_stride)
+                        + layer->bias[o];
+            int32_t q = requantize(acc, layer->multiplier[o], layer->shift[o]) + layer->output_offset;
+            out[o] = (int8_t)(q < layer->act_min ? layer->act_min : q > layer->act_max ? layer->act_max : q);
+        }
+        int8_t *temp = in;
+        in = out;
+        out = temp;
+    }
+
+    const Ann_Layer *last = &ann->layers[ann->num_layers - 1];
+    int best = 0;
+    for (int o = 1; o < last->num_outputs; o++) {
+        if (in[o] > in[best]) {
+            best = o;
+        }
+    }
+    return best;
+}
+
+uint64_t ann_macs(const Ann_Network *ann) {
+    uint64_t macs = 0;
+    for (int l = 0; l < ann->num_layers; l++) {
+        macs += (uint64_t)ann->layers[l].input_size * ann->layers[l].num_outputs;
+    }
+    return macs;
+}
+
+size_t ann_param_bytes(const Ann_Network *ann) {
+    size_t bytes = sizeof(ann->input_lut);
+    for (int l = 0; l < ann->num_layers; l++) {
+        const Ann_Layer *layer = &ann->layers[l];
+        bytes += (size_t)layer->num_outputs * layer->row_stride
+               + (size_t)layer->num_outputs * (sizeof(int32_t) * 2 + sizeof(int));
+    }
+    return bytes;
+}
+
+size_t ann_state_bytes(const Ann_Network *ann) {
+    return 2 * (size_t)ann->max_width;
+}
@@ -0,0 +1,48 @@
+#ifndef ANN_BASELINE_H
+#define ANN_BASELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Int8 dense MLP used as the ANN reference for the SNN engine. Runs the fully
+// connected int8 TFLite models this repo ships (src/tinyml/model.tflite) with
+// the TFLite integer arithmetic: int8 inputs and weights, int32 accumulate,
+// per-output fixed-point requantization and a clamp for the fused activation.
+typedef struct {
+    int input_size;
+    int num_outputs;
+    int row_stride;         // input_size rounded up to 64 bytes, padding is zero
+    int8_t *weights;        // [num_outputs][row_stride], one row per output
+    int32_t *bias;          // [num_outputs] with the input zero point folded in
+    int32_t *multiplier;    // [num_outputs] Q0.31 requantization multiplier
+    int *shift;             // [num_outputs] power-of-two exponent, > 0 shifts left
+    int32_t output_offset;  // output zero point
+    int32_t act_min;        // fused activation clamp, in the output quantization
+    int32_t act_max;
+} Ann_Layer;
+
+typedef struct {
+    Ann_Layer *layers;
+    int num_layers;
+    int8_t input_lut[256];  // pixel byte -> quantized model input
+    int max_width;          // widest activation rounded up to 64, length of the scratch buffers
+    int8_t *activations[2]; // [max_width] each, ping-pong between layers, zero padded
+} Ann_Network;
+
+// Load a TFLite flatbuffer made of FULLY_CONNECTED (and RESHAPE) operators with
+// int8 activations and weights. Weights are copied, the file is not kept open.
+// Returns 0 on success, 1 if the file cannot be read or uses anything else.
+int load_ann_tflite(const char *filename, Ann_Network *ann);
+void free_ann(Ann_Network *ann);
+
+// Classify one sample of input_size pixel bytes (0..255); returns the argmax output.
+// Not re-entrant: the activations live in ann.
+int ann_inference(Ann_Network *ann, const uint8_t *pixels);
+
+// Multiply-accumulates per sample
+uint64_t ann_macs(const Ann_Network *ann);
+// Bytes of parameters (weights, bias, requantization) and of activation scratch
+size_t ann_param_bytes(const Ann_Network *ann);
+size_t ann_state_bytes(const Ann_Network *ann);
+
+#endif // ANN_BASELINE_H
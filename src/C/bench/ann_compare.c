@@ -0,0 +1,431 @@
+// SNN vs int8 dense ANN on the same host and the same MNIST samples: per-sample
+// latency, arithmetic per sample (synaptic adds vs MACs), memory footprint and
+// accuracy side by side. The ANN is the TFLite model under src/tinyml run by
+// ann_baseline.c; the SNN is the built-in 784-256-10 model, run once with Q0.7
+// membranes and once in float32. Results go to <out>.json and <out>.csv next
+// to the snn_bench reports.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../ann_baseline.h"
+#include "../define.h"
+#include "../dsp_helper.h"
+#include "../dummy.h"
+#include "../file_operations.h"
+#include "../rate_encoding.h"
+#include "../snn_network.h"
+#include "../snn_stats.h"
+
+Snn_Network snn_network;
+
+typedef struct {
+    const char *tag;
+    const char *out;
+    const char *images_path;
+    const char *labels_path;
+    const char *model_path;
+    int num_samples;        // 0 runs every image
+    int warmup;
+    int tau;
+    int time_window;
+    uint64_t seed;
+    Encoder_Kind encoder;
+    const char *weights;    // SNN weight storage, as given to --weights
+    Weight_Format weight_formats[NUM_LAYERS];
+} Compare_Config;
+
+// One engine's line of the report
+typedef struct {
+    char engine[8];
+    int samples;
+    int correct;
+    double min_ns;
+    double median_ns;
+    double p99_ns;
+    double samples_per_s;
+    double ops_per_sample;  // ANN MACs or SNN synaptic adds
+    double neuron_updates;  // SNN membrane updates per sample, 0 for the ANN
+    size_t param_bytes;
+    size_t state_bytes;
+} Compare_Record;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void summarize(Compare_Record *record, uint64_t *values, int count) {
+    qsort(values, count, sizeof(uint64_t), compare_u64);
+    int p99 = (int)(0.99 * (count - 1) + 0.5);
+    record->samples = count;
+    record->min_ns = (double)values[0];
+    record->median_ns = (count & 1) ? (double)values[count / 2]
+                                    : 0.5 * ((double)values[count / 2 - 1] + (double)values[count / 2]);
+    record->p99_ns = (double)values[p99];
+    record->samples_per_s = record->median_ns > 0 ? 1e9 / record->median_ns : 0;
+}
+
+// Weights, bias and neuron parameters shared by every context. Every layer
+// keeps its int8 tiles, padded to whole Q7_TILE_NEURONS tiles; float32 and
+// packed layers add the rows they were converted to.
+static size_t snn_param_bytes(const Snn_Network *net) {
+    size_t bytes = 2 * (size_t)net->total_neurons * sizeof(sum_t);
+    for (int l = 1; l < net->num_layers; l++) {
+        const Layer *layer = &net->layers[l];
+        size_t padded = (layer->num_neurons + Q7_TILE_NEURONS - 1) / Q7_TILE_NEURONS * Q7_TILE_NEURONS;
+        bytes += (size_t)layer->input_size * padded + layer->num_neurons;
+        if (layer->precision == PRECISION_FLOAT32) {
+            bytes += ((size_t)layer->input_size * layer->f32_stride + layer->num_neurons) * sizeof(float);
+        } else if (layer->weight_format != WEIGHTS_INT8) {
+            bytes += (size_t)layer->input_size * layer->packed_stride + sizeof(layer->weight_lut);
+        }
+    }
+    return bytes;
+}
+
+// What create_context allocates for one inference in flight
+static size_t snn_state_bytes(const Snn_Network *net) {
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_chunks = net->time_window / net->tau;
+    size_t event_stride = ((size_t)net->max_neurons + 15) & ~(size_t)15;
+    return (size_t)net->total_neurons * sizeof(sum_t)
+         + 2 * (size_t)net->tau * net->spike_bytes
+         + (size_t)net->tau * net->max_neurons * sizeof(sum_t)
+         + (size_t)net->max_neurons * sizeof(int32_t)
+         + (size_t)num_outputs * num_chunks * sizeof(int) + num_outputs * sizeof(int *)
+         + 2 * ((size_t)net->tau * event_stride * sizeof(uint16_t) + net->tau * sizeof(int))
+         + net->num_layers * sizeof(int);
+}
+
+// Event-driven work of one sample, counted from the spikes each layer receives:
+// every presynaptic spike costs one add per postsynaptic neuron (one for the
+// input LIF layer), and every neuron is leaked and thresholded once per step.
+static void count_snn_ops(Snn_Context *ctx, Spike_Encoder *enc, uint64_t *synaptic_adds,
+                          uint64_t *neuron_updates) {
+    const Snn_Network *net = ctx->net;
+    int num_chunks = net->time_window / net->tau;
+
+    reset_context(ctx);
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+        uint8_t *ping = ctx->ping_pong[0];
+        uint8_t *pong = ctx->ping_pong[1];
+        encoder_next_chunk(enc, ping, net->tau, net->spike_bytes);
+        for (int l = net->first_layer; l < net->num_layers; l++) {
+            const Layer *layer = &net->layers[l];
+            int inputs = l == 0 ? layer->num_neurons : layer->input_size;
+            uint64_t spikes = stats_count_spikes(ping, net->spike_bytes, net->tau, inputs);
+            *synaptic_adds += l == 0 ? spikes : spikes * layer->num_neurons;
+            *neuron_updates += (uint64_t)layer->num_neurons * net->tau;
+
+            context_update_layer(ctx, ping, pong, l);
+            uint8_t *temp = ping;
+            ping = pong;
+            pong = temp;
+        }
+    }
+}
+
+static void run_snn(Compare_Record *record, const Compare_Config *cfg, Layer_Precision precision,
+                    const Idx_Dataset *images, const Idx_Dataset *labels, int *predictions) {
+    const Snn_Network *net = &snn_network;
+    uint64_t *sample_ns = calloc(cfg->num_samples, sizeof(uint64_t));
+    uint64_t synaptic_adds = 0;
+    uint64_t neuron_updates = 0;
+    Snn_Context ctx;
+    Spike_Encoder enc;
+
+    for (int l = 0; l < net->num_layers; l++) {
+        if (set_layer_precision(&snn_network, l, precision)) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (!sample_ns || create_context(&ctx, net)) {
+        perror("Failed to allocate SNN timings");
+        exit(EXIT_FAILURE);
+    }
+    encoder_init(&enc, cfg->encoder, net->layers[0].num_neurons, net->time_window, cfg->seed);
+
+    for (int d = -cfg->warmup; d < cfg->num_samples; d++) {
+        int s = d < 0 ? (d % cfg->num_samples + cfg->num_samples) % cfg->num_samples : d;
+        const uint8_t *pixels = images->data + (size_t)s * images->item_bytes;
+
+        // Encoding is part of the SNN's per-sample cost, as quantizing is for the ANN
+        uint64_t start = now_ns();
+        encoder_begin(&enc, pixels, 1, (uint64_t)s);
+        int prediction = context_inference_stream(&ctx, &enc);
+        uint64_t elapsed = now_ns() - start;
+        if (d < 0) {
+            continue;
+        }
+        sample_ns[d] = elapsed;
+        predictions[d] = prediction;
+        record->correct += prediction == labels->data[d];
+
+        encoder_begin(&enc, pixels, 1, (uint64_t)s);
+        count_snn_ops(&ctx, &enc, &synaptic_adds, &neuron_updates);
+    }
+
+    snprintf(record->engine, sizeof(record->engine), "snn-%s", precision == PRECISION_FLOAT32 ? "f32" : "q07");
+    summarize(record, sample_ns, cfg->num_samples);
+    record->ops_per_sample = (double)synaptic_adds / cfg->num_samples;
+    record->neuron_updates = (double)neuron_updates / cfg->num_samples;
+    record->param_bytes = snn_param_bytes(net);
+    record->state_bytes = snn_state_bytes(net);
+    destroy_context(&ctx);
+    free(sample_ns);
+}
+
+static void run_ann(Compare_Record *record, const Compare_Config *cfg, Ann_Network *ann,
+                    const Idx_Dataset *images, const Idx_Dataset *labels, int *predictions) {
+    uint64_t *sample_ns = calloc(cfg->num_samples, sizeof(uint64_t));
+    if (!sample_ns) {
+        perror("Failed to allocate ANN timings");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int d = -cfg->warmup; d < cfg->num_samples; d++) {
+        int s = d < 0 ? (d % cfg->num_samples + cfg->num_samples) % cfg->num_samples : d;
+        uint64_t start = now_ns();
+        int prediction = ann_inference(ann, images->data + (size_t)s * images->item_bytes);
+        uint64_t elapsed = now_ns() - start;
+        if (d < 0) {
+            continue;
+        }
+        sample_ns[d] = elapsed;
+        predictions[d] = prediction;
+        record->correct += prediction == labels->data[d];
+    }
+
+    snprintf(record->engine, sizeof(record->engine), "ann");
+    summarize(record, sample_ns, cfg->num_samples);
+    record->ops_per_sample = (double)ann_macs(ann);
+    record->param_bytes = ann_param_bytes(ann);
+    record->state_bytes = ann_state_bytes(ann);
+    free(sample_ns);
+}
+
+static int write_csv(const Compare_Record *records, int count, const Compare_Config *cfg, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open compare csv");
+        return 1;
+    }
+    fprintf(file, "tag,kernel,engine,samples,accuracy,min_ns,median_ns,p99_ns,samples_per_s,"
+                  "ops_per_sample,neuron_updates,param_bytes,state_bytes\n");
+    for (int i = 0; i < count; i++) {
+        const Compare_Record *r = &records[i];
+        fprintf(file, "%s,%s,%s,%d,%.6f,%.0f,%.0f,%.0f,%.1f,%.1f,%.1f,%zu,%zu\n", cfg->tag,
+                dsp_kernel_name(dsp_active_kernel()), r->engine, r->samples, (double)r->correct / r->samples,
+                r->min_ns, r->median_ns, r->p99_ns, r->samples_per_s, r->ops_per_sample, r->neuron_updates,
+                r->param_bytes, r->state_bytes);
+    }
+    if (fclose(file)) {
+        perror("Failed to write compare csv");
+        return 1;
+    }
+    return 0;
+}
+
+static int write_json(const Compare_Record *records, int count, const Compare_Config *cfg, double agreement,
+                      double precision_agreement, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open compare json");
+        return 1;
+    }
+    fprintf(file, "{\n  \"tag\": \"%s\",\n  \"kernel\": \"%s\",\n  \"encoder\": \"%s\",\n  \"tau\": %d,\n"
+                  "  \"time_window\": %d,\n  \"samples\": %d,\n  \"warmup\": %d,\n  \"agreement\": %.6f,\n"
+                  "  \"precision_agreement\": %.6f,\n  \"weights\": \"%s\",\n  \"results\": [\n",
+            cfg->tag, dsp_kernel_name(dsp_active_kernel()), encoder_name(cfg->encoder), cfg->tau,
+            cfg->time_window, cfg->num_samples, cfg->warmup, agreement, precision_agreement, cfg->weights);
+    for (int i = 0; i < count; i++) {
+        const Compare_Record *r = &records[i];
+        fprintf(file, "    {\"engine\": \"%s\", \"samples\": %d, \"accuracy\": %.6f, \"min_ns\": %.0f, "
+                      "\"median_ns\": %.0f, \"p99_ns\": %.0f, \"samples_per_s\": %.1f, "
+                      "\"ops_per_sample\": %.1f, \"neuron_updates\": %.1f, \"param_bytes\": %zu, "
+                      "\"state_bytes\": %zu}%s\n",
+                r->engine, r->samples, (double)r->correct / r->samples, r->min_ns, r->median_ns, r->p99_ns,
+                r->samples_per_s, r->ops_per_sample, r->neuron_updates, r->param_bytes, r->state_bytes,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (fclose(file)) {
+        perror("Failed to write compare json");
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --images idx --labels idx [--model tflite] [--samples N] [--warmup N]\n"
+                    "          [--encoder E] [--tau T] [--window W] [--seed S] [--weights W] [--tag name]\n"
+                    "          [--out prefix]\n", prog);
+    fprintf(stderr, "  --model defaults to ../tinyml/model.tflite; --samples 0 runs every image\n");
+    fprintf(stderr, "  --weights int8|int4|ternary (or one per layer) sets the SNN weight storage\n");
+    fprintf(stderr, "  results are written to <prefix>.json and <prefix>.csv (default build/compare)\n");
+}
+
+int main(int argc, char **argv) {
+    Compare_Config cfg = {
+        .tag = "local",
+        .out = "build/compare",
+        .model_path = "../tinyml/model.tflite",
+        .num_samples = 0,
+        .warmup = 100,
+        .tau = TAU,
+        .time_window = TIME_WINDOW,
+        .seed = 3,
+        .encoder = ENCODER_RATE,
+        .weights = weight_format_name(DEFAULT_WEIGHT_FORMAT),
+    };
+    weight_format_parse(cfg.weights, cfg.weight_formats, NUM_LAYERS);
+    for (int i = 1; i < argc; i++) {
+        int bad = 0;
+        if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+            cfg.images_path = argv[++i];
+        } else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc) {
+            cfg.labels_path = argv[++i];
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            cfg.model_path = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            cfg.num_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            cfg.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc) {
+            bad = encoder_parse(argv[++i], &cfg.encoder);
+        } else if (strcmp(argv[i], "--tau") == 0 && i + 1 < argc) {
+            cfg.tau = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            cfg.time_window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            cfg.seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            cfg.weights = argv[++i];
+            bad = weight_format_parse(cfg.weights, cfg.weight_formats, NUM_LAYERS);
+        } else if (strcmp(argv[i], "--tag") == 0 && i + 1 < argc) {
+            cfg.tag = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            cfg.out = argv[++i];
+        } else {
+            bad = 1;
+        }
+        if (bad) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!cfg.images_path || !cfg.labels_path || cfg.num_samples < 0 || cfg.warmup < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Idx_Dataset images = {0};
+    Idx_Dataset labels = {0};
+    Ann_Network ann;
+    if (load_idx(cfg.images_path, &images) || load_idx(cfg.labels_path, &labels)) {
+        free_idx(&images);
+        return 1;
+    }
+    if (images.item_bytes != INPUT_SIZE || labels.item_bytes != 1 || labels.num_items < images.num_items) {
+        fprintf(stderr, "Error: %s and %s do not match the %d-pixel model input\n", cfg.images_path,
+                cfg.labels_path, INPUT_SIZE);
+        free_idx(&images);
+        free_idx(&labels);
+        return 1;
+    }
+    if (cfg.num_samples == 0 || cfg.num_samples > images.num_items) {
+        cfg.num_samples = images.num_items;
+    }
+    if (load_ann_tflite(cfg.model_path, &ann)) {
+        free_idx(&images);
+        free_idx(&labels);
+        return 1;
+    }
+    if (ann.layers[0].input_size != INPUT_SIZE) {
+        fprintf(stderr, "Error: %s takes %d inputs, not %d\n", cfg.model_path, ann.layers[0].input_size, INPUT_SIZE);
+        free_ann(&ann);
+        free_idx(&images);
+        free_idx(&labels);
+        return 1;
+    }
+
+    Snn_Layer_Desc layers[NUM_LAYERS] = {
+        { INPUT_SIZE, NULL, NULL, NULL },
+        { HIDDEN_LAYER_1, &weights_fc1_data[0][0], bias_fc1, NULL },
+        { NUM_CLASSES, &weights_fc2_data[0][0], bias_fc2, NULL },
+    };
+    Snn_Network_Desc desc = { NUM_LAYERS, cfg.tau, cfg.time_window, layers, 0, 0, INPUT_LIF, NULL, 0 };
+    if (build_network(&snn_network, &desc)) {
+        free_ann(&ann);
+        free_idx(&images);
+        free_idx(&labels);
+        return 1;
+    }
+
+    for (int l = 0; l < NUM_LAYERS; l++) {
+        if (set_layer_weight_format(&snn_network, l, cfg.weight_formats[l])) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Rows: SNN in Q0.7, SNN in float32, ANN
+    Compare_Record records[3];
+    int count = 3;
+    int *predictions = calloc(count * (size_t)cfg.num_samples, sizeof(int));
+    if (!predictions) {
+        perror("Failed to allocate predictions");
+        exit(EXIT_FAILURE);
+    }
+    memset(records, 0, sizeof(records));
+    run_snn(&records[0], &cfg, PRECISION_Q07, &images, &labels, predictions);
+    run_snn(&records[1], &cfg, PRECISION_FLOAT32, &images, &labels, predictions + cfg.num_samples);
+    run_ann(&records[2], &cfg, &ann, &images, &labels, predictions + 2 * (size_t)cfg.num_samples);
+
+    int agree = 0;
+    int precision_agree = 0;
+    for (int d = 0; d < cfg.num_samples; d++) {
+        agree += predictions[d] == predictions[2 * cfg.num_samples + d];
+        precision_agree += predictions[d] == predictions[cfg.num_samples + d];
+    }
+    double agreement = (double)agree / cfg.num_samples;
+    double precision_agreement = (double)precision_agree / cfg.num_samples;
+
+    printf("%d samples, tau %d, time window %d, %s encoder, %s kernels, %s SNN weights\n", cfg.num_samples,
+           cfg.tau, cfg.time_window, encoder_name(cfg.encoder), dsp_kernel_name(dsp_active_kernel()), cfg.weights);
+    printf("%-7s %9s %10s %10s %10s %11s %13s %13s %12s %11s\n", "engine", "accuracy", "min ns", "median ns",
+           "p99 ns", "samples/s", "ops/sample", "neuron upd", "param bytes", "state bytes");
+    for (int i = 0; i < count; i++) {
+        const Compare_Record *r = &records[i];
+        printf("%-7s %8.2f%% %10.0f %10.0f %10.0f %11.1f %13.1f %13.1f %12zu %11zu\n", r->engine,
+               100.0 * r->correct / r->samples, r->min_ns, r->median_ns, r->p99_ns, r->samples_per_s,
+               r->ops_per_sample, r->neuron_updates, r->param_bytes, r->state_bytes);
+    }
+    printf("ops/sample: SNN synaptic adds vs ANN int8 MACs; predictions agree with the ANN on %.2f%%\n"
+           "of samples (Q0.7 SNN), and between Q0.7 and float32 SNN on %.2f%%\n",
+           100.0 * agreement, 100.0 * precision_agreement);
+
+    char path[512];
+    int failed = 0;
+    snprintf(path, sizeof(path), "%s.json", cfg.out);
+    failed |= write_json(records, count, &cfg, agreement, precision_agreement, path);
+    snprintf(path, sizeof(path), "%s.csv", cfg.out);
+    failed |= write_csv(records, count, &cfg, path);
+    if (!failed) {
+        printf("Wrote %s.json and %s.csv\n", cfg.out, cfg.out);
+    }
+
+    free(predictions);
+    destroy_network(&snn_network);
+    free_ann(&ann);
+    free_idx(&images);
+    free_idx(&labels);
+    return failed;
+}
@@ -0,0 +1,564 @@
+// Inference benchmark: warm-up, then per-stage latency (encode, every layer,
+// classify) on the single-sample path with a monotonic clock and the TSC,
+// plus batched and threaded throughput, swept over tau, time window, batch
+// size and thread count. Results go to <out>.json and <out>.csv so runs on
+// different commits can be compared.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../define.h"
+#include "../dsp_helper.h"
+#include "../dummy.h"
+#include "../file_operations.h"
+#include "../rate_encoding.h"
+#include "../snn_network.h"
+#include "../snn_threads.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t read_tsc(void) { return __rdtsc(); }
+#else
+static inline uint64_t read_tsc(void) { return 0; }
+#endif
+
+#define BENCH_MAX_LIST 16
+#define BENCH_REPEATS 3     // timed passes per throughput point, best one kept
+
+Snn_Network snn_network;
+
+typedef struct {
+    int values[BENCH_MAX_LIST];
+    int count;
+} Int_List;
+
+typedef struct {
+    const char *tag;
+    const char *out;
+    const char *images_path;
+    int num_samples;
+    int warmup;
+    Encoder_Kind encoder;
+    Int_List tau;
+    Int_List window;
+    Int_List batch;
+    Int_List threads;
+    Early_Exit_Policy early_exit;
+    const char *precision;  // as given to --precision, for the report
+    Layer_Precision precisions[NUM_LAYERS];
+    const char *weights;    // as given to --weights
+    Weight_Format weight_formats[NUM_LAYERS];
+} Bench_Config;
+
+// One line of the report: a latency distribution and/or a throughput
+typedef struct {
+    int tau;
+    int time_window;
+    char engine[16];        // sequential, batch or threads
+    int batch;
+    int threads;
+    char stage[16];         // encode, layerN, classify, sample or run
+    int samples;            // measurements behind the distribution
+    double min_ns;
+    double median_ns;
+    double p99_ns;
+    double mean_cycles;
+    double samples_per_s;
+} Bench_Record;
+
+typedef struct {
+    Bench_Record *records;
+    int count;
+    int capacity;
+} Bench_Report;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int parse_list(const char *text, Int_List *list) {
+    char *end;
+    list->count = 0;
+    while (*text && list->count < BENCH_MAX_LIST) {
+        long value = strtol(text, &end, 10);
+        if (end == text || value < 0) {
+            return 1;
+        }
+        list->values[list->count++] = (int)value;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return *text != '\0' || list->count == 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts values in place and fills the distribution fields of record
+static void summarize(Bench_Record *record, uint64_t *values, int count, uint64_t cycles) {
+    qsort(values, count, sizeof(uint64_t), compare_u64);
+    int p99 = (int)(0.99 * (count - 1) + 0.5);
+    record->samples = count;
+    record->min_ns = (double)values[0];
+    record->median_ns = (count & 1) ? (double)values[count / 2]
+                                    : 0.5 * ((double)values[count / 2 - 1] + (double)values[count / 2]);
+    record->p99_ns = (double)values[p99];
+    record->mean_cycles = (double)cycles / count;
+}
+
+static Bench_Record *add_record(Bench_Report *report, int tau, int time_window, const char *engine,
+                                int batch, int threads, const char *stage) {
+    if (report->count == report->capacity) {
+        int capacity = report->capacity ? report->capacity * 2 : 64;
+        Bench_Record *records = realloc(report->records, capacity * sizeof(Bench_Record));
+        if (!records) {
+            perror("Failed to allocate bench report");
+            exit(EXIT_FAILURE);
+        }
+        report->records = records;
+        report->capacity = capacity;
+    }
+    Bench_Record *record = &report->records[report->count++];
+    memset(record, 0, sizeof(*record));
+    record->tau = tau;
+    record->time_window = time_window;
+    snprintf(record->engine, sizeof(record->engine), "%s", engine);
+    record->batch = batch;
+    record->threads = threads;
+    snprintf(record->stage, sizeof(record->stage), "%s", stage);
+    return record;
+}
+
+static const uint8_t *sample_pixels(const Idx_Dataset *images, int d) {
+    return images->data ? images->data + (size_t)(d % images->num_items) * images->item_bytes : input_data;
+}
+
+// Single-sample path driven a layer at a time, mirroring context_inference_stream
+// with a timestamp around every stage. Stage order: encode, each layer, classify.
+static void bench_stages(Bench_Report *report, const Bench_Config *cfg, const Idx_Dataset *images) {
+    const Snn_Network *net = &snn_network;
+    int tau = net->tau;
+    int num_chunks = net->time_window / tau;
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_stages = net->num_layers + 2;
+    int total = cfg->warmup + cfg->num_samples;
+    uint64_t *stage_ns = calloc((size_t)num_stages * cfg->num_samples, sizeof(uint64_t));
+    uint64_t *sample_ns = calloc(cfg->num_samples, sizeof(uint64_t));
+    uint64_t *stage_cycles = calloc(num_stages, sizeof(uint64_t));
+    uint64_t sample_cycles = 0;
+    Snn_Context ctx;
+    Spike_Encoder enc;
+    int mismatches = 0;
+
+    if (!stage_ns || !sample_ns || !stage_cycles || create_context(&ctx, net)) {
+        perror("Failed to allocate stage timings");
+        exit(EXIT_FAILURE);
+    }
+    encoder_init(&enc, cfg->encoder, net->layers[0].num_neurons, net->time_window, 1);
+
+    for (int d = 0; d < total; d++) {
+        int timed = d >= cfg->warmup;
+        int s = d - cfg->warmup;
+        uint64_t sample_start = now_ns();
+        uint64_t sample_tsc = read_tsc();
+
+        reset_context(&ctx);
+        encoder_begin(&enc, sample_pixels(images, d), 1, (uint64_t)d);
+        for (int i = 0; i < num_outputs; i++) {
+            memset(ctx.firing_rows[i], 0, num_chunks * sizeof(int));
+        }
+
+        for (int chunk = 0; chunk < num_chunks; chunk++) {
+            uint8_t *ping = ctx.ping_pong[0];
+            uint8_t *pong = ctx.ping_pong[1];
+
+            uint64_t t0 = now_ns();
+            uint64_t c0 = read_tsc();
+            encoder_next_chunk(&enc, ping, tau, net->spike_bytes);
+            if (timed) {
+                stage_ns[s] += now_ns() - t0;
+                stage_cycles[0] += read_tsc() - c0;
+            }
+
+            for (int l = net->first_layer; l < net->num_layers; l++) {
+                t0 = now_ns();
+                c0 = read_tsc();
+                context_update_layer(&ctx, ping, pong, l);
+                if (timed) {
+                    stage_ns[(size_t)(1 + l) * cfg->num_samples + s] += now_ns() - t0;
+                    stage_cycles[1 + l] += read_tsc() - c0;
+                }
+                uint8_t *temp = ping;
+                ping = pong;
+                pong = temp;
+            }
+
+            t0 = now_ns();
+            c0 = read_tsc();
+            for (int i = 0; i < num_outputs; i++) {
+                for (int t = 0; t < tau; t++) {
+                    const uint8_t *row = ping + (size_t)t * net->spike_bytes;
+                    ctx.firing_rows[i][chunk] += GET_BIT(row, i);
+                }
+            }
+            int steps_left = net->time_window - (chunk + 1) * tau;
+            int exit_now = steps_left > 0 && early_exit_check(&net->early_exit, ctx.firing_rows, num_outputs,
+                                                              num_chunks, chunk + 1, steps_left);
+            if (timed) {
+                stage_ns[(size_t)(num_stages - 1) * cfg->num_samples + s] += now_ns() - t0;
+                stage_cycles[num_stages - 1] += read_tsc() - c0;
+            }
+            if (exit_now) {
+                break;
+            }
+        }
+
+        uint64_t t0 = now_ns();
+        uint64_t c0 = read_tsc();
+        int classification = classify_inference(ctx.firing_rows, num_outputs, num_chunks);
+        if (timed) {
+            stage_ns[(size_t)(num_stages - 1) * cfg->num_samples + s] += now_ns() - t0;
+            stage_cycles[num_stages - 1] += read_tsc() - c0;
+            sample_ns[s] = now_ns() - sample_start;
+            sample_cycles += read_tsc() - sample_tsc;
+
+            // The layer-at-a-time drive must classify exactly like the engine
+            encoder_begin(&enc, sample_pixels(images, d), 1, (uint64_t)d);
+            mismatches += context_inference_stream(&ctx, &enc) != classification;
+        }
+    }
+
+    for (int stage = 0; stage < num_stages; stage++) {
+        char name[16];
+        if (stage == 0) {
+            snprintf(name, sizeof(name), "encode");
+        } else if (stage == num_stages - 1) {
+            snprintf(name, sizeof(name), "classify");
+        } else if (stage - 1 < net->first_layer) {
+            continue;
+        } else {
+            snprintf(name, sizeof(name), "layer%d", stage - 1);
+        }
+        Bench_Record *record = add_record(report, tau, net->time_window, "sequential", 1, 1, name);
+        summarize(record, stage_ns + (size_t)stage * cfg->num_samples, cfg->num_samples, stage_cycles[stage]);
+    }
+    Bench_Record *record = add_record(report, tau, net->time_window, "sequential", 1, 1, "sample");
+    summarize(record, sample_ns, cfg->num_samples, sample_cycles);
+    record->samples_per_s = record->median_ns > 0 ? 1e9 / record->median_ns : 0;
+
+    if (mismatches) {
+        fprintf(stderr, "Warning: %d samples classified differently by the staged drive\n", mismatches);
+    }
+    destroy_context(&ctx);
+    free(stage_ns);
+    free(sample_ns);
+    free(stage_cycles);
+}
+
+// Encodes every sample up front, the way main does for batched and threaded runs
+static uint8_t *encode_all(const Bench_Config *cfg, const Idx_Dataset *images, int input_bytes) {
+    const Snn_Network *net = &snn_network;
+    size_t sample_bytes = (size_t)net->time_window * input_bytes;
+    uint8_t *spikes = calloc((size_t)cfg->num_samples * sample_bytes, 1);
+    Spike_Encoder enc;
+
+    if (!spikes) {
+        perror("Failed to allocate spikes");
+        exit(EXIT_FAILURE);
+    }
+    encoder_init(&enc, cfg->encoder, net->layers[0].num_neurons, net->time_window, 1);
+    for (int d = 0; d < cfg->num_samples; d++) {
+        encoder_begin(&enc, sample_pixels(images, d), 1, (uint64_t)d);
+        encoder_next_chunk(&enc, spikes + (size_t)d * sample_bytes, net->time_window, input_bytes);
+    }
+    return spikes;
+}
+
+// Batched engine on one thread: latency of each batch_inference call
+static void bench_batch(Bench_Report *report, const Bench_Config *cfg, const uint8_t *spikes,
+                        int input_bytes, int batch_size) {
+    const Snn_Network *net = &snn_network;
+    size_t sample_bytes = (size_t)net->time_window * input_bytes;
+    int num_calls = (cfg->num_samples + batch_size - 1) / batch_size;
+    uint64_t *call_ns = calloc(num_calls, sizeof(uint64_t));
+    int *classifications = calloc(batch_size, sizeof(int));
+    uint64_t best_run = UINT64_MAX;
+    uint64_t cycles = 0;
+    Snn_Batch batch;
+
+    if (!call_ns || !classifications || create_batch(&batch, net, batch_size)) {
+        perror("Failed to allocate batch bench");
+        exit(EXIT_FAILURE);
+    }
+    int warm_count = (cfg->num_samples < batch_size) ? cfg->num_samples : batch_size;
+    for (int d = 0; d < cfg->warmup; d += batch_size) {
+        batch_inference(&batch, spikes, input_bytes, warm_count, classifications, NULL);
+    }
+
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        uint64_t run_start = now_ns();
+        uint64_t run_cycles = read_tsc();
+        for (int call = 0; call < num_calls; call++) {
+            int d = call * batch_size;
+            int count = (cfg->num_samples - d < batch_size) ? cfg->num_samples - d : batch_size;
+            uint64_t t0 = now_ns();
+            batch_inference(&batch, spikes + (size_t)d * sample_bytes, input_bytes, count, classifications, NULL);
+            uint64_t elapsed = now_ns() - t0;
+            if (repeat == 0 || elapsed < call_ns[call]) {
+                call_ns[call] = elapsed;
+            }
+        }
+        uint64_t run_ns = now_ns() - run_start;
+        if (run_ns < best_run) {
+            best_run = run_ns;
+            cycles = read_tsc() - run_cycles;
+        }
+    }
+
+    Bench_Record *record = add_record(report, net->tau, net->time_window, "batch", batch_size, 1, "call");
+    summarize(record, call_ns, num_calls, cycles);
+    record->samples_per_s = 1e9 * cfg->num_samples / (double)best_run;
+
+    destroy_batch(&batch);
+    free(call_ns);
+    free(classifications);
+}
+
+// Thread pool over the whole set: one wall-clock time per timed pass
+static void bench_threads(Bench_Report *report, const Bench_Config *cfg, const uint8_t *spikes,
+                          int input_bytes, int num_threads) {
+    const Snn_Network *net = &snn_network;
+    int *classifications = calloc(cfg->num_samples, sizeof(int));
+    uint64_t run_ns[BENCH_REPEATS];
+    uint64_t cycles = 0;
+    Snn_Thread_Pool pool;
+
+    if (!classifications || create_thread_pool(&pool, net, num_threads, 1)) {
+        perror("Failed to allocate thread bench");
+        exit(EXIT_FAILURE);
+    }
+    if (cfg->warmup) {
+        int warm = cfg->warmup < cfg->num_samples ? cfg->warmup : cfg->num_samples;
+        pool_inference(&pool, spikes, input_bytes, warm, classifications, NULL);
+    }
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++) {
+        uint64_t t0 = now_ns();
+        uint64_t c0 = read_tsc();
+        pool_inference(&pool, spikes, input_bytes, cfg->num_samples, classifications, NULL);
+        run_ns[repeat] = now_ns() - t0;
+        cycles += read_tsc() - c0;
+    }
+
+    Bench_Record *record = add_record(report, net->tau, net->time_window, "threads", 1, pool.num_threads, "run");
+    summarize(record, run_ns, BENCH_REPEATS, cycles);
+    record->samples_per_s = 1e9 * cfg->num_samples / record->min_ns;
+
+    destroy_thread_pool(&pool);
+    free(classifications);
+}
+
+static int write_csv(const Bench_Report *report, const Bench_Config *cfg, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open bench csv");
+        return 1;
+    }
+    fprintf(file, "tag,kernel,tau,time_window,engine,batch,threads,stage,samples,"
+                  "min_ns,median_ns,p99_ns,mean_cycles,samples_per_s\n");
+    for (int i = 0; i < report->count; i++) {
+        const Bench_Record *r = &report->records[i];
+        fprintf(file, "%s,%s,%d,%d,%s,%d,%d,%s,%d,%.0f,%.0f,%.0f,%.0f,%.1f\n",
+                cfg->tag, dsp_kernel_name(dsp_active_kernel()), r->tau, r->time_window, r->engine,
+                r->batch, r->threads, r->stage, r->samples, r->min_ns, r->median_ns, r->p99_ns,
+                r->mean_cycles, r->samples_per_s);
+    }
+    if (fclose(file)) {
+        perror("Failed to write bench csv");
+        return 1;
+    }
+    return 0;
+}
+
+static int write_json(const Bench_Report *report, const Bench_Config *cfg, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open bench json");
+        return 1;
+    }
+    fprintf(file, "{\n  \"tag\": \"%s\",\n  \"kernel\": \"%s\",\n  \"encoder\": \"%s\",\n"
+                  "  \"early_exit\": \"%s\",\n  \"precision\": \"%s\",\n  \"weights\": \"%s\",\n  \"samples\": %d,\n  \"warmup\": %d,\n"
+                  "  \"results\": [\n",
+            cfg->tag, dsp_kernel_name(dsp_active_kernel()), encoder_name(cfg->encoder),
+            early_exit_name(cfg->early_exit.mode), cfg->precision, cfg->weights, cfg->num_samples, cfg->warmup);
+    for (int i = 0; i < report->count; i++) {
+        const Bench_Record *r = &report->records[i];
+        fprintf(file, "    {\"tau\": %d, \"time_window\": %d, \"engine\": \"%s\", \"batch\": %d, "
+                      "\"threads\": %d, \"stage\": \"%s\", \"samples\": %d, \"min_ns\": %.0f, "
+                      "\"median_ns\": %.0f, \"p99_ns\": %.0f, \"mean_cycles\": %.0f, "
+                      "\"samples_per_s\": %.1f}%s\n",
+                r->tau, r->time_window, r->engine, r->batch, r->threads, r->stage, r->samples,
+                r->min_ns, r->median_ns, r->p99_ns, r->mean_cycles, r->samples_per_s,
+                i + 1 < report->count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (fclose(file)) {
+        perror("Failed to write bench json");
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--images idx] [--samples N] [--warmup N] [--encoder E] [--tau list]\n"
+                    "          [--window list] [--batch list] [--threads list] [--early-exit P]\n"
+                    "          [--precision P] [--weights W] [--tag name] [--out prefix]\n", prog);
+    fprintf(stderr, "  lists are comma separated, e.g. --tau 5,10,20; thread count 0 uses every core\n");
+    fprintf(stderr, "  --early-exit off|decided|margin[:N]|confidence[:P] stops a sample once its winner is settled\n");
+    fprintf(stderr, "  --precision q07|float32 sets every layer, or give one per layer: q07,float32,q07\n");
+    fprintf(stderr, "  --weights int8|int4|ternary sets every layer's weight storage, or give one per layer\n");
+    fprintf(stderr, "  results are written to <prefix>.json and <prefix>.csv (default build/bench)\n");
+}
+
+int main(int argc, char **argv) {
+    Bench_Config cfg = {
+        .tag = "local",
+        .out = "build/bench",
+        .num_samples = 1000,
+        .warmup = 100,
+        .encoder = ENCODER_RATE,
+        .tau = {{5, 10, 20}, 3},
+        .window = {{20, 40}, 2},
+        .batch = {{1, 8, 32}, 3},
+        .threads = {{1, 0}, 2},
+        .early_exit = { DEFAULT_EARLY_EXIT, EARLY_EXIT_MARGIN_SPIKES, EARLY_EXIT_CONFIDENCE_PCT,
+                        EARLY_EXIT_MIN_CHUNKS },
+        .precision = precision_name(DEFAULT_PRECISION),
+        .weights = weight_format_name(DEFAULT_WEIGHT_FORMAT),
+    };
+    precision_parse(cfg.precision, cfg.precisions, NUM_LAYERS);
+    weight_format_parse(cfg.weights, cfg.weight_formats, NUM_LAYERS);
+    for (int i = 1; i < argc; i++) {
+        int bad = 0;
+        if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+            cfg.images_path = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            cfg.num_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            cfg.warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc) {
+            bad = encoder_parse(argv[++i], &cfg.encoder);
+        } else if (strcmp(argv[i], "--tau") == 0 && i + 1 < argc) {
+            bad = parse_list(argv[++i], &cfg.tau);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            bad = parse_list(argv[++i], &cfg.window);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            bad = parse_list(argv[++i], &cfg.batch);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            bad = parse_list(argv[++i], &cfg.threads);
+        } else if (strcmp(argv[i], "--early-exit") == 0 && i + 1 < argc) {
+            bad = early_exit_parse(argv[++i], &cfg.early_exit);
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            cfg.precision = argv[++i];
+            bad = precision_parse(cfg.precision, cfg.precisions, NUM_LAYERS);
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            cfg.weights = argv[++i];
+            bad = weight_format_parse(cfg.weights, cfg.weight_formats, NUM_LAYERS);
+        } else if (strcmp(argv[i], "--tag") == 0 && i + 1 < argc) {
+            cfg.tag = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            cfg.out = argv[++i];
+        } else {
+            bad = 1;
+        }
+        if (bad) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.num_samples < 1 || cfg.warmup < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Idx_Dataset images = {0};
+    if (cfg.images_path && load_idx(cfg.images_path, &images)) {
+        return 1;
+    }
+    if (images.data && images.item_bytes != INPUT_SIZE) {
+        fprintf(stderr, "Error: %s does not match the %d-pixel model input\n", cfg.images_path, INPUT_SIZE);
+        free_idx(&images);
+        return 1;
+    }
+
+    Snn_Layer_Desc layers[NUM_LAYERS] = {
+        { INPUT_SIZE, NULL, NULL, NULL },
+        { HIDDEN_LAYER_1, &weights_fc1_data[0][0], bias_fc1, NULL },
+        { NUM_CLASSES, &weights_fc2_data[0][0], bias_fc2, NULL },
+    };
+    Bench_Report report = {0};
+
+    printf("%-5s %-6s %-10s %5s %7s %-9s %12s %12s %12s %12s %12s\n", "tau", "window", "engine", "batch",
+           "threads", "stage", "min ns", "median ns", "p99 ns", "cycles", "samples/s");
+    for (int ti = 0; ti < cfg.tau.count; ti++) {
+        for (int wi = 0; wi < cfg.window.count; wi++) {
+            int tau = cfg.tau.values[ti];
+            int window = cfg.window.values[wi];
+            if (tau < 1 || window < tau || window % tau != 0) {
+                fprintf(stderr, "Skipping tau %d, time window %d: not a whole number of chunks\n", tau, window);
+                continue;
+            }
+            Snn_Network_Desc desc = { NUM_LAYERS, tau, window, layers, 0, 0, INPUT_LIF, NULL, 0 };
+            if (build_network(&snn_network, &desc)) {
+                continue;
+            }
+            for (int l = 0; l < NUM_LAYERS; l++) {
+                if (set_layer_weight_format(&snn_network, l, cfg.weight_formats[l])
+                    || set_layer_precision(&snn_network, l, cfg.precisions[l])) {
+                    exit(EXIT_FAILURE);
+                }
+            }
+            snn_network.early_exit = cfg.early_exit;
+            int first = report.count;
+            int input_bytes = (snn_network.layers[0].num_neurons + 7) / 8;
+
+            bench_stages(&report, &cfg, &images);
+            uint8_t *spikes = encode_all(&cfg, &images, input_bytes);
+            for (int b = 0; b < cfg.batch.count; b++) {
+                if (cfg.batch.values[b] > 0) {
+                    bench_batch(&report, &cfg, spikes, input_bytes, cfg.batch.values[b]);
+                }
+            }
+            for (int t = 0; t < cfg.threads.count; t++) {
+                bench_threads(&report, &cfg, spikes, input_bytes, cfg.threads.values[t]);
+            }
+            free(spikes);
+            destroy_network(&snn_network);
+
+            for (int i = first; i < report.count; i++) {
+                const Bench_Record *r = &report.records[i];
+                printf("%-5d %-6d %-10s %5d %7d %-9s %12.0f %12.0f %12.0f %12.0f %12.1f\n", r->tau,
+                       r->time_window, r->engine, r->batch, r->threads, r->stage, r->min_ns, r->median_ns,
+                       r->p99_ns, r->mean_cycles, r->samples_per_s);
+            }
+        }
+    }
+
+    char path[512];
+    int failed = 0;
+    snprintf(path, sizeof(path), "%s.json", cfg.out);
+    failed |= write_json(&report, &cfg, path);
+    snprintf(path, sizeof(path), "%s.csv", cfg.out);
+    failed |= write_csv(&report, &cfg, path);
+    if (!failed) {
+        printf("Results written to %s.json and %s.csv\n", cfg.out, cfg.out);
+    }
+
+    free(report.records);
+    free_idx(&images);
+    return failed;
+}
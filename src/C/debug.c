@@ -26,9 +26,14 @@ void print_model_overview() {
 }
 
 // Function to print the states of neurons in a layer
-void print_neuron_states(Layer *layer) {
+void print_neuron_states(const Snn_Network *net, const Layer *layer) {
+    const sum_t *membrane = net->membrane + layer->neuron_offset;
     for (int i = 0; i < layer->num_neurons; i++) {
-        printf("  Neuron %d: Membrane Potential = %f\n", i, layer->neurons[i].membrane_potential);
+        float potential = (float)membrane[i];
+        if (layer->precision == PRECISION_FLOAT32) {
+            memcpy(&potential, &membrane[i], sizeof(float));
+        }
+        printf("  Neuron %d: Membrane Potential = %f\n", i, potential);
     }
 }
 
@@ -6,7 +6,7 @@
 // Debug Print Functions
 void print_weights(float **weights, float *bias, int rows, int cols);
 void print_model_overview();
-void print_neuron_states(Layer *layer);
+void print_neuron_states(const Snn_Network *net, const Layer *layer);
 void print_spike_buffer(const char **buffer, int size);
 void print_ping_pong_buffers(const char **buffer1, const char **buffer2, int size);
 void print_firing_counts(int **firing_counts, int num_neurons, int num_chunks);
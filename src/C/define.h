@@ -11,6 +11,7 @@
 
 // Data parameters
 #define NUM_SAMPLES 1
+#define ENCODER_DELTA_THRESH 16 // pixel rise that makes the delta encoder fire
 
 // Network parameters
 #define INPUT_SIZE 784 // 28x28 flattened images
@@ -22,12 +23,66 @@
 #define TIME_WINDOW 20 // Temporal steps in spike train
 #define TAU 10
 
+// 1 pins the engine to the sizes above: static buffers and compile-time loop
+// bounds for hot builds. 0 sizes every buffer from the model at startup.
+#ifndef SNN_FIXED_TOPOLOGY
+#define SNN_FIXED_TOPOLOGY 0
+#endif
+
+// Traversal used by update_layer for each layer (see Traversal_Mode)
+#define DEFAULT_TRAVERSAL TRAVERSE_TILED
+
+// IF layers only: chunk accumulation from spike counts (see If_Popcount_Mode).
+// IF_POPCOUNT_APPROX keeps the total chunk input exact but spreads it evenly
+// over the TAU steps, so spike timing inside a chunk may shift. EXACT only
+// does that for chunks that provably fire nothing, which pays off for layers
+// that sit well below threshold for whole chunks (sparse input, high
+// thresholds); a layer that fires most chunks pays one input popcount and
+// one membrane pass per chunk for nothing.
+#define DEFAULT_IF_POPCOUNT IF_POPCOUNT_EXACT
+
+// How layers hand spikes to the next layer (see Spike_Mode). SPIKES_AUTO also
+// emits per-step index lists while a layer fired in fewer than
+// SPARSE_DENSITY_PCT percent of its neuron-steps in the previous chunk.
+#define DEFAULT_SPIKE_MODE SPIKES_AUTO
+#define SPARSE_DENSITY_PCT 40
+
+// When a sample may stop before TIME_WINDOW (see Early_Exit_Mode). The margin
+// and confidence values only apply to their own modes; no mode exits before
+// EARLY_EXIT_MIN_CHUNKS chunks have run.
+#define DEFAULT_EARLY_EXIT EARLY_EXIT_OFF
+#define EARLY_EXIT_MARGIN_SPIKES 4
+#define EARLY_EXIT_CONFIDENCE_PCT 90
+#define EARLY_EXIT_MIN_CHUNKS 1
+
+// Per-layer, per-chunk activity counters (snn_stats.h). 0 compiles every
+// recording hook out of the engines; make STATS=1 turns them on.
+#ifndef SNN_STATS
+#define SNN_STATS 0
+#endif
+
+// Output neurons per tile in the batched accumulate; B * TAU tiles of sums
+// should fit in L1 alongside the weight row segments
+#define BATCH_TILE_NEURONS 64
+
+// Storage of synaptic weight rows (see Weight_Format). WEIGHTS_INT4 halves and
+// WEIGHTS_TERNARY quarters the bytes streamed per presynaptic spike; both are
+// converted from the int8 tables at build time. --weights overrides per layer.
+#define DEFAULT_WEIGHT_FORMAT WEIGHTS_INT8
+
+// Accumulate int8 weight rows into int16 sums when a layer's static bound
+// (|bias| + sum of |w| per neuron) fits int16, else int32 (see Sum_Width)
+#define INT16_SUMS 1
+
 // Masking parameters
 #define BITMASK_BYTES ((TAU + 7) / 8)
 #define INPUT_BYTES ((INPUT_SIZE + 7) / 8)
 
-// Define the quantization parameters for Q0.7
+// Define the quantization parameters for Q0.7. Q07_FLAG picks the arithmetic
+// every layer starts in: 1 for Q0.7 fixed point, 0 for float32 (see
+// Layer_Precision); --precision switches single layers at runtime.
 #define Q07_FLAG       1
+#define DEFAULT_PRECISION ((Q07_FLAG) ? PRECISION_Q07 : PRECISION_FLOAT32)
 #define Q07_SCALE      128.0f
 #define Q07_INV_SCALE  (1.0f / 128.0f)
 #define Q07_MAX_FLOAT  0.9921875f   // 127 / 128
@@ -48,6 +103,11 @@
 #define DECAY_FP7           ((int16_t)(DECAY_RATE * 128))  // ~121
 #define DECAY_SHIFT         7                         // because scale = 128 = 2^7
 
+// Per-channel weight scales (Snn_Layer_Desc.scales) are folded into each
+// neuron's integer threshold at build time. The cap keeps decay * membrane
+// inside int32; it also sets the smallest scale the converter picks.
+#define MAX_FOLDED_THRESH   (1 << 22)
+
 #ifdef Q07_FLAG
   // For fixed-point: mem and thresh are integer Q0.7 values
   #define HEAVISIDE(mem, thresh) (((mem) >= (thresh)) ? 1 : 0)
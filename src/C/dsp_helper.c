@@ -1,4 +1,30 @@
 #include "dsp_helper.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DSP_HAVE_X86 1
+#else
+#define DSP_HAVE_X86 0
+#endif
+
+q7_add_to_q31_fn q7_add_to_q31_kernel = vectorize_q7_add_to_q31;
+q7_scale_add_to_q31_fn q7_scale_add_to_q31_kernel = vectorize_q7_scale_add_to_q31;
+q7_add_to_q15_fn q7_add_to_q15_kernel = vectorize_q7_add_to_q15;
+q7_add_to_q31_multi_fn q7_add_to_q31_multi_kernel = vectorize_q7_add_to_q31_multi;
+q7_gather_add_to_q31_fn q7_gather_add_to_q31_kernel = vectorize_q7_gather_add_to_q31;
+q7_gather_add_to_q15_fn q7_gather_add_to_q15_kernel = vectorize_q7_gather_add_to_q15;
+q7_dot_q7_fn q7_dot_q7_kernel = vectorize_q7_dot_q7;
+float_add_to_float_fn float_add_to_float_kernel = vectorize_float_add_to_float;
+q4_add_to_q31_fn q4_add_to_q31_kernel = vectorize_q4_add_to_q31;
+ternary_add_to_q31_fn ternary_add_to_q31_kernel = vectorize_ternary_add_to_q31;
+q4_gather_add_to_q31_fn q4_gather_add_to_q31_kernel = vectorize_q4_gather_add_to_q31;
+ternary_gather_add_to_q31_fn ternary_gather_add_to_q31_kernel = vectorize_ternary_gather_add_to_q31;
+static Dsp_Kernel active_kernel = DSP_KERNEL_SCALAR;
+
+// Tile rows are prefetched this many rows ahead of the one being added
+#define GATHER_PREFETCH_ROWS 8
 
 inline void vectorize_q7_add_to_q31(
     const int8_t * __restrict srcA,
@@ -19,6 +45,92 @@ inline void vectorize_q7_add_to_q31(
     }
 }
 
+inline void vectorize_q7_scale_add_to_q31(
+    const int8_t * __restrict srcA,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    // unroll 4 at a time
+    for (; i + 3 < blockSize; i += 4) {
+        dst[i]     = scale * srcA[i] + dst[i];
+        dst[i+1]   = scale * srcA[i+1] + dst[i+1];
+        dst[i+2]   = scale * srcA[i+2] + dst[i+2];
+        dst[i+3]   = scale * srcA[i+3] + dst[i+3];
+    }
+    // leftover
+    for (; i < blockSize; i++) {
+        dst[i] = scale * srcA[i] + dst[i];
+    }
+}
+
+void vectorize_q7_add_to_q15(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+) {
+    for (size_t i = 0; i < blockSize; i++) {
+        int32_t sum = dst[i] + srcA[i];
+        dst[i] = (int16_t)(sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum);
+    }
+}
+
+// Generic fan-out through the single-destination kernel (scalar and SSE4.1 levels)
+void vectorize_q7_add_to_q31_multi(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+) {
+    for (size_t k = 0; k < numDst; k++) {
+        q7_add_to_q31_kernel(srcA, dst_base + offsets[k], blockSize);
+    }
+}
+
+void vectorize_q7_gather_add_to_q31(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    int32_t acc[Q7_TILE_NEURONS];
+    memcpy(acc, dst, blockSize * sizeof(int32_t));
+    for (size_t k = 0; k < numRows; k++) {
+        const int8_t *row = tile + (size_t)rows[k] * Q7_TILE_NEURONS;
+        for (size_t i = 0; i < blockSize; i++) {
+            acc[i] += row[i];
+        }
+    }
+    memcpy(dst, acc, blockSize * sizeof(int32_t));
+}
+
+void vectorize_q7_gather_add_to_q15(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+) {
+    for (size_t k = 0; k < numRows; k++) {
+        vectorize_q7_add_to_q15(tile + (size_t)rows[k] * Q7_TILE_NEURONS, dst, blockSize);
+    }
+}
+
+int32_t vectorize_q7_dot_q7(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+) {
+    int32_t acc = 0;
+    for (size_t i = 0; i < blockSize; i++) {
+        acc += (int32_t)srcA[i] * srcB[i];
+    }
+    return acc;
+}
+
 inline void vectorize_q31_add_to_q31(
     const int32_t * __restrict srcA,
     int32_t       * __restrict dst,
@@ -55,4 +167,1080 @@ inline void vectorize_float_add_to_float(
     for (; i < blockSize; i++) {
         dst[i] = srcA[i] + dst[i];                
     }
-}
\ No newline at end of file
+}
+
+void vectorize_q4_add_to_q31(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    for (size_t g = 0; g < blockSize; g += 32) {
+        size_t width = blockSize - g < 32 ? blockSize - g : 32;
+        size_t half = (width + 1) / 2;
+        const uint8_t *codes = srcA + g / 2;
+        for (size_t k = 0; k < half; k++) {
+            dst[g + k] = lut[codes[k] & 0x0F] + dst[g + k];
+        }
+        for (size_t k = half; k < width; k++) {
+            dst[g + k] = lut[codes[k - half] >> 4] + dst[g + k];
+        }
+    }
+}
+
+void vectorize_ternary_add_to_q31(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    for (size_t i = 0; i < blockSize; i++) {
+        int32_t sign = ((pos[i >> 3] >> (i & 7)) & 1) - ((neg[i >> 3] >> (i & 7)) & 1);
+        dst[i] = sign * scale + dst[i];
+    }
+}
+
+void vectorize_q4_gather_add_to_q31(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    int32_t acc[Q7_TILE_NEURONS];
+    memcpy(acc, dst, blockSize * sizeof(int32_t));
+    for (size_t k = 0; k < numRows; k++) {
+        vectorize_q4_add_to_q31(base + (size_t)rows[k] * rowStride, lut, acc, blockSize);
+    }
+    memcpy(dst, acc, blockSize * sizeof(int32_t));
+}
+
+void vectorize_ternary_gather_add_to_q31(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    int32_t acc[Q7_TILE_NEURONS];
+    memcpy(acc, dst, blockSize * sizeof(int32_t));
+    for (size_t k = 0; k < numRows; k++) {
+        size_t offset = (size_t)rows[k] * rowStride;
+        vectorize_ternary_add_to_q31(pos + offset, neg + offset, scale, acc, blockSize);
+    }
+    memcpy(dst, acc, blockSize * sizeof(int32_t));
+}
+
+#if DSP_HAVE_X86
+// Sign-extend 16 int8 weights at a time into four xmm accumulators
+__attribute__((target("sse4.1")))
+void vectorize_q7_add_to_q31_sse41(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 15 < blockSize; i += 16) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(srcA + i));
+        __m128i w0 = _mm_cvtepi8_epi32(w);
+        __m128i w1 = _mm_cvtepi8_epi32(_mm_srli_si128(w, 4));
+        __m128i w2 = _mm_cvtepi8_epi32(_mm_srli_si128(w, 8));
+        __m128i w3 = _mm_cvtepi8_epi32(_mm_srli_si128(w, 12));
+        __m128i *d = (__m128i *)(dst + i);
+        _mm_storeu_si128(d,     _mm_add_epi32(_mm_loadu_si128(d),     w0));
+        _mm_storeu_si128(d + 1, _mm_add_epi32(_mm_loadu_si128(d + 1), w1));
+        _mm_storeu_si128(d + 2, _mm_add_epi32(_mm_loadu_si128(d + 2), w2));
+        _mm_storeu_si128(d + 3, _mm_add_epi32(_mm_loadu_si128(d + 3), w3));
+    }
+    // leftover
+    for (; i < blockSize; i++) {
+        dst[i] = srcA[i] + dst[i];
+    }
+}
+
+// 16 weights per iteration widened into two xmm registers of int16 lanes
+__attribute__((target("sse4.1")))
+void vectorize_q7_add_to_q15_sse41(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 15 < blockSize; i += 16) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(srcA + i));
+        __m128i *d = (__m128i *)(dst + i);
+        _mm_storeu_si128(d,     _mm_adds_epi16(_mm_loadu_si128(d),     _mm_cvtepi8_epi16(w)));
+        _mm_storeu_si128(d + 1, _mm_adds_epi16(_mm_loadu_si128(d + 1), _mm_cvtepi8_epi16(_mm_srli_si128(w, 8))));
+    }
+    vectorize_q7_add_to_q15(srcA + i, dst + i, blockSize - i);
+}
+
+// 32 weights per iteration: two 16-byte loads widened straight into ymm lanes
+__attribute__((target("avx2")))
+void vectorize_q7_add_to_q31_avx2(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 31 < blockSize; i += 32) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(srcA + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(srcA + i + 16));
+        __m256i w0 = _mm256_cvtepi8_epi32(lo);
+        __m256i w1 = _mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8));
+        __m256i w2 = _mm256_cvtepi8_epi32(hi);
+        __m256i w3 = _mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8));
+        __m256i *d = (__m256i *)(dst + i);
+        _mm256_storeu_si256(d,     _mm256_add_epi32(_mm256_loadu_si256(d),     w0));
+        _mm256_storeu_si256(d + 1, _mm256_add_epi32(_mm256_loadu_si256(d + 1), w1));
+        _mm256_storeu_si256(d + 2, _mm256_add_epi32(_mm256_loadu_si256(d + 2), w2));
+        _mm256_storeu_si256(d + 3, _mm256_add_epi32(_mm256_loadu_si256(d + 3), w3));
+    }
+    for (; i + 7 < blockSize; i += 8) {
+        __m256i w = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(srcA + i)));
+        __m256i *d = (__m256i *)(dst + i);
+        _mm256_storeu_si256(d, _mm256_add_epi32(_mm256_loadu_si256(d), w));
+    }
+    // leftover
+    for (; i < blockSize; i++) {
+        dst[i] = srcA[i] + dst[i];
+    }
+}
+
+// 32 floats per iteration in four ymm registers
+__attribute__((target("avx2")))
+void vectorize_float_add_to_float_avx2(
+    const float * __restrict srcA,
+    float       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 31 < blockSize; i += 32) {
+        _mm256_storeu_ps(dst + i,      _mm256_add_ps(_mm256_loadu_ps(dst + i),      _mm256_loadu_ps(srcA + i)));
+        _mm256_storeu_ps(dst + i + 8,  _mm256_add_ps(_mm256_loadu_ps(dst + i + 8),  _mm256_loadu_ps(srcA + i + 8)));
+        _mm256_storeu_ps(dst + i + 16, _mm256_add_ps(_mm256_loadu_ps(dst + i + 16), _mm256_loadu_ps(srcA + i + 16)));
+        _mm256_storeu_ps(dst + i + 24, _mm256_add_ps(_mm256_loadu_ps(dst + i + 24), _mm256_loadu_ps(srcA + i + 24)));
+    }
+    for (; i + 7 < blockSize; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(srcA + i)));
+    }
+    // leftover
+    for (; i < blockSize; i++) {
+        dst[i] = srcA[i] + dst[i];
+    }
+}
+
+// 64 floats per iteration, masked tail
+__attribute__((target("avx512f")))
+void vectorize_float_add_to_float_avx512(
+    const float * __restrict srcA,
+    float       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 63 < blockSize; i += 64) {
+        _mm512_storeu_ps(dst + i,      _mm512_add_ps(_mm512_loadu_ps(dst + i),      _mm512_loadu_ps(srcA + i)));
+        _mm512_storeu_ps(dst + i + 16, _mm512_add_ps(_mm512_loadu_ps(dst + i + 16), _mm512_loadu_ps(srcA + i + 16)));
+        _mm512_storeu_ps(dst + i + 32, _mm512_add_ps(_mm512_loadu_ps(dst + i + 32), _mm512_loadu_ps(srcA + i + 32)));
+        _mm512_storeu_ps(dst + i + 48, _mm512_add_ps(_mm512_loadu_ps(dst + i + 48), _mm512_loadu_ps(srcA + i + 48)));
+    }
+    for (; i < blockSize; i += 16) {
+        size_t rem = blockSize - i;
+        __mmask16 m = (rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << rem) - 1);
+        __m512 d = _mm512_maskz_loadu_ps(m, dst + i);
+        _mm512_mask_storeu_ps(dst + i, m, _mm512_add_ps(d, _mm512_maskz_loadu_ps(m, srcA + i)));
+    }
+}
+
+// 64 weights per iteration, masked loads/stores handle the tail without a scalar loop
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q7_add_to_q31_avx512bw(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 63 < blockSize; i += 64) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(srcA + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(srcA + i + 16));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(srcA + i + 32));
+        __m128i b3 = _mm_loadu_si128((const __m128i *)(srcA + i + 48));
+        _mm512_storeu_si512(dst + i,      _mm512_add_epi32(_mm512_loadu_si512(dst + i),      _mm512_cvtepi8_epi32(b0)));
+        _mm512_storeu_si512(dst + i + 16, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 16), _mm512_cvtepi8_epi32(b1)));
+        _mm512_storeu_si512(dst + i + 32, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 32), _mm512_cvtepi8_epi32(b2)));
+        _mm512_storeu_si512(dst + i + 48, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 48), _mm512_cvtepi8_epi32(b3)));
+    }
+    for (; i < blockSize; i += 16) {
+        size_t rem = blockSize - i;
+        __mmask16 m = (rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << rem) - 1);
+        __m512i w = _mm512_cvtepi8_epi32(_mm_maskz_loadu_epi8(m, srcA + i));
+        __m512i d = _mm512_maskz_loadu_epi32(m, dst + i);
+        _mm512_mask_storeu_epi32(dst + i, m, _mm512_add_epi32(d, w));
+    }
+}
+
+// 32 weights per iteration in two ymm registers of int16 lanes, twice the
+// neurons per instruction of the int32 accumulate
+__attribute__((target("avx2")))
+void vectorize_q7_add_to_q15_avx2(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 31 < blockSize; i += 32) {
+        __m256i w0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(srcA + i)));
+        __m256i w1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(srcA + i + 16)));
+        __m256i *d = (__m256i *)(dst + i);
+        _mm256_storeu_si256(d,     _mm256_adds_epi16(_mm256_loadu_si256(d),     w0));
+        _mm256_storeu_si256(d + 1, _mm256_adds_epi16(_mm256_loadu_si256(d + 1), w1));
+    }
+    for (; i + 15 < blockSize; i += 16) {
+        __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(srcA + i)));
+        __m256i *d = (__m256i *)(dst + i);
+        _mm256_storeu_si256(d, _mm256_adds_epi16(_mm256_loadu_si256(d), w));
+    }
+    vectorize_q7_add_to_q15(srcA + i, dst + i, blockSize - i);
+}
+
+// 64 weights per iteration in two zmm registers of int16 lanes, masked tail
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q7_add_to_q15_avx512bw(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    for (; i + 63 < blockSize; i += 64) {
+        __m512i w0 = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(srcA + i)));
+        __m512i w1 = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i *)(srcA + i + 32)));
+        _mm512_storeu_si512(dst + i,      _mm512_adds_epi16(_mm512_loadu_si512(dst + i),      w0));
+        _mm512_storeu_si512(dst + i + 32, _mm512_adds_epi16(_mm512_loadu_si512(dst + i + 32), w1));
+    }
+    for (; i < blockSize; i += 32) {
+        size_t rem = blockSize - i;
+        __mmask32 m = (rem >= 32) ? (__mmask32)0xFFFFFFFFu : (__mmask32)((1u << rem) - 1);
+        __m512i w = _mm512_cvtepi8_epi16(_mm256_maskz_loadu_epi8(m, srcA + i));
+        __m512i d = _mm512_maskz_loadu_epi16(m, dst + i);
+        _mm512_mask_storeu_epi16(dst + i, m, _mm512_adds_epi16(d, w));
+    }
+}
+
+// Widen 32 weights into four ymm registers once, then add them into each destination
+__attribute__((target("avx2")))
+void vectorize_q7_add_to_q31_multi_avx2(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+) {
+    size_t i = 0;
+    for (; i + 31 < blockSize; i += 32) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(srcA + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(srcA + i + 16));
+        __m256i w0 = _mm256_cvtepi8_epi32(lo);
+        __m256i w1 = _mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8));
+        __m256i w2 = _mm256_cvtepi8_epi32(hi);
+        __m256i w3 = _mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8));
+        for (size_t k = 0; k < numDst; k++) {
+            __m256i *d = (__m256i *)(dst_base + offsets[k] + i);
+            _mm256_storeu_si256(d,     _mm256_add_epi32(_mm256_loadu_si256(d),     w0));
+            _mm256_storeu_si256(d + 1, _mm256_add_epi32(_mm256_loadu_si256(d + 1), w1));
+            _mm256_storeu_si256(d + 2, _mm256_add_epi32(_mm256_loadu_si256(d + 2), w2));
+            _mm256_storeu_si256(d + 3, _mm256_add_epi32(_mm256_loadu_si256(d + 3), w3));
+        }
+    }
+    if (i < blockSize) {
+        for (size_t k = 0; k < numDst; k++) {
+            vectorize_q7_add_to_q31_avx2(srcA + i, dst_base + offsets[k] + i, blockSize - i);
+        }
+    }
+}
+
+// 64 weights held widened in four zmm registers across all destinations
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q7_add_to_q31_multi_avx512bw(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+) {
+    for (size_t i = 0; i < blockSize; i += 64) {
+        size_t rem = blockSize - i;
+        __mmask16 m[4];
+        __m512i w[4];
+        for (int q = 0; q < 4; q++) {
+            size_t lane_rem = (rem > (size_t)q * 16) ? rem - (size_t)q * 16 : 0;
+            m[q] = (lane_rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << lane_rem) - 1);
+            w[q] = _mm512_cvtepi8_epi32(_mm_maskz_loadu_epi8(m[q], srcA + i + q * 16));
+        }
+        for (size_t k = 0; k < numDst; k++) {
+            int32_t *d = dst_base + offsets[k] + i;
+            for (int q = 0; q < 4; q++) {
+                __m512i v = _mm512_maskz_loadu_epi32(m[q], d + q * 16);
+                _mm512_mask_storeu_epi32(d + q * 16, m[q], _mm512_add_epi32(v, w[q]));
+            }
+        }
+    }
+}
+
+// Eight ymm accumulators hold the whole tile; a partial tile runs on a padded copy
+__attribute__((target("avx2")))
+void vectorize_q7_gather_add_to_q31_avx2(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    int32_t padded[Q7_TILE_NEURONS] __attribute__((aligned(32)));
+    int32_t *d = dst;
+    if (blockSize < Q7_TILE_NEURONS) {
+        memcpy(padded, dst, blockSize * sizeof(int32_t));
+        d = padded;
+    }
+    __m256i acc[8];
+    for (int q = 0; q < 8; q++) {
+        acc[q] = _mm256_loadu_si256((const __m256i *)(d + q * 8));
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        if (k + GATHER_PREFETCH_ROWS < numRows) {
+            _mm_prefetch((const char *)(tile + (size_t)rows[k + GATHER_PREFETCH_ROWS] * Q7_TILE_NEURONS), _MM_HINT_T0);
+        }
+        const int8_t *row = tile + (size_t)rows[k] * Q7_TILE_NEURONS;
+        for (int q = 0; q < 8; q++) {
+            __m256i w = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(row + q * 8)));
+            acc[q] = _mm256_add_epi32(acc[q], w);
+        }
+    }
+    for (int q = 0; q < 8; q++) {
+        _mm256_storeu_si256((__m256i *)(d + q * 8), acc[q]);
+    }
+    if (d != dst) {
+        memcpy(dst, padded, blockSize * sizeof(int32_t));
+    }
+}
+
+__attribute__((target("avx2")))
+void vectorize_q7_gather_add_to_q15_avx2(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+) {
+    int16_t padded[Q7_TILE_NEURONS] __attribute__((aligned(32)));
+    int16_t *d = dst;
+    if (blockSize < Q7_TILE_NEURONS) {
+        memcpy(padded, dst, blockSize * sizeof(int16_t));
+        d = padded;
+    }
+    __m256i acc[4];
+    for (int q = 0; q < 4; q++) {
+        acc[q] = _mm256_loadu_si256((const __m256i *)(d + q * 16));
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        if (k + GATHER_PREFETCH_ROWS < numRows) {
+            _mm_prefetch((const char *)(tile + (size_t)rows[k + GATHER_PREFETCH_ROWS] * Q7_TILE_NEURONS), _MM_HINT_T0);
+        }
+        const int8_t *row = tile + (size_t)rows[k] * Q7_TILE_NEURONS;
+        for (int q = 0; q < 4; q++) {
+            __m256i w = _mm256_cvtepi8_epi16(_mm_load_si128((const __m128i *)(row + q * 16)));
+            acc[q] = _mm256_adds_epi16(acc[q], w);
+        }
+    }
+    for (int q = 0; q < 4; q++) {
+        _mm256_storeu_si256((__m256i *)(d + q * 16), acc[q]);
+    }
+    if (d != dst) {
+        memcpy(dst, padded, blockSize * sizeof(int16_t));
+    }
+}
+
+// Four zmm accumulators, one 64-byte row load widened a quarter at a time
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q7_gather_add_to_q31_avx512bw(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    __mmask16 m[4];
+    __m512i acc[4];
+    for (int q = 0; q < 4; q++) {
+        size_t lane_rem = (blockSize > (size_t)q * 16) ? blockSize - (size_t)q * 16 : 0;
+        m[q] = (lane_rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << lane_rem) - 1);
+        acc[q] = _mm512_maskz_loadu_epi32(m[q], dst + q * 16);
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        if (k + GATHER_PREFETCH_ROWS < numRows) {
+            _mm_prefetch((const char *)(tile + (size_t)rows[k + GATHER_PREFETCH_ROWS] * Q7_TILE_NEURONS), _MM_HINT_T0);
+        }
+        __m512i w = _mm512_load_si512(tile + (size_t)rows[k] * Q7_TILE_NEURONS);
+        acc[0] = _mm512_add_epi32(acc[0], _mm512_cvtepi8_epi32(_mm512_castsi512_si128(w)));
+        acc[1] = _mm512_add_epi32(acc[1], _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(w, 1)));
+        acc[2] = _mm512_add_epi32(acc[2], _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(w, 2)));
+        acc[3] = _mm512_add_epi32(acc[3], _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(w, 3)));
+    }
+    for (int q = 0; q < 4; q++) {
+        _mm512_mask_storeu_epi32(dst + q * 16, m[q], acc[q]);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q7_gather_add_to_q15_avx512bw(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+) {
+    __mmask32 m[2];
+    __m512i acc[2];
+    for (int q = 0; q < 2; q++) {
+        size_t lane_rem = (blockSize > (size_t)q * 32) ? blockSize - (size_t)q * 32 : 0;
+        m[q] = (lane_rem >= 32) ? (__mmask32)0xFFFFFFFFu : (__mmask32)((1u << lane_rem) - 1);
+        acc[q] = _mm512_maskz_loadu_epi16(m[q], dst + q * 32);
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        if (k + GATHER_PREFETCH_ROWS < numRows) {
+            _mm_prefetch((const char *)(tile + (size_t)rows[k + GATHER_PREFETCH_ROWS] * Q7_TILE_NEURONS), _MM_HINT_T0);
+        }
+        __m512i w = _mm512_load_si512(tile + (size_t)rows[k] * Q7_TILE_NEURONS);
+        acc[0] = _mm512_adds_epi16(acc[0], _mm512_cvtepi8_epi16(_mm512_castsi512_si256(w)));
+        acc[1] = _mm512_adds_epi16(acc[1], _mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(w, 1)));
+    }
+    for (int q = 0; q < 2; q++) {
+        _mm512_mask_storeu_epi16(dst + q * 32, m[q], acc[q]);
+    }
+}
+
+// Widen to int16 and multiply there: scale * w stays within int16 for -255 <= scale <= 256
+__attribute__((target("avx2")))
+void vectorize_q7_scale_add_to_q31_avx2(
+    const int8_t * __restrict srcA,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    size_t i = 0;
+    if (scale <= 256 && scale >= -255) {
+        __m256i s16 = _mm256_set1_epi16((int16_t)scale);
+        for (; i + 15 < blockSize; i += 16) {
+            __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(srcA + i)));
+            __m256i p = _mm256_mullo_epi16(w, s16);
+            __m256i p0 = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(p));
+            __m256i p1 = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(p, 1));
+            __m256i *d = (__m256i *)(dst + i);
+            _mm256_storeu_si256(d,     _mm256_add_epi32(_mm256_loadu_si256(d),     p0));
+            _mm256_storeu_si256(d + 1, _mm256_add_epi32(_mm256_loadu_si256(d + 1), p1));
+        }
+    }
+    // leftover (and wide scales)
+    for (; i < blockSize; i++) {
+        dst[i] = scale * srcA[i] + dst[i];
+    }
+}
+
+// Widen both operands to int16, madd pairs into int32 lanes; |a * b| <= 2^14 so pairs cannot overflow
+__attribute__((target("avx2")))
+int32_t vectorize_q7_dot_q7_avx2(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 31 < blockSize; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(srcA + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(srcB + i));
+        __m256i a0 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(a));
+        __m256i a1 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(a, 1));
+        __m256i b0 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(b));
+        __m256i b1 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(b, 1));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+    }
+    __m256i acc = _mm256_add_epi32(acc0, acc1);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    int32_t total = _mm_cvtsi128_si32(sum);
+    // leftover
+    for (; i < blockSize; i++) {
+        total += (int32_t)srcA[i] * srcB[i];
+    }
+    return total;
+}
+
+// 64 pairs per iteration, masked loads zero the tail
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+int32_t vectorize_q7_dot_q7_avx512bw(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+) {
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 63 < blockSize; i += 64) {
+        __m512i a = _mm512_loadu_si512(srcA + i);
+        __m512i b = _mm512_loadu_si512(srcB + i);
+        __m512i a0 = _mm512_cvtepi8_epi16(_mm512_castsi512_si256(a));
+        __m512i a1 = _mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(a, 1));
+        __m512i b0 = _mm512_cvtepi8_epi16(_mm512_castsi512_si256(b));
+        __m512i b1 = _mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(b, 1));
+        acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(a0, b0));
+        acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(a1, b1));
+    }
+    for (; i < blockSize; i += 32) {
+        size_t rem = blockSize - i;
+        __mmask32 m = (rem >= 32) ? (__mmask32)0xFFFFFFFFu : (__mmask32)((1u << rem) - 1);
+        __m512i a = _mm512_cvtepi8_epi16(_mm256_maskz_loadu_epi8(m, srcA + i));
+        __m512i b = _mm512_cvtepi8_epi16(_mm256_maskz_loadu_epi8(m, srcB + i));
+        acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(a, b));
+    }
+    return _mm512_reduce_add_epi32(_mm512_add_epi32(acc0, acc1));
+}
+
+// One 16-byte group is 32 codes: low nibbles are the first 16 neurons, high
+// nibbles the next 16. Each half is looked up in the table with one byte
+// shuffle and widened into two ymm registers.
+__attribute__((target("avx2")))
+void vectorize_q4_add_to_q31_avx2(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    const __m128i table = _mm_loadu_si128((const __m128i *)lut);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 31 < blockSize; i += 32) {
+        __m128i codes = _mm_loadu_si128((const __m128i *)(srcA + i / 2));
+        __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(codes, low));
+        __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(codes, 4), low));
+        __m256i *d = (__m256i *)(dst + i);
+        _mm256_storeu_si256(d,     _mm256_add_epi32(_mm256_loadu_si256(d),     _mm256_cvtepi8_epi32(lo)));
+        _mm256_storeu_si256(d + 1, _mm256_add_epi32(_mm256_loadu_si256(d + 1), _mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8))));
+        _mm256_storeu_si256(d + 2, _mm256_add_epi32(_mm256_loadu_si256(d + 2), _mm256_cvtepi8_epi32(hi)));
+        _mm256_storeu_si256(d + 3, _mm256_add_epi32(_mm256_loadu_si256(d + 3), _mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8))));
+    }
+    // Short last group: decode both halves into a buffer, then add it as int8
+    if (i < blockSize) {
+        size_t width = blockSize - i;
+        size_t half = (width + 1) / 2;
+        uint8_t codes[16] = {0};
+        int8_t weights[48];
+        memcpy(codes, srcA + i / 2, half);
+        __m128i c = _mm_loadu_si128((const __m128i *)codes);
+        _mm_storeu_si128((__m128i *)weights, _mm_shuffle_epi8(table, _mm_and_si128(c, low)));
+        _mm_storeu_si128((__m128i *)(weights + half), _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(c, 4), low)));
+        vectorize_q7_add_to_q31_avx2(weights, dst + i, width);
+    }
+}
+
+// 64 codes per iteration. A group is widened to one byte per dword lane and
+// vpermd looks up the low 4 bits of every lane in a 16-entry int32 table, so
+// the high nibbles only need a shift first.
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q4_add_to_q31_avx512bw(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    const __m512i table = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)lut));
+    size_t i = 0;
+    for (; i + 63 < blockSize; i += 64) {
+        __m512i c0 = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(srcA + i / 2)));
+        __m512i c1 = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(srcA + i / 2 + 16)));
+        __m512i w0 = _mm512_permutexvar_epi32(c0, table);
+        __m512i w1 = _mm512_permutexvar_epi32(_mm512_srli_epi32(c0, 4), table);
+        __m512i w2 = _mm512_permutexvar_epi32(c1, table);
+        __m512i w3 = _mm512_permutexvar_epi32(_mm512_srli_epi32(c1, 4), table);
+        _mm512_storeu_si512(dst + i,      _mm512_add_epi32(_mm512_loadu_si512(dst + i),      w0));
+        _mm512_storeu_si512(dst + i + 16, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 16), w1));
+        _mm512_storeu_si512(dst + i + 32, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 32), w2));
+        _mm512_storeu_si512(dst + i + 48, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 48), w3));
+    }
+    for (; i + 31 < blockSize; i += 32) {
+        __m512i c = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(srcA + i / 2)));
+        __m512i w0 = _mm512_permutexvar_epi32(c, table);
+        __m512i w1 = _mm512_permutexvar_epi32(_mm512_srli_epi32(c, 4), table);
+        _mm512_storeu_si512(dst + i,      _mm512_add_epi32(_mm512_loadu_si512(dst + i),      w0));
+        _mm512_storeu_si512(dst + i + 16, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 16), w1));
+    }
+    // Short last group of width <= 31 in at most two masked vectors. Lane k
+    // takes the low nibble of byte k below half and the high nibble of byte
+    // k - half above it, so each vector is one gather of codes and one lookup.
+    for (size_t k0 = 0; i + k0 < blockSize; k0 += 16) {
+        size_t width = blockSize - i;
+        size_t half = (width + 1) / 2;
+        size_t rem = width - k0;
+        __mmask16 m = (rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << rem) - 1);
+        __m512i bytes = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8((__mmask16)((1u << half) - 1), srcA + i / 2));
+        __m512i lane = _mm512_add_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                        _mm512_set1_epi32((int)k0));
+        __mmask16 upper = _mm512_cmpge_epi32_mask(lane, _mm512_set1_epi32((int)half));
+        __m512i lo = _mm512_permutexvar_epi32(lane, bytes);
+        __m512i hi = _mm512_srli_epi32(_mm512_permutexvar_epi32(_mm512_sub_epi32(lane, _mm512_set1_epi32((int)half)), bytes), 4);
+        __m512i w = _mm512_permutexvar_epi32(_mm512_mask_blend_epi32(upper, lo, hi), table);
+        _mm512_mask_storeu_epi32(dst + i + k0, m, _mm512_add_epi32(_mm512_maskz_loadu_epi32(m, dst + i + k0), w));
+    }
+}
+
+// 8 neurons per iteration: one byte of each bitplane is broadcast and turned
+// into lane masks by testing lane k against bit k
+__attribute__((target("avx2")))
+void vectorize_ternary_add_to_q31_avx2(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i s = _mm256_set1_epi32(scale);
+    size_t i = 0;
+    for (; i + 7 < blockSize; i += 8) {
+        __m256i p = _mm256_and_si256(_mm256_set1_epi32(pos[i >> 3]), bits);
+        __m256i n = _mm256_and_si256(_mm256_set1_epi32(neg[i >> 3]), bits);
+        __m256i add = _mm256_and_si256(_mm256_cmpeq_epi32(p, bits), s);
+        __m256i sub = _mm256_and_si256(_mm256_cmpeq_epi32(n, bits), s);
+        __m256i *d = (__m256i *)(dst + i);
+        _mm256_storeu_si256(d, _mm256_sub_epi32(_mm256_add_epi32(_mm256_loadu_si256(d), add), sub));
+    }
+    // leftover, i is a multiple of 8 here
+    vectorize_ternary_add_to_q31(pos + i / 8, neg + i / 8, scale, dst + i, blockSize - i);
+}
+
+// 64 neurons per iteration: the two 64-bit bitplane words turn into 64 int8
+// weights with a masked move and a masked subtract, then widen like int8 rows
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_ternary_add_to_q31_avx512bw(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+) {
+    const __m512i s = _mm512_set1_epi32(scale);
+    size_t i = 0;
+    const __m512i s8 = _mm512_set1_epi8((char)scale);
+    for (; i + 63 < blockSize; i += 64) {
+        uint64_t p;
+        uint64_t n;
+        memcpy(&p, pos + i / 8, sizeof(p));
+        memcpy(&n, neg + i / 8, sizeof(n));
+        __m512i w = _mm512_mask_sub_epi8(_mm512_maskz_mov_epi8(_cvtu64_mask64(p), s8), _cvtu64_mask64(n),
+                                         _mm512_setzero_si512(), s8);
+        _mm512_storeu_si512(dst + i,      _mm512_add_epi32(_mm512_loadu_si512(dst + i),      _mm512_cvtepi8_epi32(_mm512_castsi512_si128(w))));
+        _mm512_storeu_si512(dst + i + 16, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 16), _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(w, 1))));
+        _mm512_storeu_si512(dst + i + 32, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 32), _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(w, 2))));
+        _mm512_storeu_si512(dst + i + 48, _mm512_add_epi32(_mm512_loadu_si512(dst + i + 48), _mm512_cvtepi8_epi32(_mm512_extracti32x4_epi32(w, 3))));
+    }
+    for (; i < blockSize; i += 16) {
+        size_t rem = blockSize - i;
+        __mmask16 m = (rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << rem) - 1);
+        // The second byte of each plane only exists past neuron i + 8
+        __mmask16 p = (__mmask16)(pos[i >> 3] | (rem > 8 ? pos[(i >> 3) + 1] << 8 : 0)) & m;
+        __mmask16 n = (__mmask16)(neg[i >> 3] | (rem > 8 ? neg[(i >> 3) + 1] << 8 : 0)) & m;
+        __m512i d = _mm512_maskz_loadu_epi32(m, dst + i);
+        d = _mm512_mask_add_epi32(d, p, d, s);
+        d = _mm512_mask_sub_epi32(d, n, d, s);
+        _mm512_mask_storeu_epi32(dst + i, m, d);
+    }
+}
+// Two full 32-neuron groups per row into eight ymm accumulators; a partial
+// tile has a short last group and adds its rows into a padded copy instead
+__attribute__((target("avx2")))
+void vectorize_q4_gather_add_to_q31_avx2(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    if (blockSize < Q7_TILE_NEURONS) {
+        int32_t acc[Q7_TILE_NEURONS];
+        memcpy(acc, dst, blockSize * sizeof(int32_t));
+        for (size_t k = 0; k < numRows; k++) {
+            vectorize_q4_add_to_q31_avx2(base + (size_t)rows[k] * rowStride, lut, acc, blockSize);
+        }
+        memcpy(dst, acc, blockSize * sizeof(int32_t));
+        return;
+    }
+    const __m128i table = _mm_loadu_si128((const __m128i *)lut);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m256i acc[8];
+    for (int q = 0; q < 8; q++) {
+        acc[q] = _mm256_loadu_si256((const __m256i *)(dst + q * 8));
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        if (k + GATHER_PREFETCH_ROWS < numRows) {
+            _mm_prefetch((const char *)(base + (size_t)rows[k + GATHER_PREFETCH_ROWS] * rowStride), _MM_HINT_T0);
+        }
+        const uint8_t *row = base + (size_t)rows[k] * rowStride;
+        for (int g = 0; g < 2; g++) {
+            __m128i codes = _mm_loadu_si128((const __m128i *)(row + g * 16));
+            __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(codes, low));
+            __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(codes, 4), low));
+            acc[g * 4]     = _mm256_add_epi32(acc[g * 4],     _mm256_cvtepi8_epi32(lo));
+            acc[g * 4 + 1] = _mm256_add_epi32(acc[g * 4 + 1], _mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8)));
+            acc[g * 4 + 2] = _mm256_add_epi32(acc[g * 4 + 2], _mm256_cvtepi8_epi32(hi));
+            acc[g * 4 + 3] = _mm256_add_epi32(acc[g * 4 + 3], _mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8)));
+        }
+    }
+    for (int q = 0; q < 8; q++) {
+        _mm256_storeu_si256((__m256i *)(dst + q * 8), acc[q]);
+    }
+}
+
+// A partial tile's short group keeps its low nibbles in the first
+// half of its lanes and high nibbles in the rest, so every lane gets a byte
+// index and a shift up front and a row costs one more vpermd and shift per
+// vector.
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static void q4_gather_partial_avx512bw(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const __m512i    table,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    __mmask16 m[4];
+    __mmask16 load[2];
+    __m512i idx[4];
+    __m512i shift[4];
+    __m512i acc[4];
+    for (int g = 0; g < 2; g++) {
+        size_t width = blockSize > (size_t)g * 32 ? blockSize - (size_t)g * 32 : 0;
+        width = width > 32 ? 32 : width;
+        load[g] = (__mmask16)((1u << ((width + 1) / 2)) - 1);
+    }
+    for (int q = 0; q < 4; q++) {
+        size_t lane_rem = blockSize > (size_t)q * 16 ? blockSize - (size_t)q * 16 : 0;
+        size_t width = blockSize - (size_t)(q / 2) * 32;
+        size_t half = ((width > 32 ? 32 : width) + 1) / 2;
+        int32_t lane_idx[16];
+        int32_t lane_shift[16];
+        for (int l = 0; l < 16; l++) {
+            size_t k = (size_t)(q % 2) * 16 + l;
+            lane_idx[l] = (int32_t)(k < half ? k : k - half);
+            lane_shift[l] = k < half ? 0 : 4;
+        }
+        m[q] = (lane_rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << lane_rem) - 1);
+        idx[q] = _mm512_loadu_si512(lane_idx);
+        shift[q] = _mm512_loadu_si512(lane_shift);
+        acc[q] = _mm512_maskz_loadu_epi32(m[q], dst + q * 16);
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        const uint8_t *row = base + (size_t)rows[k] * rowStride;
+        __m512i c[2];
+        c[0] = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(load[0], row));
+        c[1] = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(load[1], row + 16));
+        for (int q = 0; q < 4; q++) {
+            __m512i codes = _mm512_srlv_epi32(_mm512_permutexvar_epi32(idx[q], c[q / 2]), shift[q]);
+            acc[q] = _mm512_maskz_add_epi32(m[q], acc[q], _mm512_permutexvar_epi32(codes, table));
+        }
+    }
+    for (int q = 0; q < 4; q++) {
+        _mm512_mask_storeu_epi32(dst + q * 16, m[q], acc[q]);
+    }
+}
+
+// A full tile's low nibbles are neurons 0-15 and 32-47, its high nibbles
+// 16-31 and 48-63, so one byte shuffle per half looks up 32 weights. They are
+// summed in int16 lanes, which hold Q4_SUM16_ROWS rows of int8 weights, and
+// widened into the int32 sums once per chunk.
+#define Q4_SUM16_ROWS 256
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_q4_gather_add_to_q31_avx512bw(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    if (blockSize < Q7_TILE_NEURONS) {
+        const __m512i table = _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)lut));
+        q4_gather_partial_avx512bw(base, rowStride, rows, numRows, table, dst, blockSize);
+        return;
+    }
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lut));
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m512i acc[4];
+    for (int q = 0; q < 4; q++) {
+        acc[q] = _mm512_loadu_si512(dst + q * 16);
+    }
+    for (size_t k0 = 0; k0 < numRows; k0 += Q4_SUM16_ROWS) {
+        size_t end = numRows - k0 < Q4_SUM16_ROWS ? numRows : k0 + Q4_SUM16_ROWS;
+        __m512i sum_lo = _mm512_setzero_si512();
+        __m512i sum_hi = _mm512_setzero_si512();
+        for (size_t k = k0; k < end; k++) {
+            if (k + GATHER_PREFETCH_ROWS < numRows) {
+                _mm_prefetch((const char *)(base + (size_t)rows[k + GATHER_PREFETCH_ROWS] * rowStride), _MM_HINT_T0);
+            }
+            __m256i codes = _mm256_loadu_si256((const __m256i *)(base + (size_t)rows[k] * rowStride));
+            __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(codes, low));
+            __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(codes, 4), low));
+            sum_lo = _mm512_add_epi16(sum_lo, _mm512_cvtepi8_epi16(lo));
+            sum_hi = _mm512_add_epi16(sum_hi, _mm512_cvtepi8_epi16(hi));
+        }
+        acc[0] = _mm512_add_epi32(acc[0], _mm512_cvtepi16_epi32(_mm512_castsi512_si256(sum_lo)));
+        acc[1] = _mm512_add_epi32(acc[1], _mm512_cvtepi16_epi32(_mm512_castsi512_si256(sum_hi)));
+        acc[2] = _mm512_add_epi32(acc[2], _mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(sum_lo, 1)));
+        acc[3] = _mm512_add_epi32(acc[3], _mm512_cvtepi16_epi32(_mm512_extracti64x4_epi64(sum_hi, 1)));
+    }
+    for (int q = 0; q < 4; q++) {
+        _mm512_storeu_si512(dst + q * 16, acc[q]);
+    }
+}
+
+// Eight ymm accumulators; each bitplane byte becomes lane masks as in the row
+// kernel. Only the tile's bytes of each plane are read, so a partial tile
+// runs on a padded copy.
+__attribute__((target("avx2")))
+void vectorize_ternary_gather_add_to_q31_avx2(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i s = _mm256_set1_epi32(scale);
+    size_t plane_bytes = (blockSize + 7) / 8;
+    int32_t padded[Q7_TILE_NEURONS];
+    int32_t *d = dst;
+    if (blockSize < Q7_TILE_NEURONS) {
+        memcpy(padded, dst, blockSize * sizeof(int32_t));
+        d = padded;
+    }
+    __m256i acc[8];
+    for (int q = 0; q < 8; q++) {
+        acc[q] = _mm256_loadu_si256((const __m256i *)(d + q * 8));
+    }
+    for (size_t k = 0; k < numRows; k++) {
+        size_t offset = (size_t)rows[k] * rowStride;
+        uint64_t p = 0;
+        uint64_t n = 0;
+        if (plane_bytes == sizeof(p)) {
+            memcpy(&p, pos + offset, sizeof(p));
+            memcpy(&n, neg + offset, sizeof(n));
+        } else {
+            for (size_t b = 0; b < plane_bytes; b++) {
+                p |= (uint64_t)pos[offset + b] << (b * 8);
+                n |= (uint64_t)neg[offset + b] << (b * 8);
+            }
+        }
+        for (int q = 0; q < 8; q++) {
+            __m256i pb = _mm256_and_si256(_mm256_set1_epi32((int)((p >> (q * 8)) & 0xFF)), bits);
+            __m256i nb = _mm256_and_si256(_mm256_set1_epi32((int)((n >> (q * 8)) & 0xFF)), bits);
+            __m256i add = _mm256_and_si256(_mm256_cmpeq_epi32(pb, bits), s);
+            __m256i sub = _mm256_and_si256(_mm256_cmpeq_epi32(nb, bits), s);
+            acc[q] = _mm256_sub_epi32(_mm256_add_epi32(acc[q], add), sub);
+        }
+    }
+    for (int q = 0; q < 8; q++) {
+        _mm256_storeu_si256((__m256i *)(d + q * 8), acc[q]);
+    }
+    if (d != dst) {
+        memcpy(dst, padded, blockSize * sizeof(int32_t));
+    }
+}
+
+// A row adds +scale, -scale or nothing to each neuron, so the rows of a
+// chunk are counted per neuron in two int8 registers, one kmov and one masked
+// add per plane, and the counts are widened and scaled once per chunk
+#define TERNARY_COUNT_ROWS 255
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void vectorize_ternary_gather_add_to_q31_avx512bw(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+) {
+    const __m512i s = _mm512_set1_epi32(scale);
+    const __m512i one = _mm512_set1_epi8(1);
+    __mmask16 plane = (__mmask16)((1u << ((blockSize + 7) / 8)) - 1);
+    __mmask16 m[4];
+    __m512i acc[4];
+    for (int q = 0; q < 4; q++) {
+        size_t lane_rem = (blockSize > (size_t)q * 16) ? blockSize - (size_t)q * 16 : 0;
+        m[q] = (lane_rem >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << lane_rem) - 1);
+        acc[q] = _mm512_maskz_loadu_epi32(m[q], dst + q * 16);
+    }
+    for (size_t k0 = 0; k0 < numRows; k0 += TERNARY_COUNT_ROWS) {
+        size_t end = numRows - k0 < TERNARY_COUNT_ROWS ? numRows : k0 + TERNARY_COUNT_ROWS;
+        __m512i count_pos = _mm512_setzero_si512();
+        __m512i count_neg = _mm512_setzero_si512();
+        for (size_t k = k0; k < end; k++) {
+            if (k + GATHER_PREFETCH_ROWS < numRows) {
+                _mm_prefetch((const char *)(pos + (size_t)rows[k + GATHER_PREFETCH_ROWS] * rowStride), _MM_HINT_T0);
+            }
+            size_t offset = (size_t)rows[k] * rowStride;
+            uint64_t p = (uint64_t)_mm_cvtsi128_si64(_mm_maskz_loadu_epi8(plane, pos + offset));
+            uint64_t n = (uint64_t)_mm_cvtsi128_si64(_mm_maskz_loadu_epi8(plane, neg + offset));
+            count_pos = _mm512_mask_add_epi8(count_pos, _cvtu64_mask64(p), count_pos, one);
+            count_neg = _mm512_mask_add_epi8(count_neg, _cvtu64_mask64(n), count_neg, one);
+        }
+        __m128i p8[4] = {_mm512_castsi512_si128(count_pos), _mm512_extracti32x4_epi32(count_pos, 1),
+                         _mm512_extracti32x4_epi32(count_pos, 2), _mm512_extracti32x4_epi32(count_pos, 3)};
+        __m128i n8[4] = {_mm512_castsi512_si128(count_neg), _mm512_extracti32x4_epi32(count_neg, 1),
+                         _mm512_extracti32x4_epi32(count_neg, 2), _mm512_extracti32x4_epi32(count_neg, 3)};
+        for (int q = 0; q < 4; q++) {
+            __m512i net = _mm512_sub_epi32(_mm512_cvtepu8_epi32(p8[q]), _mm512_cvtepu8_epi32(n8[q]));
+            acc[q] = _mm512_add_epi32(acc[q], _mm512_mullo_epi32(net, s));
+        }
+    }
+    for (int q = 0; q < 4; q++) {
+        _mm512_mask_storeu_epi32(dst + q * 16, m[q], acc[q]);
+    }
+}
+#endif
+
+int dsp_kernel_supported(Dsp_Kernel kernel) {
+    switch (kernel) {
+    case DSP_KERNEL_SCALAR:
+        return 1;
+#if DSP_HAVE_X86
+    case DSP_KERNEL_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case DSP_KERNEL_AVX2:
+        // The float32 LIF update is a fused multiply-add
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case DSP_KERNEL_AVX512BW:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("avx512vl");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *dsp_kernel_name(Dsp_Kernel kernel) {
+    static const char *names[DSP_KERNEL_COUNT] = {"scalar", "sse4.1", "avx2", "avx512bw"};
+    if (kernel < 0 || kernel >= DSP_KERNEL_COUNT) {
+        return "unknown";
+    }
+    return names[kernel];
+}
+
+Dsp_Kernel dsp_active_kernel(void) {
+    return active_kernel;
+}
+
+int dsp_select_kernel(Dsp_Kernel kernel) {
+    if (!dsp_kernel_supported(kernel)) {
+        return 1;
+    }
+    switch (kernel) {
+#if DSP_HAVE_X86
+    case DSP_KERNEL_SSE41:
+        q7_add_to_q31_kernel = vectorize_q7_add_to_q31_sse41;
+        q7_add_to_q15_kernel = vectorize_q7_add_to_q15_sse41;
+        q7_scale_add_to_q31_kernel = vectorize_q7_scale_add_to_q31;
+        q7_add_to_q31_multi_kernel = vectorize_q7_add_to_q31_multi;
+        q7_gather_add_to_q31_kernel = vectorize_q7_gather_add_to_q31;
+        q7_gather_add_to_q15_kernel = vectorize_q7_gather_add_to_q15;
+        q7_dot_q7_kernel = vectorize_q7_dot_q7;
+        float_add_to_float_kernel = vectorize_float_add_to_float;
+        q4_add_to_q31_kernel = vectorize_q4_add_to_q31;
+        ternary_add_to_q31_kernel = vectorize_ternary_add_to_q31;
+        q4_gather_add_to_q31_kernel = vectorize_q4_gather_add_to_q31;
+        ternary_gather_add_to_q31_kernel = vectorize_ternary_gather_add_to_q31;
+        break;
+    case DSP_KERNEL_AVX2:
+        q7_add_to_q31_kernel = vectorize_q7_add_to_q31_avx2;
+        q7_add_to_q15_kernel = vectorize_q7_add_to_q15_avx2;
+        q7_scale_add_to_q31_kernel = vectorize_q7_scale_add_to_q31_avx2;
+        q7_add_to_q31_multi_kernel = vectorize_q7_add_to_q31_multi_avx2;
+        q7_gather_add_to_q31_kernel = vectorize_q7_gather_add_to_q31_avx2;
+        q7_gather_add_to_q15_kernel = vectorize_q7_gather_add_to_q15_avx2;
+        q7_dot_q7_kernel = vectorize_q7_dot_q7_avx2;
+        float_add_to_float_kernel = vectorize_float_add_to_float_avx2;
+        q4_add_to_q31_kernel = vectorize_q4_add_to_q31_avx2;
+        ternary_add_to_q31_kernel = vectorize_ternary_add_to_q31_avx2;
+        q4_gather_add_to_q31_kernel = vectorize_q4_gather_add_to_q31_avx2;
+        ternary_gather_add_to_q31_kernel = vectorize_ternary_gather_add_to_q31_avx2;
+        break;
+    case DSP_KERNEL_AVX512BW:
+        q7_add_to_q31_kernel = vectorize_q7_add_to_q31_avx512bw;
+        q7_add_to_q15_kernel = vectorize_q7_add_to_q15_avx512bw;
+        q7_scale_add_to_q31_kernel = vectorize_q7_scale_add_to_q31_avx2;
+        q7_add_to_q31_multi_kernel = vectorize_q7_add_to_q31_multi_avx512bw;
+        q7_gather_add_to_q31_kernel = vectorize_q7_gather_add_to_q31_avx512bw;
+        q7_gather_add_to_q15_kernel = vectorize_q7_gather_add_to_q15_avx512bw;
+        q7_dot_q7_kernel = vectorize_q7_dot_q7_avx512bw;
+        float_add_to_float_kernel = vectorize_float_add_to_float_avx512;
+        q4_add_to_q31_kernel = vectorize_q4_add_to_q31_avx512bw;
+        ternary_add_to_q31_kernel = vectorize_ternary_add_to_q31_avx512bw;
+        q4_gather_add_to_q31_kernel = vectorize_q4_gather_add_to_q31_avx512bw;
+        ternary_gather_add_to_q31_kernel = vectorize_ternary_gather_add_to_q31_avx512bw;
+        break;
+#endif
+    default:
+        q7_add_to_q31_kernel = vectorize_q7_add_to_q31;
+        q7_add_to_q15_kernel = vectorize_q7_add_to_q15;
+        q7_scale_add_to_q31_kernel = vectorize_q7_scale_add_to_q31;
+        q7_add_to_q31_multi_kernel = vectorize_q7_add_to_q31_multi;
+        q7_gather_add_to_q31_kernel = vectorize_q7_gather_add_to_q31;
+        q7_gather_add_to_q15_kernel = vectorize_q7_gather_add_to_q15;
+        q7_dot_q7_kernel = vectorize_q7_dot_q7;
+        float_add_to_float_kernel = vectorize_float_add_to_float;
+        q4_add_to_q31_kernel = vectorize_q4_add_to_q31;
+        ternary_add_to_q31_kernel = vectorize_ternary_add_to_q31;
+        q4_gather_add_to_q31_kernel = vectorize_q4_gather_add_to_q31;
+        ternary_gather_add_to_q31_kernel = vectorize_ternary_gather_add_to_q31;
+        break;
+    }
+    active_kernel = kernel;
+    return 0;
+}
+
+Dsp_Kernel dsp_init_dispatch(void) {
+    Dsp_Kernel cap = (Dsp_Kernel)(DSP_KERNEL_COUNT - 1);
+    const char *env = getenv("SNN_DSP_KERNEL");
+    if (env) {
+        for (int k = 0; k < DSP_KERNEL_COUNT; k++) {
+            if (strcmp(env, dsp_kernel_name((Dsp_Kernel)k)) == 0) {
+                cap = (Dsp_Kernel)k;
+            }
+        }
+    }
+
+#if DSP_HAVE_X86
+    __builtin_cpu_init();
+#endif
+    for (int k = cap; k >= DSP_KERNEL_SCALAR; k--) {
+        if (dsp_select_kernel((Dsp_Kernel)k) == 0) {
+            break;
+        }
+    }
+    return active_kernel;
+}
@@ -4,12 +4,332 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// Instruction set levels the q7 -> q31 accumulate can be dispatched to
+typedef enum {
+    DSP_KERNEL_SCALAR = 0,
+    DSP_KERNEL_SSE41,
+    DSP_KERNEL_AVX2,
+    DSP_KERNEL_AVX512BW,
+    DSP_KERNEL_COUNT
+} Dsp_Kernel;
+
+typedef void (*q7_add_to_q31_fn)(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+// Dispatched accumulate, set by dsp_init_dispatch(). Defaults to scalar.
+extern q7_add_to_q31_fn q7_add_to_q31_kernel;
+
+// dst += srcA with int16 saturation, for layers whose synaptic sums are bounded
+// to int16 (see Sum_Width). Half the scratch bytes of the int32 accumulate and
+// twice the lanes per instruction; the bound keeps saturation from ever firing,
+// so results match the int32 kernels exactly.
+typedef void (*q7_add_to_q15_fn)(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+);
+
+extern q7_add_to_q15_fn q7_add_to_q15_kernel;
+
+// Weight tiles (TRAVERSE_TILED) hold Q7_TILE_NEURONS output neurons of every
+// presynaptic neuron side by side: row r of a tile is the 64-byte line at
+// tile + r * Q7_TILE_NEURONS.
+#define Q7_TILE_NEURONS 64
+
+// dst[i] += tile[rows[k] * Q7_TILE_NEURONS + i] over the numRows listed rows,
+// for i < blockSize <= Q7_TILE_NEURONS. dst is loaded into registers once,
+// the rows stream past with the next ones prefetched, and dst is stored once.
+// tile must be 64-byte aligned with whole rows readable.
+typedef void (*q7_gather_add_to_q31_fn)(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+extern q7_gather_add_to_q31_fn q7_gather_add_to_q31_kernel;
+
+// The same into int16 sums with saturation, like q7_add_to_q15
+typedef void (*q7_gather_add_to_q15_fn)(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+);
+
+extern q7_gather_add_to_q15_fn q7_gather_add_to_q15_kernel;
+
+// dst += scale * srcA, used to fold several spikes of one row into a single pass
+typedef void (*q7_scale_add_to_q31_fn)(
+    const int8_t * __restrict srcA,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+extern q7_scale_add_to_q31_fn q7_scale_add_to_q31_kernel;
+
+// dst_base[offsets[k] + i] += srcA[i] for every destination k. The row is widened
+// once and reused for all destinations (batched accumulate).
+typedef void (*q7_add_to_q31_multi_fn)(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+);
+
+extern q7_add_to_q31_multi_fn q7_add_to_q31_multi_kernel;
+
+// sum(srcA[i] * srcB[i]) in int32, the dense int8 layer inner product
+typedef int32_t (*q7_dot_q7_fn)(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+);
+
+extern q7_dot_q7_fn q7_dot_q7_kernel;
+
+// dst += srcA in float32, the synaptic accumulate of PRECISION_FLOAT32 layers.
+// Every level adds element by element, so all are bit-exact with each other.
+typedef void (*float_add_to_float_fn)(
+    const float * __restrict srcA,
+    float       * __restrict dst,
+    size_t          blockSize
+);
+
+extern float_add_to_float_fn float_add_to_float_kernel;
+
+// dst += lut[code] for packed int4 codes. Codes come in groups of 32 neurons
+// stored in 16 bytes: byte k holds neuron k in its low nibble and neuron k + 16
+// in its high nibble; a shorter last group of w neurons splits at (w + 1) / 2
+// instead. The 16-entry table holds each code's int8 weight, so a per-layer
+// scale costs nothing in the loop and SIMD levels decode a whole half-group
+// with one table lookup. srcA must start on a group.
+typedef void (*q4_add_to_q31_fn)(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+extern q4_add_to_q31_fn q4_add_to_q31_kernel;
+
+// dst[i] += scale where bit i of pos is set and -= scale where bit i of neg is
+// set: a ternary {-1, 0, +1} row stored as two bitplanes
+typedef void (*ternary_add_to_q31_fn)(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+extern ternary_add_to_q31_fn ternary_add_to_q31_kernel;
+
+// Output-stationary accumulate of packed rows, like q7_gather_add_to_q31: the
+// blockSize <= Q7_TILE_NEURONS sums stay in registers while the listed rows
+// stream past. Packed rows are gathered in place, base + rows[k] * rowStride
+// being the tile's slice of row rows[k] (it starts on a 32-neuron group for
+// int4 and on a whole byte of each bitplane for ternary).
+typedef void (*q4_gather_add_to_q31_fn)(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+extern q4_gather_add_to_q31_fn q4_gather_add_to_q31_kernel;
+
+typedef void (*ternary_gather_add_to_q31_fn)(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+extern ternary_gather_add_to_q31_fn ternary_gather_add_to_q31_kernel;
+
+// Pick the widest kernel the CPU supports (CPUID). SNN_DSP_KERNEL=scalar|sse4.1|avx2|avx512bw
+// in the environment caps the choice. Returns the selected level.
+Dsp_Kernel dsp_init_dispatch(void);
+// Force a kernel level, returns 0 on success or 1 if the CPU cannot run it
+int dsp_select_kernel(Dsp_Kernel kernel);
+int dsp_kernel_supported(Dsp_Kernel kernel);
+Dsp_Kernel dsp_active_kernel(void);
+const char *dsp_kernel_name(Dsp_Kernel kernel);
+
+// Scalar reference, bit-exact with every SIMD variant
 void vectorize_q7_add_to_q31(
     const int8_t * __restrict srcA,
     int32_t       * __restrict dst,
     size_t          blockSize
 );
 
+void vectorize_q7_scale_add_to_q31(
+    const int8_t * __restrict srcA,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q15(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q31_multi(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+);
+
+#if defined(__x86_64__) || defined(__i386__)
+void vectorize_q7_add_to_q31_sse41(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q31_avx2(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q31_avx512bw(
+    const int8_t * __restrict srcA,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q15_sse41(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q15_avx2(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q7_add_to_q15_avx512bw(
+    const int8_t * __restrict srcA,
+    int16_t       * __restrict dst,
+    size_t          blockSize
+);
+#endif
+
+void vectorize_q7_gather_add_to_q31(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_q7_gather_add_to_q15(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+);
+
+#if defined(__x86_64__) || defined(__i386__)
+void vectorize_q7_gather_add_to_q31_avx2(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_q7_gather_add_to_q31_avx512bw(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_q7_gather_add_to_q15_avx2(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_q7_gather_add_to_q15_avx512bw(
+    const int8_t   * __restrict tile,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int16_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_q7_add_to_q31_multi_avx2(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+);
+
+void vectorize_q7_add_to_q31_multi_avx512bw(
+    const int8_t   * __restrict srcA,
+    int32_t        * __restrict dst_base,
+    const uint32_t * __restrict offsets,
+    size_t           numDst,
+    size_t           blockSize
+);
+
+void vectorize_q7_scale_add_to_q31_avx2(
+    const int8_t * __restrict srcA,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+#endif
+
+int32_t vectorize_q7_dot_q7(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+);
+
+#if defined(__x86_64__) || defined(__i386__)
+int32_t vectorize_q7_dot_q7_avx2(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+);
+
+int32_t vectorize_q7_dot_q7_avx512bw(
+    const int8_t * __restrict srcA,
+    const int8_t * __restrict srcB,
+    size_t          blockSize
+);
+#endif
+
 void vectorize_q31_add_to_q31(
     const int32_t * __restrict srcA,
     int32_t       * __restrict dst,
@@ -22,4 +342,128 @@ void vectorize_float_add_to_float(
     size_t          blockSize
 );
 
+#if defined(__x86_64__) || defined(__i386__)
+void vectorize_float_add_to_float_avx2(
+    const float * __restrict srcA,
+    float       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_float_add_to_float_avx512(
+    const float * __restrict srcA,
+    float       * __restrict dst,
+    size_t          blockSize
+);
+#endif
+
+void vectorize_q4_add_to_q31(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_ternary_add_to_q31(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q4_gather_add_to_q31(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_ternary_gather_add_to_q31(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+#if defined(__x86_64__) || defined(__i386__)
+void vectorize_q4_add_to_q31_avx2(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q4_add_to_q31_avx512bw(
+    const uint8_t * __restrict srcA,
+    const int8_t  * __restrict lut,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_ternary_add_to_q31_avx2(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_ternary_add_to_q31_avx512bw(
+    const uint8_t * __restrict pos,
+    const uint8_t * __restrict neg,
+    int32_t         scale,
+    int32_t       * __restrict dst,
+    size_t          blockSize
+);
+
+void vectorize_q4_gather_add_to_q31_avx2(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_q4_gather_add_to_q31_avx512bw(
+    const uint8_t  * __restrict base,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    const int8_t   * __restrict lut,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_ternary_gather_add_to_q31_avx2(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+
+void vectorize_ternary_gather_add_to_q31_avx512bw(
+    const uint8_t  * __restrict pos,
+    const uint8_t  * __restrict neg,
+    size_t           rowStride,
+    const uint16_t * __restrict rows,
+    size_t           numRows,
+    int32_t          scale,
+    int32_t        * __restrict dst,
+    size_t           blockSize
+);
+#endif
+
 #endif // DSP_HELPER_H
\ No newline at end of file
@@ -1,6 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef SNN_HAVE_ZLIB
+#include <zlib.h>
+#endif
 #include "file_operations.h"
 
 
@@ -175,3 +183,541 @@ void load_csv(const char *filename, float **array, int rows, int cols) {
     }
     fclose(file);
 }
+
+// Model file layout (whitespace separated):
+//   snn_model 1
+//   tau <T> time_window <W>
+//   input direct                  (optional, see INPUT_DIRECT)
+//   layers <L> <n0> <n1> ... <nL-1>
+//   then for each layer l >= 1: n_l bias values, then n_(l-1) rows of n_l weights
+// Values are Q0.7 integers in [-128, 127]. Version 2 files may start a layer
+// with "scales" and n_l per-channel scales (see Snn_Layer_Desc.scales); files
+// without any scales are written as version 1.
+static int read_q07_block(FILE *file, int8_t *dst, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int value;
+        if (fscanf(file, "%d", &value) != 1 || value < Q07_MIN_INT8 || value > Q07_MAX_INT8) {
+            return 1;
+        }
+        dst[i] = (int8_t)value;
+    }
+    return 0;
+}
+
+static int read_scale_block(FILE *file, float *dst, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (fscanf(file, "%f", &dst[i]) != 1 || !(dst[i] > 0.0f) || isinf(dst[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int desc_has_scales(const Snn_Network_Desc *desc) {
+    for (int l = 0; l < desc->num_layers; l++) {
+        if (desc->layers[l].scales) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int load_model_desc(const char *filename, Snn_Network_Desc *desc) {
+    memset(desc, 0, sizeof(*desc));
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        perror("Failed to open model file");
+        return 1;
+    }
+
+    char magic[sizeof(SNN_MODEL_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, SNN_MODEL_MAGIC, sizeof(magic)) == 0) {
+        fclose(file);
+        return load_model_bin(filename, desc);
+    }
+    rewind(file);
+
+    int version = 0;
+    char input_mode[16] = "";
+    int header_ok = fscanf(file, " snn_model %d", &version) == 1 && (version == 1 || version == 2)
+                 && fscanf(file, " tau %d time_window %d", &desc->tau, &desc->time_window) == 2;
+    // The input line is optional; a miss only consumes whitespace
+    if (header_ok && fscanf(file, " input %15s", input_mode) == 1) {
+        header_ok = strcmp(input_mode, "direct") == 0 || strcmp(input_mode, "lif") == 0;
+        desc->input_mode = strcmp(input_mode, "direct") == 0 ? INPUT_DIRECT : INPUT_LIF;
+    }
+    if (!header_ok || fscanf(file, " layers %d", &desc->num_layers) != 1 || desc->num_layers < 1) {
+        fprintf(stderr, "Error: %s is not a version 1 or 2 model file\n", filename);
+        fclose(file);
+        return 1;
+    }
+
+    desc->layers = calloc(desc->num_layers, sizeof(Snn_Layer_Desc));
+    if (!desc->layers) {
+        perror("Failed to allocate model");
+        fclose(file);
+        return 1;
+    }
+    for (int l = 0; l < desc->num_layers; l++) {
+        if (fscanf(file, "%d", &desc->layers[l].num_neurons) != 1 || desc->layers[l].num_neurons < 1) {
+            fprintf(stderr, "Error: bad width for layer %d in %s\n", l, filename);
+            free_model_desc(desc);
+            fclose(file);
+            return 1;
+        }
+    }
+
+    for (int l = 1; l < desc->num_layers; l++) {
+        size_t rows = desc->layers[l - 1].num_neurons;
+        size_t cols = desc->layers[l].num_neurons;
+        // The scales line is optional; a miss only consumes whitespace, as bias values never start with 's'
+        int matched = 0;
+        if (version == 2 && fscanf(file, " scales%n", &matched) == 0 && matched > 0) {
+            float *scales = malloc(cols * sizeof(float));
+            desc->layers[l].scales = scales;
+            if (!scales || read_scale_block(file, scales, cols)) {
+                fprintf(stderr, "Error: failed to read layer %d scales from %s\n", l, filename);
+                free_model_desc(desc);
+                fclose(file);
+                return 1;
+            }
+        }
+        int8_t *bias = malloc(cols);
+        int8_t *weights = malloc(rows * cols);
+        desc->layers[l].bias = bias;
+        desc->layers[l].weights = weights;
+        if (!bias || !weights || read_q07_block(file, bias, cols) || read_q07_block(file, weights, rows * cols)) {
+            fprintf(stderr, "Error: failed to read layer %d parameters from %s\n", l, filename);
+            free_model_desc(desc);
+            fclose(file);
+            return 1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int save_model_desc(const char *filename, const Snn_Network_Desc *desc) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        perror("Failed to open model file for writing");
+        return 1;
+    }
+
+    fprintf(file, "snn_model %d\ntau %d time_window %d\n", desc_has_scales(desc) ? 2 : 1, desc->tau, desc->time_window);
+    if (desc->input_mode == INPUT_DIRECT) {
+        fprintf(file, "input direct\n");
+    }
+    fprintf(file, "layers %d", desc->num_layers);
+    for (int l = 0; l < desc->num_layers; l++) {
+        fprintf(file, " %d", desc->layers[l].num_neurons);
+    }
+    fprintf(file, "\n");
+
+    for (int l = 1; l < desc->num_layers; l++) {
+        int rows = desc->layers[l - 1].num_neurons;
+        int cols = desc->layers[l].num_neurons;
+        if (desc->layers[l].scales) {
+            fprintf(file, "scales");
+            for (int i = 0; i < cols; i++) {
+                fprintf(file, " %.9g", desc->layers[l].scales[i]);
+            }
+            fprintf(file, "\n");
+        }
+        for (int i = 0; i < cols; i++) {
+            fprintf(file, "%d%c", desc->layers[l].bias[i], (i == cols - 1) ? '\n' : ' ');
+        }
+        for (int r = 0; r < rows; r++) {
+            for (int i = 0; i < cols; i++) {
+                fprintf(file, "%d%c", desc->layers[l].weights[(size_t)r * cols + i], (i == cols - 1) ? '\n' : ' ');
+            }
+        }
+    }
+
+    if (fclose(file) != 0) {
+        perror("Failed to write model file");
+        return 1;
+    }
+    return 0;
+}
+
+void free_model_desc(Snn_Network_Desc *desc) {
+    if (desc->mapping) {
+        munmap(desc->mapping, desc->mapping_bytes);
+    } else if (desc->layers) {
+        for (int l = 0; l < desc->num_layers; l++) {
+            free((void *)desc->layers[l].weights);
+            free((void *)desc->layers[l].bias);
+            free((void *)desc->layers[l].scales);
+        }
+    }
+    free(desc->layers);
+    memset(desc, 0, sizeof(*desc));
+}
+
+// Binary model layout (little-endian, every blob offset a multiple of 64):
+//   Snn_Model_Header
+//   Snn_Model_Layer[num_layers]
+//   per layer l >= 1: bias[n_l], weights[n_(l-1)][n_l], each padded to 64 bytes,
+//   then in version 2 an optional float scales[n_l] blob, padded the same way
+// Version 1 layer entries stop before scales_offset; files without any scales
+// are still written as version 1.
+#define SNN_MODEL_ALIGN 64
+#define SNN_NEURON_LIF  0
+#define SNN_NEURON_IF   1
+#define SNN_LAYER_DIRECT_INPUT 1u
+
+typedef struct {
+    char magic[8];          // SNN_MODEL_MAGIC
+    uint32_t version;
+    uint32_t num_layers;
+    uint32_t tau;
+    uint32_t time_window;
+    uint32_t neuron_type;   // SNN_NEURON_LIF or SNN_NEURON_IF
+    float weight_scale;     // real value = int8 / weight_scale (Q07_SCALE)
+    int32_t voltage_thresh; // Q0.7, 0 = build default
+    int32_t decay_rate;     // Q0.7, 0 = build default
+    uint64_t file_bytes;
+} Snn_Model_Header;
+
+typedef struct {
+    uint32_t num_neurons;
+    uint32_t flags;         // SNN_LAYER_DIRECT_INPUT on layer 0
+    uint64_t bias_offset;   // 0 for the input layer
+    uint64_t weights_offset;
+    uint64_t scales_offset; // version 2: per-channel scales, 0 for none
+} Snn_Model_Layer;
+
+#define SNN_MODEL_LAYER_V1_BYTES offsetof(Snn_Model_Layer, scales_offset)
+
+static size_t model_layer_bytes(uint32_t version) {
+    return version == 1 ? SNN_MODEL_LAYER_V1_BYTES : sizeof(Snn_Model_Layer);
+}
+
+// Entry l of either table version, with the fields it lacks zeroed
+static Snn_Model_Layer model_layer(const Snn_Model_Header *hdr, uint32_t l) {
+    Snn_Model_Layer entry;
+    size_t bytes = model_layer_bytes(hdr->version);
+    memset(&entry, 0, sizeof(entry));
+    memcpy(&entry, (const uint8_t *)(hdr + 1) + l * bytes, bytes);
+    return entry;
+}
+
+static uint64_t align_model_offset(uint64_t offset) {
+    return (offset + SNN_MODEL_ALIGN - 1) & ~(uint64_t)(SNN_MODEL_ALIGN - 1);
+}
+
+// Whether a blob of size bytes at offset lies past the layer table and inside
+// the file. Compared as offset <= end and size <= end - offset, so an offset
+// near UINT64_MAX cannot wrap around into range.
+static int model_blob_fits(uint64_t offset, uint64_t size, size_t table_end, size_t file_bytes) {
+    return offset % SNN_MODEL_ALIGN == 0 && offset >= table_end && offset <= file_bytes
+           && size <= file_bytes - offset;
+}
+
+int load_model_bin(const char *filename, Snn_Network_Desc *desc) {
+    memset(desc, 0, sizeof(*desc));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open model file");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Snn_Model_Header)) {
+        fprintf(stderr, "Error: %s is too short for a binary model\n", filename);
+        close(fd);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map model file");
+        return 1;
+    }
+    desc->mapping = map;
+    desc->mapping_bytes = (size_t)st.st_size;
+
+    const Snn_Model_Header *hdr = map;
+    size_t table_end = sizeof(*hdr) + (size_t)hdr->num_layers * model_layer_bytes(hdr->version);
+    if (memcmp(hdr->magic, SNN_MODEL_MAGIC, sizeof(SNN_MODEL_MAGIC)) != 0 || hdr->version < 1
+        || hdr->version > SNN_MODEL_VERSION
+        || hdr->file_bytes != (uint64_t)st.st_size || hdr->num_layers < 1 || hdr->num_layers > 4096
+        || table_end > desc->mapping_bytes) {
+        fprintf(stderr, "Error: %s is not a version 1 to %d binary model\n", filename, SNN_MODEL_VERSION);
+        free_model_desc(desc);
+        return 1;
+    }
+    if (hdr->neuron_type != (LIF ? SNN_NEURON_LIF : SNN_NEURON_IF) || hdr->weight_scale != Q07_SCALE) {
+        fprintf(stderr, "Error: %s was exported for a different neuron type or weight scale\n", filename);
+        free_model_desc(desc);
+        return 1;
+    }
+
+    // Only the small layer table is copied; blobs stay in the page cache
+    Snn_Layer_Desc *layers = calloc(hdr->num_layers, sizeof(Snn_Layer_Desc));
+    if (!layers) {
+        perror("Failed to allocate model");
+        free_model_desc(desc);
+        return 1;
+    }
+    desc->layers = layers;
+    desc->num_layers = (int)hdr->num_layers;
+    desc->tau = (int)hdr->tau;
+    desc->time_window = (int)hdr->time_window;
+    desc->voltage_thresh = hdr->voltage_thresh;
+    desc->decay_rate = hdr->decay_rate;
+    desc->input_mode = (model_layer(hdr, 0).flags & SNN_LAYER_DIRECT_INPUT) ? INPUT_DIRECT : INPUT_LIF;
+
+    uint64_t rows = 0;
+    for (uint32_t l = 0; l < hdr->num_layers; l++) {
+        Snn_Model_Layer entry = model_layer(hdr, l);
+        uint64_t cols = entry.num_neurons;
+        layers[l].num_neurons = (int)cols;
+        if (cols == 0 || cols > INT32_MAX) {
+            fprintf(stderr, "Error: bad width for layer %u in %s\n", l, filename);
+            free_model_desc(desc);
+            return 1;
+        }
+        if (l == 0) {
+            rows = cols;
+            continue;
+        }
+        uint64_t weight_bytes;
+        uint64_t scale_bytes;
+        if (__builtin_mul_overflow(rows, cols, &weight_bytes)
+            || __builtin_mul_overflow(cols, (uint64_t)sizeof(float), &scale_bytes)
+            || !model_blob_fits(entry.bias_offset, cols, table_end, desc->mapping_bytes)
+            || !model_blob_fits(entry.weights_offset, weight_bytes, table_end, desc->mapping_bytes)
+            || (entry.scales_offset
+                && !model_blob_fits(entry.scales_offset, scale_bytes, table_end, desc->mapping_bytes))) {
+            fprintf(stderr, "Error: layer %u parameters of %s are out of bounds\n", l, filename);
+            free_model_desc(desc);
+            return 1;
+        }
+        layers[l].bias = (const int8_t *)map + entry.bias_offset;
+        layers[l].weights = (const int8_t *)map + entry.weights_offset;
+        layers[l].scales = entry.scales_offset ? (const float *)((const uint8_t *)map + entry.scales_offset) : NULL;
+        rows = cols;
+    }
+    return 0;
+}
+
+int save_model_bin(const char *filename, const Snn_Network_Desc *desc) {
+    Snn_Model_Header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNN_MODEL_MAGIC, sizeof(SNN_MODEL_MAGIC));
+    hdr.version = desc_has_scales(desc) ? SNN_MODEL_VERSION : 1;
+    hdr.num_layers = (uint32_t)desc->num_layers;
+    hdr.tau = (uint32_t)desc->tau;
+    hdr.time_window = (uint32_t)desc->time_window;
+    hdr.neuron_type = LIF ? SNN_NEURON_LIF : SNN_NEURON_IF;
+    hdr.weight_scale = Q07_SCALE;
+    hdr.voltage_thresh = desc->voltage_thresh;
+    hdr.decay_rate = desc->decay_rate;
+
+    Snn_Model_Layer *table = calloc(desc->num_layers, sizeof(Snn_Model_Layer));
+    if (!table) {
+        perror("Failed to allocate model");
+        return 1;
+    }
+    size_t entry_bytes = model_layer_bytes(hdr.version);
+    uint64_t offset = align_model_offset(sizeof(hdr) + (size_t)desc->num_layers * entry_bytes);
+    for (int l = 0; l < desc->num_layers; l++) {
+        table[l].num_neurons = (uint32_t)desc->layers[l].num_neurons;
+        table[l].flags = (l == 0 && desc->input_mode == INPUT_DIRECT) ? SNN_LAYER_DIRECT_INPUT : 0;
+        if (l > 0) {
+            uint64_t cols = desc->layers[l].num_neurons;
+            uint64_t rows = desc->layers[l - 1].num_neurons;
+            table[l].bias_offset = offset;
+            offset = align_model_offset(offset + cols);
+            table[l].weights_offset = offset;
+            offset = align_model_offset(offset + rows * cols);
+            if (desc->layers[l].scales) {
+                table[l].scales_offset = offset;
+                offset = align_model_offset(offset + cols * sizeof(float));
+            }
+        }
+    }
+    hdr.file_bytes = offset;
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        perror("Failed to open model file for writing");
+        free(table);
+        return 1;
+    }
+    static const uint8_t zeros[SNN_MODEL_ALIGN];
+    int failed = fwrite(&hdr, sizeof(hdr), 1, file) != 1;
+    for (int l = 0; l < desc->num_layers; l++) {
+        failed |= fwrite(&table[l], entry_bytes, 1, file) != 1;
+    }
+    for (int l = 1; l < desc->num_layers && !failed; l++) {
+        size_t cols = desc->layers[l].num_neurons;
+        size_t rows = desc->layers[l - 1].num_neurons;
+        long pos = ftell(file);
+        failed |= fwrite(zeros, 1, table[l].bias_offset - pos, file) != table[l].bias_offset - pos
+               || fwrite(desc->layers[l].bias, 1, cols, file) != cols;
+        pos = ftell(file);
+        failed |= fwrite(zeros, 1, table[l].weights_offset - pos, file) != table[l].weights_offset - pos
+               || fwrite(desc->layers[l].weights, 1, rows * cols, file) != rows * cols;
+        if (desc->layers[l].scales) {
+            pos = ftell(file);
+            failed |= fwrite(zeros, 1, table[l].scales_offset - pos, file) != table[l].scales_offset - pos
+                   || fwrite(desc->layers[l].scales, sizeof(float), cols, file) != cols;
+        }
+    }
+    if (!failed) {
+        long pos = ftell(file);
+        failed |= fwrite(zeros, 1, offset - pos, file) != offset - pos;
+    }
+    free(table);
+    if (fclose(file) != 0 || failed) {
+        perror("Failed to write model file");
+        return 1;
+    }
+    return 0;
+}
+
+// IDX layout: 0x00 0x00 <type> <ndims>, ndims big-endian uint32 sizes, then data
+#define IDX_TYPE_UBYTE 0x08
+#define IDX_MAX_HEADER (4 + 3 * 4)
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// Fills the dataset shape from a header, returns the header length or 0 if invalid
+static size_t parse_idx_header(const uint8_t *header, size_t available, Idx_Dataset *set) {
+    if (available < 4 || header[0] != 0 || header[1] != 0 || header[2] != IDX_TYPE_UBYTE
+        || (header[3] != 1 && header[3] != 3)) {
+        return 0;
+    }
+    size_t header_bytes = 4 + 4 * (size_t)header[3];
+    if (available < header_bytes) {
+        return 0;
+    }
+    uint32_t items = read_be32(header + 4);
+    uint32_t rows = header[3] == 3 ? read_be32(header + 8) : 1;
+    uint32_t cols = header[3] == 3 ? read_be32(header + 12) : 1;
+    if (items == 0 || items > INT32_MAX || rows == 0 || rows > 65536 || cols == 0 || cols > 65536) {
+        return 0;
+    }
+    set->num_items = (int)items;
+    set->rows = (int)rows;
+    set->cols = (int)cols;
+    set->item_bytes = (size_t)rows * cols;
+    return header_bytes;
+}
+
+static int load_idx_mapped(const char *filename, int fd, Idx_Dataset *set) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 4) {
+        fprintf(stderr, "Error: %s is too short for an IDX file\n", filename);
+        return 1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("Failed to map IDX file");
+        return 1;
+    }
+    set->storage = map;
+    set->storage_bytes = (size_t)st.st_size;
+    set->mapped = 1;
+
+    size_t header_bytes = parse_idx_header(map, set->storage_bytes, set);
+    if (header_bytes == 0 || set->storage_bytes - header_bytes < (size_t)set->num_items * set->item_bytes) {
+        fprintf(stderr, "Error: %s is not a complete unsigned-byte IDX file\n", filename);
+        free_idx(set);
+        return 1;
+    }
+    madvise(map, set->storage_bytes, MADV_SEQUENTIAL);
+    set->data = (const uint8_t *)map + header_bytes;
+    return 0;
+}
+
+static int load_idx_gzip(const char *filename, Idx_Dataset *set) {
+#ifdef SNN_HAVE_ZLIB
+    gzFile gz = gzopen(filename, "rb");
+    if (gz == NULL) {
+        perror("Failed to open IDX file");
+        return 1;
+    }
+    gzbuffer(gz, 1 << 17);
+
+    uint8_t header[IDX_MAX_HEADER];
+    int got = gzread(gz, header, 4);
+    int dims = (got == 4) ? header[3] : 0;
+    if (dims >= 1 && dims <= 3) {
+        got += gzread(gz, header + 4, 4 * dims);
+    }
+    size_t header_bytes = parse_idx_header(header, got > 0 ? (size_t)got : 0, set);
+    if (header_bytes == 0) {
+        fprintf(stderr, "Error: %s is not an unsigned-byte IDX file\n", filename);
+        gzclose(gz);
+        return 1;
+    }
+
+    set->storage_bytes = (size_t)set->num_items * set->item_bytes;
+    set->storage = malloc(set->storage_bytes);
+    if (!set->storage) {
+        perror("Failed to allocate IDX data");
+        gzclose(gz);
+        return 1;
+    }
+    // gzread takes an unsigned count, so decompress in bounded pieces
+    size_t filled = 0;
+    while (filled < set->storage_bytes) {
+        size_t want = set->storage_bytes - filled;
+        int n = gzread(gz, (uint8_t *)set->storage + filled, want > (1u << 30) ? (1u << 30) : (unsigned)want);
+        if (n <= 0) {
+            fprintf(stderr, "Error: %s ends after %zu of %zu data bytes\n", filename, filled, set->storage_bytes);
+            gzclose(gz);
+            free_idx(set);
+            return 1;
+        }
+        filled += (size_t)n;
+    }
+    gzclose(gz);
+    set->data = set->storage;
+    return 0;
+#else
+    fprintf(stderr, "Error: %s is gzip-compressed but this build has no zlib support\n", filename);
+    (void)set;
+    return 1;
+#endif
+}
+
+int load_idx(const char *filename, Idx_Dataset *set) {
+    memset(set, 0, sizeof(*set));
+
+    char gz_name[4096];
+    const char *path = filename;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 && snprintf(gz_name, sizeof(gz_name), "%s.gz", filename) < (int)sizeof(gz_name)) {
+        path = gz_name;
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot open IDX file %s\n", filename);
+        return 1;
+    }
+
+    // gzip streams start with 0x1f 0x8b, IDX files with two zero bytes
+    uint8_t magic[2] = {0, 0};
+    int is_gzip = read(fd, magic, 2) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    int status = is_gzip ? load_idx_gzip(path, set) : load_idx_mapped(path, fd, set);
+    close(fd);
+    return status;
+}
+
+void free_idx(Idx_Dataset *set) {
+    if (set->mapped) {
+        munmap(set->storage, set->storage_bytes);
+    } else {
+        free(set->storage);
+    }
+    memset(set, 0, sizeof(*set));
+}
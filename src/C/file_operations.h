@@ -1,7 +1,10 @@
 #ifndef FILE_OPERATIONS_H
 #define FILE_OPERATIONS_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "define.h"
+#include "snn_network.h"
 
 void load_weights(const char *filename, float **weights, int rows, int cols);
 void load_bias(const char *filename, float *bias, int size);
@@ -11,4 +14,35 @@ void load_csv(const char *filename, float **array, int rows, int cols);
 int read_spike_data(const char* filename, char ***spikes);
 int read_labels(const char* filename, char *labels, int num_samples);
 
+// Text model file: topology header followed by Q0.7 bias/weight integers and,
+// in version 2, optional per-channel scales
+int load_model_desc(const char *filename, Snn_Network_Desc *desc);
+int save_model_desc(const char *filename, const Snn_Network_Desc *desc);
+void free_model_desc(Snn_Network_Desc *desc);
+
+// Binary model file: fixed header, per-layer table and 64-byte aligned Q0.7
+// blobs. Loading maps the file and points the descriptor straight into it.
+// load_model_desc detects binary files by their magic, so either format works.
+#define SNN_MODEL_MAGIC   "SNNMODL"
+#define SNN_MODEL_VERSION 2     // 2 adds per-channel scales; 1 is still read and written
+int load_model_bin(const char *filename, Snn_Network_Desc *desc);
+int save_model_bin(const char *filename, const Snn_Network_Desc *desc);
+
+// Unsigned-byte IDX file (MNIST images or labels). Raw files are memory-mapped,
+// gzip files are decompressed in one streaming pass when built with zlib.
+typedef struct {
+    int num_items;
+    int rows;               // 1 for label files
+    int cols;               // 1 for label files
+    size_t item_bytes;      // rows * cols
+    const uint8_t *data;    // [num_items][item_bytes]
+    void *storage;          // mapping or heap buffer behind data
+    size_t storage_bytes;
+    int mapped;
+} Idx_Dataset;
+
+// Falls back to filename.gz when filename does not exist
+int load_idx(const char *filename, Idx_Dataset *set);
+void free_idx(Idx_Dataset *set);
+
 #endif // FILE_OPERATIONS_H
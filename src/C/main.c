@@ -3,41 +3,276 @@
 #include <string.h>
 #include <time.h>
 #include <stdint.h>
-#include <sys/time.h>
 
 #include "define.h"
 #include "file_operations.h"
 #include "rate_encoding.h"
 #include "snn_network.h"
+#include "dsp_helper.h"
+#include "snn_threads.h"
+#include "snn_pipeline.h"
+#include "snn_stats.h"
 // #include "debug.h"
 #include "dummy.h"
 
 Snn_Network snn_network;
 
-char labels[NUM_SAMPLES] = {0};
+char *labels = NULL;
 
 // Function prototypes
 void dump_classification(FILE *output_file, int sample_index, int classification, char* labels);
+void usage(const char *prog);
 
 int validate_spike_data(char ***spikes);
 
-int main() {
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--model file] [--export-model file] [--export-binary file] [--direct-input] [--samples N] [--seed S] [--encoder E] [--threads T] [--pipeline S]\n"
+                    "          [--images idx [--labels idx]] [--stats file] [--early-exit P] [--min-chunks N] [--precision P]\n"
+                    "          [--weights W]\n", prog);
+    fprintf(stderr, "  --model file         run a model file instead of the built-in dummy.c tables\n");
+    fprintf(stderr, "  --images idx         classify an MNIST IDX image file (raw or .gz) instead of the built-in sample\n");
+    fprintf(stderr, "  --labels idx         matching IDX label file, reports accuracy\n");
+    fprintf(stderr, "  --direct-input       feed encoder spikes straight into layer 1, skipping the input LIF\n");
+    fprintf(stderr, "  --samples N          number of encoded samples to classify (default %d, or every image with --images)\n", NUM_SAMPLES);
+    fprintf(stderr, "  --seed S             encoder seed; sample d always gets stream d (default: time)\n");
+    fprintf(stderr, "  --encoder E          spike generator: rate (default), latency or delta\n");
+    fprintf(stderr, "  --threads T          shard samples across T worker threads (0 = all cores)\n");
+    fprintf(stderr, "  --pipeline S         stream chunks through S layer-group stages, one thread each\n");
+    fprintf(stderr, "  --early-exit P       stop a sample once its output is settled: off (default), decided,\n"
+                    "                       margin[:N] (N spikes ahead) or confidence[:P] (P%% of output spikes)\n");
+    fprintf(stderr, "  --min-chunks N       chunks every sample runs before it may stop early (default %d)\n",
+            EARLY_EXIT_MIN_CHUNKS);
+    fprintf(stderr, "  --precision P        membrane arithmetic: q07 or float32 for every layer, or a comma list\n"
+                    "                       with one entry per layer (default %s)\n", precision_name(DEFAULT_PRECISION));
+    fprintf(stderr, "  --weights W          weight storage: int8, int4 or ternary for every layer, or a comma\n"
+                    "                       list with one entry per layer (default %s)\n",
+            weight_format_name(DEFAULT_WEIGHT_FORMAT));
+    fprintf(stderr, "  --stats file         write per-layer activity counters as JSON, or CSV for a .csv name (make STATS=1)\n");
+    fprintf(stderr, "  --export-model file  write the built-in tables as a model file and exit\n");
+    fprintf(stderr, "  --export-binary file write the built-in tables as a mappable binary model and exit\n");
+}
+
+int main(int argc, char **argv) {
+    const char *model_path = NULL;
+    const char *export_path = NULL;
+    const char *export_bin_path = NULL;
+    const char *images_path = NULL;
+    const char *labels_path = NULL;
+    int num_samples = 0;
+    uint64_t seed = (uint64_t)time(NULL);
+    Encoder_Kind encoder_kind = ENCODER_RATE;
+    int num_threads = 1;
+    int num_stages = 0;
+    int direct_input = 0;
+    const char *stats_path = NULL;
+    const char *precision_text = NULL;
+    const char *weights_text = NULL;
+    Early_Exit_Policy early_exit = { DEFAULT_EARLY_EXIT, EARLY_EXIT_MARGIN_SPIKES, EARLY_EXIT_CONFIDENCE_PCT,
+                                     EARLY_EXIT_MIN_CHUNKS };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+            model_path = argv[++i];
+        } else if (strcmp(argv[i], "--export-model") == 0 && i + 1 < argc) {
+            export_path = argv[++i];
+        } else if (strcmp(argv[i], "--export-binary") == 0 && i + 1 < argc) {
+            export_bin_path = argv[++i];
+        } else if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+            images_path = argv[++i];
+        } else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc) {
+            labels_path = argv[++i];
+        } else if (strcmp(argv[i], "--direct-input") == 0) {
+            direct_input = 1;
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            num_samples = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--encoder") == 0 && i + 1 < argc) {
+            if (encoder_parse(argv[++i], &encoder_kind)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            num_stages = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--early-exit") == 0 && i + 1 < argc) {
+            if (early_exit_parse(argv[++i], &early_exit)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--min-chunks") == 0 && i + 1 < argc) {
+            early_exit.min_chunks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            precision_text = argv[++i];
+        } else if (strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            weights_text = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (num_samples < 0 || (labels_path && !images_path)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (stats_path && !SNN_STATS) {
+        fprintf(stderr, "Error: --stats needs a build with the counters compiled in (make clean && make STATS=1)\n");
+        return 1;
+    }
+
     srand((unsigned int)time(NULL));
 
-    snn_network.num_layers = NUM_LAYERS;
-    int neurons_per_layer[] = {INPUT_SIZE, HIDDEN_LAYER_1, NUM_CLASSES};
+    // Built-in model from dummy.c
+    Snn_Layer_Desc builtin_layers[NUM_LAYERS] = {
+        { INPUT_SIZE, NULL, NULL, NULL },
+        { HIDDEN_LAYER_1, &weights_fc1_data[0][0], bias_fc1, NULL },
+        { NUM_CLASSES, &weights_fc2_data[0][0], bias_fc2, NULL },
+    };
+    Snn_Network_Desc model = { NUM_LAYERS, TAU, TIME_WINDOW, builtin_layers, 0, 0,
+                               direct_input ? INPUT_DIRECT : INPUT_LIF, NULL, 0 };
 
-    initialize_network(neurons_per_layer, weights_fc1_data, weights_fc2_data, bias_fc1, bias_fc2);
-    zero_network();
-    printf("Network initialized\n");
+    if (export_path || export_bin_path) {
+        if ((export_path && save_model_desc(export_path, &model))
+            || (export_bin_path && save_model_bin(export_bin_path, &model))) {
+            return 1;
+        }
+        printf("Model written to %s\n", export_path ? export_path : export_bin_path);
+        return 0;
+    }
 
-    static uint8_t initial_spikes[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES] = {0};
+    Snn_Network_Desc loaded = {0};
+    if (model_path) {
+        if (load_model_desc(model_path, &loaded)) {
+            return 1;
+        }
+        model = loaded;
+        if (direct_input) {
+            model.input_mode = INPUT_DIRECT;
+        }
+    }
 
-    labels[0] = label;
+    if (build_network(&snn_network, &model)) {
+        free_model_desc(&loaded);
+        return 1;
+    }
+    if (weights_text) {
+        Weight_Format formats[snn_network.num_layers];
+        if (weight_format_parse(weights_text, formats, snn_network.num_layers)) {
+            usage(argv[0]);
+            free_network();
+            free_model_desc(&loaded);
+            return 1;
+        }
+        for (int l = 0; l < snn_network.num_layers; l++) {
+            if (set_layer_weight_format(&snn_network, l, formats[l])) {
+                free_network();
+                free_model_desc(&loaded);
+                return 1;
+            }
+        }
+    }
+    if (precision_text) {
+        Layer_Precision precisions[snn_network.num_layers];
+        if (precision_parse(precision_text, precisions, snn_network.num_layers)) {
+            usage(argv[0]);
+            free_network();
+            free_model_desc(&loaded);
+            return 1;
+        }
+        for (int l = 0; l < snn_network.num_layers; l++) {
+            if (set_layer_precision(&snn_network, l, precisions[l])) {
+                free_network();
+                free_model_desc(&loaded);
+                return 1;
+            }
+        }
+    }
+    snn_network.early_exit = early_exit;
+    printf("Network initialized (synaptic kernel: %s, %s input, early exit %s)\n",
+           dsp_kernel_name(dsp_active_kernel()), snn_network.first_layer ? "direct" : "LIF",
+           early_exit_name(early_exit.mode));
+    for (int l = 0; l < snn_network.num_layers; l++) {
+        const Layer *layer = &snn_network.layers[l];
+        printf("  layer %d: %d neurons, %s", l, layer->num_neurons, precision_name(layer->precision));
+        if (l > 0) {
+            printf(", %s weights", weight_format_name(layer->weight_format));
+            if (layer->weight_format != WEIGHTS_INT8) {
+                printf(" (scale %.2f)", layer->weight_scale);
+            }
+            if (layer->channel_scale) {
+                printf(", per-channel scales");
+            }
+            printf(", %s sums (bound %d)", layer->sum_width == SUMS_INT16 ? "int16" : "int32", layer->sum_bound);
+        }
+        printf("\n");
+    }
+    Snn_Memory_Plan plan;
+    if (plan_network_memory(&model, &plan) == 0) {
+        printf("  memory: %zu bytes network (%zu in weight tiles), %zu per context\n",
+               plan.total, plan.weight_tiles, context_memory_size(&snn_network));
+    }
 
-    printf("Making Spikes\n");
-    rate_encoding_3d(input_data, NUM_SAMPLES, TIME_WINDOW, INPUT_SIZE, initial_spikes);
-    printf("\033[1;32mSpikes Made\033[0m\n");
+    // Input pixels come from an IDX file or the built-in 28x28 sample
+    int num_inputs = snn_network.layers[0].num_neurons;
+    Idx_Dataset images = {0};
+    Idx_Dataset label_set = {0};
+    if (images_path) {
+        if (load_idx(images_path, &images) || (labels_path && load_idx(labels_path, &label_set))) {
+            free_idx(&images);
+            free_network();
+            free_model_desc(&loaded);
+            return 1;
+        }
+        if (images.item_bytes != (size_t)num_inputs || (labels_path && label_set.num_items < images.num_items)) {
+            fprintf(stderr, "Error: %s does not match the model input or label count\n", images_path);
+            free_idx(&images);
+            free_idx(&label_set);
+            free_network();
+            free_model_desc(&loaded);
+            return 1;
+        }
+        if (num_samples == 0 || num_samples > images.num_items) {
+            num_samples = images.num_items;
+        }
+        printf("Loaded %d images of %dx%d from %s\n", images.num_items, images.rows, images.cols, images_path);
+    } else {
+        if (num_inputs != INPUT_SIZE) {
+            fprintf(stderr, "Error: model input is %d neurons, built-in sample has %d pixels\n", num_inputs, INPUT_SIZE);
+            free_network();
+            free_model_desc(&loaded);
+            return 1;
+        }
+        if (num_samples == 0) {
+            num_samples = NUM_SAMPLES;
+        }
+    }
+
+    // Every engine pulls each chunk from an encoder as it runs, so no
+    // [time_window] spike tensor is ever built
+    int time_window = snn_network.time_window;
+    Spike_Source source;
+    encoder_init(&source.encoder, encoder_kind, num_inputs, time_window, seed);
+    source.data = images_path ? images.data : input_data;
+    source.sample_stride = images_path ? images.item_bytes : 0;
+    source.num_frames = 1;
+    Spike_Encoder encoder;
+
+    int *classifications = calloc(num_samples, sizeof(int));
+    int *chunks_used = calloc(num_samples, sizeof(int));
+    labels = calloc(num_samples, sizeof(char));
+    if (!classifications || !chunks_used || !labels) {
+        perror("Failed to allocate results");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int d = 0; d < num_samples; d++) {
+        labels[d] = labels_path ? (char)label_set.data[d] : (images_path ? -1 : label);
+    }
+    free_idx(&label_set);
+
+    printf("Streaming %s-encoded chunks into the engine\n", encoder_name(encoder_kind));
 
     // Read data into allocated arrays
     // if (read_spike_data("../mnist_input_spikes.csv", initial_spikes) || read_labels("../mnist_labels.csv", labels, NUM_SAMPLES)) {
@@ -68,27 +303,117 @@ int main() {
         exit(EXIT_FAILURE);
     }
 
-    struct timeval start, end;
-
-    printf("\033[1;32mStarting Sim\033[0m\n");
-    for (int d = 0; d < NUM_SAMPLES; d++) {
-        // printf("\r\033[KSample: \033[1;37m%d\033[0m/%d", d+1, NUM_SAMPLES);
-        // fflush(stdout);
+    Snn_Thread_Pool pool;
+    Snn_Pipeline pipe;
+    if (num_stages > 0) {
+        if (create_pipeline(&pipe, &snn_network, num_stages)) {
+            exit(EXIT_FAILURE);
+        }
+        printf("Running a %d-stage pipeline\n", pipe.num_stages);
+    } else if (num_threads != 1) {
+        if (create_thread_pool(&pool, &snn_network, num_threads, 1)) {
+            exit(EXIT_FAILURE);
+        }
+        printf("Running on %d threads\n", pool.num_threads);
+    }
 
-        gettimeofday(&start, NULL);
+    // One counter set per engine instance (worker, stage or the sequential
+    // path), merged into the first after the run
+    int num_stats = !stats_path ? 0 : num_stages > 0 ? pipe.num_stages : num_threads != 1 ? pool.num_threads : 1;
+    Snn_Stats *stats = calloc(num_stats ? num_stats : 1, sizeof(Snn_Stats));
+    if (!stats) {
+        perror("Failed to allocate stats");
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < num_stats; s++) {
+        if (stats_init(&stats[s], &snn_network)) {
+            exit(EXIT_FAILURE);
+        }
+        if (num_stages > 0) {
+            pipe.stages[s].ctx.stats = &stats[s];
+        } else if (num_threads != 1) {
+            pool.workers[s].ctx.stats = &stats[s];
+        } else {
+            snn_network.stats = &stats[s];
+        }
+    }
 
-        int classification = inference(initial_spikes, d);
+    struct timespec start, end;
 
-        gettimeofday(&end, NULL);
+    printf("\033[1;32mStarting Sim\033[0m\n");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (num_stages > 0) {
+        pipeline_inference_stream(&pipe, &source, num_samples, classifications, chunks_used);
+    } else if (num_threads != 1) {
+        pool_inference_stream(&pool, &source, num_samples, classifications, chunks_used);
+    } else {
+        for (int d = 0; d < num_samples; d++) {
+            // printf("\r\033[KSample: \033[1;37m%d\033[0m/%d", d+1, num_samples);
+            // fflush(stdout);
+            source_begin(&source, &encoder, d);
+            classifications[d] = network_inference_stream(&snn_network, &encoder);
+            chunks_used[d] = snn_network.chunks_used;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-        dump_classification(output_file, d, classification, labels);
+    int correct = 0;
+    for (int d = 0; d < num_samples; d++) {
+        dump_classification(output_file, d, classifications[d], labels);
+        correct += classifications[d] == labels[d];
     }
     printf("\n");
     printf("\033[1;32mSim Finished\033[0m\n");
-    printf( "CPU run time = %0.6f s\n", (float)(end.tv_sec - start.tv_sec\
-                + (end.tv_usec - start.tv_usec) / (float)1000000));
+    float run_time = (float)(end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9);
+    printf( "CPU run time = %0.6f s (%d samples, %d threads, %0.1f samples/s)\n",
+            run_time, num_samples, num_threads, run_time > 0 ? num_samples / run_time : 0.0f);
+    if (!images_path || labels_path) {
+        printf("Accuracy = %0.2f%% (%d/%d)\n", 100.0f * correct / num_samples, correct, num_samples);
+    }
+    if (early_exit.mode != EARLY_EXIT_OFF) {
+        int num_chunks = time_window / snn_network.tau;
+        int *histogram = calloc(num_chunks + 1, sizeof(int));
+        long total_chunks = 0;
+        for (int d = 0; d < num_samples && histogram; d++) {
+            total_chunks += chunks_used[d];
+            histogram[chunks_used[d]]++;
+        }
+        printf("Chunks used = %0.2f of %d on average (", (double)total_chunks / num_samples, num_chunks);
+        for (int c = 1; c <= num_chunks && histogram; c++) {
+            printf("%s%d: %d", c > 1 ? ", " : "", c, histogram[c]);
+        }
+        printf(")\n");
+        free(histogram);
+    }
     fclose(output_file);
 
+    if (num_stats) {
+        for (int s = 1; s < num_stats; s++) {
+            stats_merge(&stats[0], &stats[s]);
+        }
+        size_t len = strlen(stats_path);
+        int csv = len >= 4 && strcmp(stats_path + len - 4, ".csv") == 0;
+        if (!(csv ? stats_write_csv(&stats[0], stats_path) : stats_write_json(&stats[0], stats_path))) {
+            printf("Layer stats written to %s\n", stats_path);
+        }
+    }
+    for (int s = 0; s < num_stats; s++) {
+        stats_free(&stats[s]);
+    }
+    free(stats);
+    snn_network.stats = NULL;
+
+    if (num_stages > 0) {
+        destroy_pipeline(&pipe);
+    } else if (num_threads != 1) {
+        destroy_thread_pool(&pool);
+    }
+    free_idx(&images);
+    free(classifications);
+    free(chunks_used);
+    free(labels);
+    free_network();
+    free_model_desc(&loaded);
     return 0;
 }
 
@@ -4,8 +4,20 @@
 #include "define.h"
 #include "rate_encoding.h"
 #include "snn_network.h"
+#include "dsp_helper.h"
+#include <string.h>
 #include <time.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RATE_HAVE_X86 1
+#else
+#define RATE_HAVE_X86 0
+#endif
+
+// Pixels per encoder block: one byte from each of the 8 lanes' 64-bit draws
+#define RATE_BLOCK 64
+
 void rate_encoding(float *data, int data_size, int time_window, int max_rate, unsigned char **spike_trains) {
     for (int i = 0; i < data_size; i++) {
         int num_spikes = (int)(data[i] * max_rate);
@@ -30,16 +42,286 @@ int bernoulli_trial(float p){
     return (rand() / (float)RAND_MAX) < p ? 1 : 0; // bernoulli trial with probability p
 }
 
-void rate_encoding_3d(const uint8_t data[INPUT_SIZE], int dim1, int dim2, int dim3, uint8_t spikes[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES]) {
+void rate_encode_sample(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes, int spike_bytes) {
     float prob =0;
     int spike = 0;
+    for (int h = 0; h < time_window; h++) {
+        uint8_t *row = spikes + (size_t)h * spike_bytes;
+        for (int w = 0; w < num_inputs; w++) {
+            prob = data[w] / 255.0; // Normalize the data to [0, 1]
+            spike = bernoulli_trial(prob); // Perform Bernoulli trial
+            SET_BIT(row, w, spike); // Set the spike in the packed row
+        }
+    }
+}
+
+void rate_encoding_3d(const uint8_t data[INPUT_SIZE], int dim1, int dim2, int dim3, uint8_t spikes[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES]) {
+    // One rand() per call keeps srand() in charge of the whole batch
+    uint64_t seed = (uint64_t)rand();
+    Rate_Rng rng;
     for (int c = 0; c < dim1; c++) {
-        for (int h = 0; h < dim2; h++) {
-            for (int w = 0; w < dim3; w++) {
-                prob = data[w] / 255.0; // Normalize the data to [0, 1]
-                spike = bernoulli_trial(prob); // Perform Bernoulli trial
-                set_input_spike(spikes, c, h, w, spike); // Set the spike in the 3D array
+        rate_rng_seed(&rng, seed, (uint64_t)c);
+        rate_encode_sample_rng(data, dim3, dim2, &spikes[c][0][0], INPUT_BYTES, &rng);
+    }
+}
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void rate_rng_seed(Rate_Rng *rng, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    for (int w = 0; w < 4; w++) {
+        for (int lane = 0; lane < RATE_RNG_LANES; lane++) {
+            rng->s[w][lane] = splitmix64(&x);
+        }
+    }
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Zero pixels never fire, so a zero-padded copy of the last partial block
+// encodes it like a full one. Returns where the full blocks end.
+static inline int pad_tail_block(const uint8_t *data, int num_inputs, uint8_t *pad) {
+    int full_end = num_inputs - num_inputs % RATE_BLOCK;
+    memset(pad, 0, RATE_BLOCK);
+    memcpy(pad, data + full_end, num_inputs - full_end);
+    return full_end;
+}
+
+static inline void store_block_bits(uint8_t *row, uint64_t bits, int num_inputs, int b) {
+    int n = num_inputs - b;
+    memcpy(row + b / 8, &bits, n >= RATE_BLOCK ? 8 : (n + 7) / 8);
+}
+
+static void encode_blocks_scalar(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes,
+                                 int spike_bytes, Rate_Rng *rng) {
+    uint8_t pad[RATE_BLOCK];
+    int full_end = pad_tail_block(data, num_inputs, pad);
+    for (int t = 0; t < time_window; t++) {
+        for (int b = 0; b < num_inputs; b += RATE_BLOCK) {
+            const uint8_t *pix = b < full_end ? data + b : pad;
+            uint64_t bits = 0;
+            for (int lane = 0; lane < RATE_RNG_LANES; lane++) {
+                uint64_t *s0 = &rng->s[0][lane], *s1 = &rng->s[1][lane];
+                uint64_t *s2 = &rng->s[2][lane], *s3 = &rng->s[3][lane];
+                uint64_t r = rotl64(*s0 + *s3, 23) + *s0;
+                uint64_t tmp = *s1 << 17;
+                *s2 ^= *s0;
+                *s3 ^= *s1;
+                *s1 ^= *s2;
+                *s0 ^= *s3;
+                *s2 ^= tmp;
+                *s3 = rotl64(*s3, 45);
+
+                for (int j = 0; j < 8; j++) {
+                    uint8_t p = pix[lane * 8 + j];
+                    uint8_t draw = (uint8_t)(r >> (8 * j));
+                    bits |= (uint64_t)(draw < p || p == 255) << (lane * 8 + j);
+                }
+            }
+            store_block_bits(spikes + (size_t)t * spike_bytes, bits, num_inputs, b);
+        }
+    }
+}
+
+#if RATE_HAVE_X86
+__attribute__((target("avx2")))
+static inline __m256i rotl64_avx2(__m256i x, int k) {
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+__attribute__((target("avx2")))
+static void encode_blocks_avx2(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes,
+                               int spike_bytes, Rate_Rng *rng) {
+    uint8_t pad[RATE_BLOCK];
+    int full_end = pad_tail_block(data, num_inputs, pad);
+    __m256i s[4][2];
+    for (int w = 0; w < 4; w++) {
+        s[w][0] = _mm256_load_si256((const __m256i *)&rng->s[w][0]);
+        s[w][1] = _mm256_load_si256((const __m256i *)&rng->s[w][4]);
+    }
+    const __m256i full = _mm256_set1_epi8((char)0xFF);
+
+    for (int t = 0; t < time_window; t++) {
+        for (int b = 0; b < num_inputs; b += RATE_BLOCK) {
+            const uint8_t *pix = b < full_end ? data + b : pad;
+            uint64_t bits = 0;
+            for (int h = 0; h < 2; h++) {
+                __m256i p = _mm256_loadu_si256((const __m256i *)(pix + 32 * h));
+                __m256i r = _mm256_add_epi64(rotl64_avx2(_mm256_add_epi64(s[0][h], s[3][h]), 23), s[0][h]);
+                __m256i tmp = _mm256_slli_epi64(s[1][h], 17);
+                s[2][h] = _mm256_xor_si256(s[2][h], s[0][h]);
+                s[3][h] = _mm256_xor_si256(s[3][h], s[1][h]);
+                s[1][h] = _mm256_xor_si256(s[1][h], s[2][h]);
+                s[0][h] = _mm256_xor_si256(s[0][h], s[3][h]);
+                s[2][h] = _mm256_xor_si256(s[2][h], tmp);
+                s[3][h] = rotl64_avx2(s[3][h], 45);
+
+                // draw < p  <=>  !(p <= draw)  <=>  min(p, draw) != p
+                __m256i ge = _mm256_cmpeq_epi8(_mm256_min_epu8(p, r), p);
+                __m256i fire = _mm256_or_si256(_mm256_andnot_si256(ge, full), _mm256_cmpeq_epi8(p, full));
+                bits |= (uint64_t)(uint32_t)_mm256_movemask_epi8(fire) << (32 * h);
             }
+            store_block_bits(spikes + (size_t)t * spike_bytes, bits, num_inputs, b);
+        }
+    }
+
+    for (int w = 0; w < 4; w++) {
+        _mm256_store_si256((__m256i *)&rng->s[w][0], s[w][0]);
+        _mm256_store_si256((__m256i *)&rng->s[w][4], s[w][1]);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static void encode_blocks_avx512bw(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes,
+                                   int spike_bytes, Rate_Rng *rng) {
+    __m512i s0 = _mm512_load_si512(rng->s[0]);
+    __m512i s1 = _mm512_load_si512(rng->s[1]);
+    __m512i s2 = _mm512_load_si512(rng->s[2]);
+    __m512i s3 = _mm512_load_si512(rng->s[3]);
+    const __m512i full = _mm512_set1_epi8((char)0xFF);
+
+    for (int t = 0; t < time_window; t++) {
+        uint8_t *row = spikes + (size_t)t * spike_bytes;
+        for (int b = 0; b < num_inputs; b += RATE_BLOCK) {
+            int n = num_inputs - b;
+            __mmask64 valid = n >= RATE_BLOCK ? ~(__mmask64)0 : (((__mmask64)1 << n) - 1);
+            __mmask16 store = n >= RATE_BLOCK ? 0xFF : (__mmask16)((1u << ((n + 7) / 8)) - 1);
+            __m512i p = _mm512_maskz_loadu_epi8(valid, data + b);
+
+            __m512i r = _mm512_add_epi64(_mm512_rol_epi64(_mm512_add_epi64(s0, s3), 23), s0);
+            __m512i tmp = _mm512_slli_epi64(s1, 17);
+            s2 = _mm512_xor_si512(s2, s0);
+            s3 = _mm512_xor_si512(s3, s1);
+            s1 = _mm512_xor_si512(s1, s2);
+            s0 = _mm512_xor_si512(s0, s3);
+            s2 = _mm512_xor_si512(s2, tmp);
+            s3 = _mm512_rol_epi64(s3, 45);
+
+            __mmask64 bits = _mm512_cmplt_epu8_mask(r, p) | _mm512_cmpeq_epi8_mask(p, full);
+            _mm_mask_storeu_epi8(row + b / 8, store, _mm_cvtsi64_si128((long long)bits));
+        }
+    }
+
+    _mm512_store_si512(rng->s[0], s0);
+    _mm512_store_si512(rng->s[1], s1);
+    _mm512_store_si512(rng->s[2], s2);
+    _mm512_store_si512(rng->s[3], s3);
+}
+#endif
+
+void rate_encode_sample_rng(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes,
+                            int spike_bytes, Rate_Rng *rng) {
+    // Clear row padding past the last 64-pixel block's bytes
+    int used_bytes = (num_inputs + 7) / 8;
+    if (spike_bytes > used_bytes) {
+        for (int t = 0; t < time_window; t++) {
+            memset(spikes + (size_t)t * spike_bytes + used_bytes, 0, spike_bytes - used_bytes);
+        }
+    }
+
+    switch (dsp_active_kernel()) {
+#if RATE_HAVE_X86
+    case DSP_KERNEL_AVX512BW:
+        encode_blocks_avx512bw(data, num_inputs, time_window, spikes, spike_bytes, rng);
+        return;
+    case DSP_KERNEL_AVX2:
+        encode_blocks_avx2(data, num_inputs, time_window, spikes, spike_bytes, rng);
+        return;
+#endif
+    default:
+        encode_blocks_scalar(data, num_inputs, time_window, spikes, spike_bytes, rng);
+        return;
+    }
+}
+
+static void fill_rate(Spike_Encoder *enc, uint8_t *rows, int steps, int stride) {
+    rate_encode_sample_rng(enc->data, enc->num_inputs, steps, rows, stride, &enc->rng);
+}
+
+static void fill_latency(Spike_Encoder *enc, uint8_t *rows, int steps, int stride) {
+    memset(rows, 0, (size_t)steps * stride);
+    int last = enc->time_window - 1;
+    for (int i = 0; i < enc->num_inputs; i++) {
+        int p = enc->data[i];
+        if (p == 0) {
+            continue;
+        }
+        // 255 fires on step 0, 1 on the last step of the window
+        int t = ((255 - p) * last + 127) / 254 - enc->step;
+        if (t >= 0 && t < steps) {
+            uint8_t *row = rows + (size_t)t * stride;
+            SET_BIT(row, i, 1);
+        }
+    }
+}
+
+static void fill_delta(Spike_Encoder *enc, uint8_t *rows, int steps, int stride) {
+    memset(rows, 0, (size_t)steps * stride);
+    for (int k = 0; k < steps; k++) {
+        int t = enc->step + k;
+        const uint8_t *cur = enc->data + (size_t)(t < enc->num_frames ? t : enc->num_frames - 1) * enc->num_inputs;
+        const uint8_t *prev = t == 0 ? NULL
+                            : enc->data + (size_t)(t - 1 < enc->num_frames ? t - 1 : enc->num_frames - 1) * enc->num_inputs;
+        uint8_t *row = rows + (size_t)k * stride;
+        for (int i = 0; i < enc->num_inputs; i++) {
+            if ((int)cur[i] - (prev ? (int)prev[i] : 0) >= ENCODER_DELTA_THRESH) {
+                SET_BIT(row, i, 1);
+            }
+        }
+    }
+}
+
+static const encoder_fill_fn encoder_fills[ENCODER_COUNT] = {fill_rate, fill_latency, fill_delta};
+static const char *encoder_names[ENCODER_COUNT] = {"rate", "latency", "delta"};
+
+void encoder_init(Spike_Encoder *enc, Encoder_Kind kind, int num_inputs, int time_window, uint64_t seed) {
+    memset(enc, 0, sizeof(*enc));
+    enc->kind = kind;
+    enc->fill = encoder_fills[kind];
+    enc->num_inputs = num_inputs;
+    enc->time_window = time_window;
+    enc->seed = seed;
+}
+
+void encoder_begin(Spike_Encoder *enc, const uint8_t *data, int num_frames, uint64_t stream) {
+    enc->data = data;
+    enc->num_frames = num_frames < 1 ? 1 : num_frames;
+    enc->step = 0;
+    if (enc->kind == ENCODER_RATE) {
+        rate_rng_seed(&enc->rng, enc->seed, stream);
+    }
+}
+
+void encoder_next_chunk(Spike_Encoder *enc, uint8_t *rows, int steps, int stride) {
+    enc->fill(enc, rows, steps, stride);
+    enc->step += steps;
+}
+
+void source_begin(const Spike_Source *src, Spike_Encoder *enc, int sample) {
+    *enc = src->encoder;
+    encoder_begin(enc, src->data + (size_t)sample * src->sample_stride, src->num_frames, (uint64_t)sample);
+}
+
+const char *encoder_name(Encoder_Kind kind) {
+    if (kind < 0 || kind >= ENCODER_COUNT) {
+        return "unknown";
+    }
+    return encoder_names[kind];
+}
+
+int encoder_parse(const char *name, Encoder_Kind *kind) {
+    for (int k = 0; k < ENCODER_COUNT; k++) {
+        if (strcmp(name, encoder_names[k]) == 0) {
+            *kind = (Encoder_Kind)k;
+            return 0;
         }
     }
+    return 1;
 }
\ No newline at end of file
@@ -1,8 +1,77 @@
 #ifndef RATE_ENCODING_H
 #define RATE_ENCODING_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "define.h"
+
+// Eight interleaved xoshiro256++ generators, s[word][lane]. Every SIMD width
+// steps the same lanes, so a seed gives the same spikes on every kernel.
+#define RATE_RNG_LANES 8
+typedef struct {
+    uint64_t s[4][RATE_RNG_LANES];
+} __attribute__((aligned(64))) Rate_Rng;
+
 void rate_encoding(float *data, int data_size, int time_window, int max_rate, unsigned char **spike_trains);
 void print_spike_trains(unsigned char **spike_trains, int data_size, int time_window);
 int bernoulli_trial(float p);
+// Reference Bernoulli encoder on rand(): one sample into [time_window][spike_bytes] packed bits
+void rate_encode_sample(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes, int spike_bytes);
 void rate_encoding_3d(const uint8_t data[INPUT_SIZE], int dim1, int dim2, int dim3, uint8_t spikes[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES]);
+
+// Independent stream per (seed, stream) pair, e.g. stream = sample index, so
+// samples encode reproducibly regardless of thread or order
+void rate_rng_seed(Rate_Rng *rng, uint64_t seed, uint64_t stream);
+// Vectorized Bernoulli encoder: pixel p spikes when an 8-bit random draw is
+// below p (probability p/256, and always for p = 255). Writes whole packed
+// rows of [time_window][spike_bytes], bits past num_inputs cleared.
+void rate_encode_sample_rng(const uint8_t *data, int num_inputs, int time_window, uint8_t *spikes,
+                            int spike_bytes, Rate_Rng *rng);
+
+// Streaming spike generators: produce the next few time steps of a sample
+// on demand, straight into a packed [steps][stride] buffer (typically the
+// layer-0 ping buffer), so a full [time_window] tensor never exists.
+typedef enum {
+    ENCODER_RATE = 0,   // Bernoulli rate code, same spikes as rate_encode_sample_rng
+    ENCODER_LATENCY,    // one spike per pixel, brighter pixels earlier, 0 never
+    ENCODER_DELTA,      // spike when a pixel rises by ENCODER_DELTA_THRESH since the last frame
+    ENCODER_COUNT
+} Encoder_Kind;
+
+typedef struct Spike_Encoder Spike_Encoder;
+typedef void (*encoder_fill_fn)(Spike_Encoder *enc, uint8_t *rows, int steps, int stride);
+
+struct Spike_Encoder {
+    Rate_Rng rng;
+    encoder_fill_fn fill;   // generator, replaceable by callers
+    Encoder_Kind kind;
+    int num_inputs;
+    int time_window;        // latency code spreads first spikes over this window
+    uint64_t seed;
+    const uint8_t *data;    // [num_frames][num_inputs] pixels of the current sample
+    int num_frames;         // frame for step t is min(t, num_frames - 1)
+    int step;               // next time step to generate
+};
+
+void encoder_init(Spike_Encoder *enc, Encoder_Kind kind, int num_inputs, int time_window, uint64_t seed);
+// Starts a sample; stream selects its rate-code random stream (e.g. sample index)
+void encoder_begin(Spike_Encoder *enc, const uint8_t *data, int num_frames, uint64_t stream);
+// Writes the next steps rows of stride bytes, bits past num_inputs cleared
+void encoder_next_chunk(Spike_Encoder *enc, uint8_t *rows, int steps, int stride);
+
+// Samples for the engines that start each one themselves (batch, pool,
+// pipeline): sample d is the num_frames frames at data + d * sample_stride,
+// encoded on stream d by a copy of encoder. A stride of 0 repeats one sample.
+typedef struct {
+    Spike_Encoder encoder;  // kind, sizes, seed and fill; never advanced
+    const uint8_t *data;
+    size_t sample_stride;
+    int num_frames;
+} Spike_Source;
+
+// Copies the source's encoder into enc and starts sample d on it
+void source_begin(const Spike_Source *src, Spike_Encoder *enc, int sample);
+const char *encoder_name(Encoder_Kind kind);
+// Returns 0 and sets kind if name is "rate", "latency" or "delta"
+int encoder_parse(const char *name, Encoder_Kind *kind);
 #endif // RATE_ENCODING_H
\ No newline at end of file
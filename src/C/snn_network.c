@@ -1,202 +1,2105 @@
 #include <stdint.h>
 #include "dsp_helper.h"
 #include "snn_network.h"
+#include "snn_stats.h"
 #include "define.h"
+#include <math.h>
 #include <stdlib.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SNN_HAVE_X86 1
+#else
+#define SNN_HAVE_X86 0
+#endif
+
 extern Snn_Network snn_network;
 
-static Layer static_layers[MAX_LAYERS];
-static Neuron static_neurons[MAX_LAYERS][MAX_NEURONS];
+// Loop bounds and strides. A fixed-topology build folds them to the define.h
+// constants so the hot loops keep compile-time trip counts; net is still
+// evaluated so helpers that only take it for sizes stay warning-free.
+#define FIXED_SPIKE_BYTES ((MAX_NEURONS + 7) / 8)
+
+#if (SNN_FIXED_TOPOLOGY)
+#define NET_TAU(net)          ((void)(net), TAU)
+#define NET_SPIKE_BYTES(net)  ((void)(net), FIXED_SPIKE_BYTES)
+#define NET_SUM_STRIDE(net)   ((void)(net), MAX_NEURONS)
+#else
+#define NET_TAU(net)          ((net)->tau)
+#define NET_SPIKE_BYTES(net)  ((net)->spike_bytes)
+#define NET_SUM_STRIDE(net)   ((net)->max_neurons)
+#endif
+
+// Every layer's neuron arrays start on a 64-byte line and are padded to a
+// whole number of lines, so SIMD kernels load full vectors without tails
+#define NEURON_ALIGN 16
+#define ALIGN_NEURONS(n) (((n) + NEURON_ALIGN - 1) & ~(NEURON_ALIGN - 1))
+// Weight tiles pad each layer to whole tiles of Q7_TILE_NEURONS neurons
+#define ALIGN_TILE_NEURONS(n) (((n) + Q7_TILE_NEURONS - 1) / Q7_TILE_NEURONS * Q7_TILE_NEURONS)
+
+#define SPIKE_ROW(buf, t, stride) ((buf) + (size_t)(t) * (stride))
+#define SUM_ROW(net, sums, t)     ((sums) + (size_t)(t) * NET_SUM_STRIDE(net))
+// Index lists get a padded row per step so kernels may store whole vectors
+#define EVENT_STRIDE(net)         ALIGN_NEURONS(NET_SUM_STRIDE(net))
+#define EVENT_ROW(net, ev, t)     ((ev)->index + (size_t)(t) * EVENT_STRIDE(net))
+
+// Bump allocator over one 64-byte aligned block. Every buffer is rounded up to
+// whole lines so the next one starts on a line too. A NULL base only counts.
+typedef struct {
+    uint8_t *base;
+    size_t used;
+} Snn_Arena;
+
+static void *arena_take(Snn_Arena *arena, size_t bytes, size_t *tally) {
+    size_t at = arena->used;
+    size_t size = (bytes + 63) & ~(size_t)63;
+    arena->used += size;
+    if (tally) {
+        *tally += size;
+    }
+    return arena->base ? arena->base + at : NULL;
+}
+
+#if (SNN_FIXED_TOPOLOGY)
+static Layer static_layers[MAX_LAYERS];
+static sum_t static_membrane[MAX_LAYERS * ALIGN_NEURONS(MAX_NEURONS)] __attribute__((aligned(64)));
+static sum_t static_voltage_thresh[MAX_LAYERS * ALIGN_NEURONS(MAX_NEURONS)] __attribute__((aligned(64)));
+static sum_t static_decay_rate[MAX_LAYERS * ALIGN_NEURONS(MAX_NEURONS)] __attribute__((aligned(64)));
+// Int8 weight tiles of the widest topology the build accepts
+static int8_t static_weight_tiles[(MAX_LAYERS - 1) * MAX_NEURONS
+                                  * ALIGN_TILE_NEURONS(MAX_NEURONS)] __attribute__((aligned(64)));
+
+// Backing storage for the two ping-pong buffers:
+// Each step has FIXED_SPIKE_BYTES bytes, one bit per neuron of the widest layer
+static uint8_t ping_pong_buffer_storage_1[TAU][FIXED_SPIKE_BYTES] = {0};
+static uint8_t ping_pong_buffer_storage_2[TAU][FIXED_SPIKE_BYTES] = {0};
+
+// Per-step synaptic input for one chunk, filled before any neuron is touched
+static sum_t static_sums[TAU * MAX_NEURONS] __attribute__((aligned(64)));
+static int32_t static_chunk_sums[MAX_NEURONS] __attribute__((aligned(64)));
+static uint16_t static_active[MAX_NEURONS];
+static int static_firing_counts[MAX_NEURONS * (TIME_WINDOW / TAU)];
+static int *static_firing_rows[MAX_NEURONS];
+static uint16_t static_event_index[2][TAU * ALIGN_NEURONS(MAX_NEURONS)] __attribute__((aligned(64)));
+static int static_event_count[2][TAU];
+static int static_layer_spikes[MAX_LAYERS];
+#endif
+
+// Int8 weights of input j from neuron first up to the end of its tile: tile
+// k holds neurons k * Q7_TILE_NEURONS onwards of every input, one 64-byte
+// line per input, zero past the last neuron
+static inline const int8_t *weight_line(const Layer *layer, int j, int first) {
+    return layer->weights_tiled + ((size_t)(first / Q7_TILE_NEURONS) * layer->input_size + j) * Q7_TILE_NEURONS
+           + first % Q7_TILE_NEURONS;
+}
+
+// Neurons left in the tile holding neuron first, capped at width
+static inline int line_width(int first, int width) {
+    int left = Q7_TILE_NEURONS - first % Q7_TILE_NEURONS;
+    return width < left ? width : left;
+}
+
+// sums[0..width) += neurons first..first + width - 1 of Q0.7 weight row j, in
+// the layer's storage format. first is a multiple of 32 so packed rows split
+// on whole int4 groups and ternary bytes, and int8 rows are read one tile line
+// at a time.
+_Static_assert(BATCH_TILE_NEURONS % 32 == 0, "batch tiles must start on a packed weight group");
+_Static_assert(Q7_TILE_NEURONS % BATCH_TILE_NEURONS == 0, "batch tiles must not straddle weight tiles");
+static inline void add_weight_segment(const Layer *layer, int j, int first, int width, sum_t *sums) {
+    if (layer->weight_format == WEIGHTS_INT4) {
+        const uint8_t *row = layer->weights_packed + (size_t)j * layer->packed_stride;
+        q4_add_to_q31_kernel(row + first / 2, layer->weight_lut, sums, width);
+    } else if (layer->weight_format == WEIGHTS_TERNARY) {
+        const uint8_t *row = layer->weights_packed + (size_t)j * layer->packed_stride;
+        const uint8_t *neg = row + layer->packed_stride / 2;
+        ternary_add_to_q31_kernel(row + first / 8, neg + first / 8, layer->weight_lut[1], sums, width);
+    } else {
+        for (int done = 0; done < width;) {
+            int n = line_width(first + done, width - done);
+            q7_add_to_q31_kernel(weight_line(layer, j, first + done), sums + done, n);
+            done += n;
+        }
+    }
+}
+
+// sums += weight row j, in the layer's precision and sum width. int16 sums
+// fill the first half of each row, so the row layout is the same for both.
+static inline void add_weight_row(const Layer *layer, int j, sum_t *sums) {
+    if (layer->precision == PRECISION_FLOAT32) {
+        float_add_to_float_kernel(layer->weights_f32 + (size_t)j * layer->f32_stride, (float *)sums,
+                                  layer->num_neurons);
+    } else if (layer->sum_width == SUMS_INT16) {
+        for (int first = 0; first < layer->num_neurons; first += Q7_TILE_NEURONS) {
+            q7_add_to_q15_kernel(weight_line(layer, j, first), (int16_t *)sums + first,
+                                 line_width(first, layer->num_neurons - first));
+        }
+    } else {
+        add_weight_segment(layer, j, 0, layer->num_neurons, sums);
+    }
+}
+
+// Original traversal: rescan the input bitmask for every step and add the
+// row of each active presynaptic neuron into that step's sums.
+static void accumulate_step_major(const Snn_Network *net, const uint8_t *input,
+                                  sum_t *sums_base, const Layer *layer) {
+    int input_size = layer->input_size;
+    int num_bytes = (input_size + 7) / 8;
+    int stride = NET_SPIKE_BYTES(net);
+
+    for (int t = 0; t < NET_TAU(net); t++) {
+        const uint8_t *row = SPIKE_ROW(input, t, stride);
+        sum_t *sums = SUM_ROW(net, sums_base, t);
+
+        for (int byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
+            uint8_t byte = row[byte_idx];
+            int base_idx = byte_idx * 8;
+
+            while (byte) {
+                int bit = __builtin_ctz(byte);
+                int j = base_idx + bit;
+                if (j < input_size) {
+                    add_weight_row(layer, j, sums);
+                }
+                byte &= byte - 1;  // Clear least significant set bit
+            }
+        }
+    }
+}
+
+// Transposed traversal: walk each presynaptic neuron once per chunk, gather
+// its TAU-bit spike mask and add its row into every step it fired in while
+// the row is still hot in L1.
+static void accumulate_row_reuse(const Snn_Network *net, const uint8_t *input,
+                                 sum_t *sums_base, const Layer *layer) {
+    int input_size = layer->input_size;
+    int num_bytes = (input_size + 7) / 8;
+    int stride = NET_SPIKE_BYTES(net);
+    int tau = NET_TAU(net);
+
+    for (int byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
+        uint8_t any = 0;
+        for (int t = 0; t < tau; t++) {
+            any |= SPIKE_ROW(input, t, stride)[byte_idx];
+        }
+        int base_idx = byte_idx * 8;
+
+        while (any) {
+            int bit = __builtin_ctz(any);
+            int j = base_idx + bit;
+            if (j < input_size) {
+                for (int t = 0; t < tau; t++) {
+                    if ((SPIKE_ROW(input, t, stride)[byte_idx] >> bit) & 1) {
+                        add_weight_row(layer, j, SUM_ROW(net, sums_base, t));
+                    }
+                }
+            }
+            any &= any - 1;  // Clear least significant set bit
+        }
+    }
+}
+
+// Address-event traversal: the producer already listed who fired in each
+// step, so only active neurons are visited and no bitmask is scanned.
+static void accumulate_events(const Snn_Network *net, const Spike_Events *events,
+                              sum_t *sums_base, const Layer *layer) {
+    for (int t = 0; t < NET_TAU(net); t++) {
+        const uint16_t *index = EVENT_ROW(net, events, t);
+        sum_t *sums = SUM_ROW(net, sums_base, t);
+
+        for (int k = 0; k < events->count[t]; k++) {
+            add_weight_row(layer, index[k], sums);
+        }
+    }
+}
+
+// Lists the set bits of one step's spike row below input_size into active
+static inline int list_active_inputs(const uint8_t *row, int input_size, uint16_t *active) {
+    int num_bytes = (input_size + 7) / 8;
+    int count = 0;
+    for (int byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
+        uint8_t byte = row[byte_idx];
+        while (byte) {
+            int j = byte_idx * 8 + __builtin_ctz(byte);
+            if (j < input_size) {
+                active[count++] = (uint16_t)j;
+            }
+            byte &= byte - 1;  // Clear least significant set bit
+        }
+    }
+    return count;
+}
+
+// sums[first..first + width) += the listed rows of one tile. Packed int4 and
+// ternary layers gather their rows in place: a tile's neurons are a 32-byte
+// slice of an int4 row and an 8-byte slice of each ternary plane, so their
+// rows are short enough without being tiled.
+static inline void gather_tile(const Layer *layer, int first, int width, const uint16_t *rows, int count,
+                               sum_t *sums) {
+    if (layer->weight_format == WEIGHTS_INT4) {
+        q4_gather_add_to_q31_kernel(layer->weights_packed + first / 2, layer->packed_stride, rows, count,
+                                    layer->weight_lut, sums + first, width);
+    } else if (layer->weight_format == WEIGHTS_TERNARY) {
+        const uint8_t *pos = layer->weights_packed + first / 8;
+        ternary_gather_add_to_q31_kernel(pos, pos + layer->packed_stride / 2, layer->packed_stride, rows,
+                                         count, layer->weight_lut[1], sums + first, width);
+    } else {
+        const int8_t *tile = weight_line(layer, 0, first);
+        if (layer->sum_width == SUMS_INT16) {
+            q7_gather_add_to_q15_kernel(tile, rows, count, (int16_t *)sums + first, width);
+        } else {
+            q7_gather_add_to_q31_kernel(tile, rows, count, sums + first, width);
+        }
+    }
+}
+
+// Output-stationary traversal: for each step, every tile of Q7_TILE_NEURONS
+// sums is loaded into registers once and the rows of the step's active inputs
+// stream through it from the layer's contiguous weight tile. The producer's
+// index lists are used when it wrote them, else the set bits are listed once
+// per step into active, which holds one entry per input.
+static void accumulate_tiled(const Snn_Network *net, const uint8_t *input, const Spike_Events *events,
+                             uint16_t *active, sum_t *sums_base, const Layer *layer) {
+    for (int t = 0; t < NET_TAU(net); t++) {
+        const uint16_t *rows = active;
+        int count = 0;
+        if (events) {
+            rows = EVENT_ROW(net, events, t);
+            count = events->count[t];
+        } else {
+            count = list_active_inputs(SPIKE_ROW(input, t, NET_SPIKE_BYTES(net)), layer->input_size, active);
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        sum_t *sums = SUM_ROW(net, sums_base, t);
+        for (int first = 0; first < layer->num_neurons; first += Q7_TILE_NEURONS) {
+            int width = layer->num_neurons - first;
+            if (width > Q7_TILE_NEURONS) {
+                width = Q7_TILE_NEURONS;
+            }
+            gather_tile(layer, first, width, rows, count, sums);
+        }
+    }
+}
+
+// Active input indices are listed as uint16
+static inline int tiles_fit(int input_size) {
+    return input_size <= UINT16_MAX + 1;
+}
+
+// TRAVERSE_TILED Q0.7 layers gather tiles when their inputs fit the uint16
+// row lists. Int8 layers read their weight tiles, packed layers their own rows.
+static inline int uses_tiles(const Layer *layer) {
+    return layer->traversal == TRAVERSE_TILED && layer->precision == PRECISION_Q07
+           && tiles_fit(layer->input_size);
+}
+
+#if (IF) && !(LIF)
+static uint32_t chunk_spike_mask(const Snn_Network *net, const uint8_t *input, int byte_idx, int bit) {
+    uint32_t mask = 0;
+    for (int t = 0; t < NET_TAU(net); t++) {
+        mask |= (uint32_t)((SPIKE_ROW(input, t, NET_SPIKE_BYTES(net))[byte_idx] >> bit) & 1) << t;
+    }
+    return mask;
+}
+
+// Spikes of the input rows that are real neurons, over the whole chunk
+static int chunk_input_spikes(const Snn_Network *net, const uint8_t *input, int input_size) {
+    int full_bytes = input_size / 8;
+    uint8_t tail = (uint8_t)((1u << (input_size % 8)) - 1);
+    int spikes = 0;
+    for (int t = 0; t < NET_TAU(net); t++) {
+        const uint8_t *row = SPIKE_ROW(input, t, NET_SPIKE_BYTES(net));
+        for (int byte_idx = 0; byte_idx < full_bytes; byte_idx++) {
+            spikes += __builtin_popcount(row[byte_idx]);
+        }
+        if (tail) {
+            spikes += __builtin_popcount(row[full_bytes] & tail);
+        }
+    }
+    return spikes;
+}
+
+// An IF neuron fires in a step only if its membrane has already reached the
+// threshold, and without leak it never rises above its chunk start plus every
+// positive input it could get: tau positive biases and, per input spike, the
+// layer's largest weight. When that stays below every threshold the chunk
+// fires nothing, and each membrane ends at start + total input whatever steps
+// the input came in.
+static int chunk_is_quiet(const Snn_Network *net, const sum_t *membrane, int input_spikes, const Layer *layer) {
+    const sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+    int64_t synaptic = (int64_t)input_spikes * (layer->max_weight > 0 ? layer->max_weight : 0);
+    for (int i = 0; i < layer->num_neurons; i++) {
+        int64_t bias = layer->bias[i] > 0 ? layer->bias[i] : 0;
+        if (membrane[i] + NET_TAU(net) * bias + synaptic >= thresh[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Without decay the chunk input of an IF layer is sum_j(count_j * W[j]): one
+// count-weighted row pass per active input instead of one row per spike. The
+// total is spread evenly over the TAU steps. IF_POPCOUNT_EXACT only takes a
+// chunk chunk_is_quiet() proves silent, where the spread changes nothing.
+// Returns 1 if sums[] was filled, 0 if the caller must fall back to the traversal.
+static int accumulate_popcount(const Snn_Network *net, const uint8_t *input, const sum_t *membrane,
+                               sum_t *sums_base, int32_t *chunk_sums, const Layer *layer) {
+    int input_size = layer->input_size;
+    int num_bytes = (input_size + 7) / 8;
+    int num_neurons = layer->num_neurons;
+    int stride = NET_SPIKE_BYTES(net);
+    int tau = NET_TAU(net);
+
+    // Checked before any row is touched, so a chunk that fires costs one
+    // popcount of its input and one pass over the membranes
+    if (layer->popcount_mode == IF_POPCOUNT_EXACT
+        && !chunk_is_quiet(net, membrane, chunk_input_spikes(net, input, input_size), layer)) {
+        return 0;
+    }
+
+    memset(chunk_sums, 0, num_neurons * sizeof(int32_t));
+    for (int byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
+        uint8_t any = 0;
+        for (int t = 0; t < tau; t++) {
+            any |= SPIKE_ROW(input, t, stride)[byte_idx];
+        }
+        while (any) {
+            int bit = __builtin_ctz(any);
+            int j = byte_idx * 8 + bit;
+            if (j < input_size) {
+                if (layer->weight_format == WEIGHTS_INT8) {
+                    int count = __builtin_popcount(chunk_spike_mask(net, input, byte_idx, bit));
+                    for (int first = 0; first < num_neurons; first += Q7_TILE_NEURONS) {
+                        q7_scale_add_to_q31_kernel(weight_line(layer, j, first), count, chunk_sums + first,
+                                                   line_width(first, num_neurons - first));
+                    }
+                } else {
+                    // Packed rows have no scaled kernel; count is at most TAU
+                    int count = __builtin_popcount(chunk_spike_mask(net, input, byte_idx, bit));
+                    for (int c = 0; c < count; c++) {
+                        add_weight_segment(layer, j, 0, num_neurons, chunk_sums);
+                    }
+                }
+            }
+            any &= any - 1;
+        }
+    }
+
+    // floor(total / TAU) on every step, remainder on the first steps. A share
+    // is at most sum_j |W[j][i]|, so int16 rows stay within the sum bound.
+    for (int i = 0; i < num_neurons; i++) {
+        int32_t total = chunk_sums[i];
+        int32_t share = total / tau;
+        int32_t rem = total - share * tau;
+        if (rem < 0) {
+            share -= 1;
+            rem += tau;
+        }
+        for (int t = 0; t < tau; t++) {
+            if (layer->sum_width == SUMS_INT16) {
+                int16_t *row = (int16_t *)SUM_ROW(net, sums_base, t);
+                int32_t v = row[i] + share + (t < rem);
+                row[i] = (int16_t)(v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v);
+            } else {
+                SUM_ROW(net, sums_base, t)[i] += share + (t < rem);
+            }
+        }
+    }
+    return 1;
+}
+#endif
+
+// Every step of a hidden/output layer starts from the bias
+static void accumulate_bias(const Snn_Network *net, sum_t *sums_base, const Layer *layer) {
+    sum_t *first = SUM_ROW(net, sums_base, 0);
+    size_t row_bytes = layer->num_neurons * sizeof(sum_t);
+    if (layer->precision == PRECISION_FLOAT32) {
+        memcpy(first, layer->bias_f32, layer->num_neurons * sizeof(float));
+    } else if (layer->sum_width == SUMS_INT16) {
+        int16_t *first16 = (int16_t *)first;
+        for (int i = 0; i < layer->num_neurons; i++) {
+            first16[i] = layer->bias[i];
+        }
+        row_bytes = layer->num_neurons * sizeof(int16_t);
+    } else {
+        memset(first, 0, layer->num_neurons * sizeof(sum_t));
+        q7_add_to_q31_kernel(
+            layer->bias,
+            first,
+            layer->num_neurons
+        );
+    }
+    for (int t = 1; t < NET_TAU(net); t++) {
+        memcpy(SUM_ROW(net, sums_base, t), first, row_bytes);
+    }
+}
+
+// Input layer: spike from self (i-th input neuron only)
+// This is a bit of a hack, but it works for the input layer
+// and is a bit faster than the alternative of using a separate
+// function to handle the input layer.
+static void accumulate_input_layer(const Snn_Network *net, const uint8_t *input,
+                                   sum_t *sums_base, const Layer *layer) {
+    for (int t = 0; t < NET_TAU(net); t++) {
+        const uint8_t *row = SPIKE_ROW(input, t, NET_SPIKE_BYTES(net));
+        sum_t *sums = SUM_ROW(net, sums_base, t);
+        if (layer->precision == PRECISION_FLOAT32) {
+            float *sums_f32 = (float *)sums;
+            for (int i = 0; i < layer->num_neurons; i++) {
+                sums_f32[i] = GET_BIT(row, i) ? 1.0f : 0.0f;
+            }
+            continue;
+        }
+        for (int i = 0; i < layer->num_neurons; i++) {
+            sums[i] = GET_BIT(row, i) ? (1 << DECAY_SHIFT) : 0;  // Q0.7 equivalent of +1
+        }
+    }
+}
+
+// Appends neuron base + i for every set bit i of mask to one step's index list
+static inline void append_events(uint16_t *index, int *count, int base, unsigned mask) {
+    int c = *count;
+    while (mask) {
+        index[c++] = (uint16_t)(base + __builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+    *count = c;
+}
+
+// Fused neuron update for one layer and chunk. Input is either the finished
+// sums ([tau][sum stride]) or, for the input layer, spike bits that each add
+// Q0.7 +1 to their own neuron. Neurons are independent once their input is
+// known, so each block runs all TAU steps with its membranes in registers:
+// decay, add input, compare with the threshold, subtract the reset and store
+// the spike mask as packed bytes. With events, the firing neurons are also
+// appended to each step's index list. Returns the number of spikes.
+static int fire_layer_scalar(const Snn_Network *net, const sum_t *sums_base, const uint8_t *input,
+                             sum_t *membrane, uint8_t *output, const Layer *layer, Spike_Events *events) {
+    const sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+    const sum_t *decay = net->decay_rate + layer->neuron_offset;
+    int stride = NET_SPIKE_BYTES(net);
+    int sums16_in = layer->sum_width == SUMS_INT16;
+    int spikes = 0;
+    (void)decay;
+
+    for (int i = 0; i < layer->num_neurons; i += 8) {
+        int count = (layer->num_neurons - i < 8) ? layer->num_neurons - i : 8;
+        for (int t = 0; t < NET_TAU(net); t++) {
+            const sum_t *sums = sums_base ? SUM_ROW(net, sums_base, t) + i : NULL;
+            const int16_t *sums16 = sums_base ? (const int16_t *)SUM_ROW(net, sums_base, t) + i : NULL;
+            uint8_t in = input ? SPIKE_ROW(input, t, stride)[i >> 3] : 0;
+            uint8_t out = 0;
+            for (int k = 0; k < count; k++) {
+                int n = i + k;
+                int32_t sum = !sums ? ((in >> k) & 1) << DECAY_SHIFT : sums16_in ? sums16[k] : sums[k];
+                int reset_signal = HEAVISIDE(membrane[n], thresh[n]);
+#if (LIF)
+                membrane[n] = ((decay[n] * membrane[n]) >> DECAY_SHIFT) + sum - reset_signal * thresh[n];
+#else
+                membrane[n] = membrane[n] + sum - reset_signal * thresh[n];
+#endif
+                out |= (uint8_t)(reset_signal << k);
+            }
+            SPIKE_ROW(output, t, stride)[i >> 3] = out;
+            spikes += __builtin_popcount(out);
+            if (events) {
+                append_events(EVENT_ROW(net, events, t), &events->count[t], i, out);
+            }
+        }
+    }
+    return spikes;
+}
+
+#if SNN_HAVE_X86
+__attribute__((target("avx2")))
+static int fire_layer_avx2(const Snn_Network *net, const sum_t *sums_base, const uint8_t *input,
+                           sum_t *membrane, uint8_t *output, const Layer *layer, Spike_Events *events) {
+    const sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+    const sum_t *decay = net->decay_rate + layer->neuron_offset;
+    int stride = NET_SPIKE_BYTES(net);
+    const __m256i bit_select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i one = _mm256_set1_epi32(1 << DECAY_SHIFT);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    int sums16_in = layer->sum_width == SUMS_INT16;
+    int spikes = 0;
+    (void)decay;
+
+    // Layers start 64-byte aligned and padded, so the state loads never run off
+    for (int i = 0; i < layer->num_neurons; i += 8) {
+        int count = (layer->num_neurons - i < 8) ? layer->num_neurons - i : 8;
+        __m256i tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lane);
+        // int16 sums: 8 lanes are (count + 1) / 2 dwords, widened and masked
+        __m128i tail16 = _mm256_castsi256_si128(_mm256_cmpgt_epi32(_mm256_set1_epi32((count + 1) / 2), lane));
+        uint8_t valid = (uint8_t)((1u << count) - 1);
+        __m256i vm = _mm256_load_si256((const __m256i *)(membrane + i));
+        __m256i vt = _mm256_load_si256((const __m256i *)(thresh + i));
+#if (LIF)
+        __m256i vd = _mm256_load_si256((const __m256i *)(decay + i));
+#endif
+
+        for (int t = 0; t < NET_TAU(net); t++) {
+            __m256i sum;
+            if (sums_base && sums16_in) {
+                const int16_t *row = (const int16_t *)SUM_ROW(net, sums_base, t) + i;
+                sum = _mm256_cvtepi16_epi32(_mm_maskload_epi32((const int *)row, tail16));
+                sum = _mm256_and_si256(sum, tail);
+            } else if (sums_base) {
+                sum = _mm256_maskload_epi32(SUM_ROW(net, sums_base, t) + i, tail);
+            } else {
+                __m256i in = _mm256_set1_epi32(SPIKE_ROW(input, t, stride)[i >> 3]);
+                sum = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(in, bit_select), bit_select), one);
+                sum = _mm256_and_si256(sum, tail);
+            }
+            __m256i fire = _mm256_xor_si256(_mm256_cmpgt_epi32(vt, vm), ones);
+#if (LIF)
+            __m256i next = _mm256_srai_epi32(_mm256_mullo_epi32(vd, vm), DECAY_SHIFT);
+#else
+            __m256i next = vm;
+#endif
+            vm = _mm256_sub_epi32(_mm256_add_epi32(next, sum), _mm256_and_si256(fire, vt));
+            uint8_t out = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(fire)) & valid;
+            SPIKE_ROW(output, t, stride)[i >> 3] = out;
+            spikes += __builtin_popcount(out);
+            if (events) {
+                append_events(EVENT_ROW(net, events, t), &events->count[t], i, out);
+            }
+        }
+        _mm256_store_si256((__m256i *)(membrane + i), vm);
+    }
+    return spikes;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static int fire_layer_avx512(const Snn_Network *net, const sum_t *sums_base, const uint8_t *input,
+                             sum_t *membrane, uint8_t *output, const Layer *layer, Spike_Events *events) {
+    const sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+    const sum_t *decay = net->decay_rate + layer->neuron_offset;
+    int stride = NET_SPIKE_BYTES(net);
+    const __m512i one = _mm512_set1_epi32(1 << DECAY_SHIFT);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    int sums16_in = layer->sum_width == SUMS_INT16;
+    int spikes = 0;
+    (void)decay;
+
+    for (int i = 0; i < layer->num_neurons; i += 16) {
+        int count = (layer->num_neurons - i < 16) ? layer->num_neurons - i : 16;
+        __mmask16 valid = (__mmask16)((1u << count) - 1);
+        __mmask16 bytes = (__mmask16)((1u << ((count + 7) / 8)) - 1);
+        __m512i index = _mm512_add_epi32(_mm512_set1_epi32(i), lane);
+        __m512i vm = _mm512_load_si512(membrane + i);
+        __m512i vt = _mm512_load_si512(thresh + i);
+#if (LIF)
+        __m512i vd = _mm512_load_si512(decay + i);
+#endif
+
+        for (int t = 0; t < NET_TAU(net); t++) {
+            __mmask16 fire = _mm512_cmpge_epi32_mask(vm, vt) & valid;
+#if (LIF)
+            __m512i next = _mm512_srai_epi32(_mm512_mullo_epi32(vd, vm), DECAY_SHIFT);
+#else
+            __m512i next = vm;
+#endif
+            if (sums_base && sums16_in) {
+                const int16_t *row = (const int16_t *)SUM_ROW(net, sums_base, t) + i;
+                next = _mm512_add_epi32(next, _mm512_cvtepi16_epi32(_mm256_maskz_loadu_epi16(valid, row)));
+            } else if (sums_base) {
+                next = _mm512_add_epi32(next, _mm512_maskz_loadu_epi32(valid, SUM_ROW(net, sums_base, t) + i));
+            } else {
+                __m128i in = _mm_maskz_loadu_epi8(bytes, SPIKE_ROW(input, t, stride) + (i >> 3));
+                next = _mm512_mask_add_epi32(next, (__mmask16)_mm_cvtsi128_si32(in) & valid, next, one);
+            }
+            vm = _mm512_mask_sub_epi32(next, fire, next, vt);
+            _mm_mask_storeu_epi8(SPIKE_ROW(output, t, stride) + (i >> 3), bytes, _mm_cvtsi32_si128(fire));
+            spikes += __builtin_popcount(fire);
+            if (events) {
+                // Compress the firing lanes to the front and store all 16; the
+                // row is padded, and the next append overwrites the excess
+                int *c = &events->count[t];
+                __m256i packed = _mm512_cvtepi32_epi16(_mm512_maskz_compress_epi32(fire, index));
+                _mm256_storeu_si256((__m256i *)(EVENT_ROW(net, events, t) + *c), packed);
+                *c += __builtin_popcount(fire);
+            }
+        }
+        _mm512_store_si512(membrane + i, vm);
+    }
+    return spikes;
+}
+#endif
+
+// Float32 counterpart of the fused update, for PRECISION_FLOAT32 layers (the
+// input layer's +1.0 per spike arrives through sums). The LIF leak is one
+// fused multiply-add and the reset a conditional subtract, so the scalar and
+// SIMD variants round identically.
+static int fire_layer_f32_scalar(const Snn_Network *net, const sum_t *sums_base, sum_t *membrane,
+                                 uint8_t *output, const Layer *layer, Spike_Events *events) {
+    const float *thresh = (const float *)(net->voltage_thresh + layer->neuron_offset);
+    const float *decay = (const float *)(net->decay_rate + layer->neuron_offset);
+    float *mem = (float *)membrane;
+    int stride = NET_SPIKE_BYTES(net);
+    int spikes = 0;
+    (void)decay;
+
+    for (int i = 0; i < layer->num_neurons; i += 8) {
+        int count = (layer->num_neurons - i < 8) ? layer->num_neurons - i : 8;
+        for (int t = 0; t < NET_TAU(net); t++) {
+            const float *sums = (const float *)SUM_ROW(net, sums_base, t) + i;
+            uint8_t out = 0;
+            for (int k = 0; k < count; k++) {
+                int n = i + k;
+                int reset_signal = HEAVISIDE(mem[n], thresh[n]);
+#if (LIF)
+                float next = fmaf(decay[n], mem[n], sums[k]);
+#else
+                float next = mem[n] + sums[k];
+#endif
+                mem[n] = reset_signal ? next - thresh[n] : next;
+                out |= (uint8_t)(reset_signal << k);
+            }
+            SPIKE_ROW(output, t, stride)[i >> 3] = out;
+            spikes += __builtin_popcount(out);
+            if (events) {
+                append_events(EVENT_ROW(net, events, t), &events->count[t], i, out);
+            }
+        }
+    }
+    return spikes;
+}
+
+#if SNN_HAVE_X86
+__attribute__((target("avx2,fma")))
+static int fire_layer_f32_avx2(const Snn_Network *net, const sum_t *sums_base, sum_t *membrane,
+                               uint8_t *output, const Layer *layer, Spike_Events *events) {
+    const float *thresh = (const float *)(net->voltage_thresh + layer->neuron_offset);
+    const float *decay = (const float *)(net->decay_rate + layer->neuron_offset);
+    float *mem = (float *)membrane;
+    int stride = NET_SPIKE_BYTES(net);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int spikes = 0;
+    (void)decay;
+
+    for (int i = 0; i < layer->num_neurons; i += 8) {
+        int count = (layer->num_neurons - i < 8) ? layer->num_neurons - i : 8;
+        __m256i tail = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lane);
+        uint8_t valid = (uint8_t)((1u << count) - 1);
+        __m256 vm = _mm256_load_ps(mem + i);
+        __m256 vt = _mm256_load_ps(thresh + i);
+#if (LIF)
+        __m256 vd = _mm256_load_ps(decay + i);
+#endif
+
+        for (int t = 0; t < NET_TAU(net); t++) {
+            __m256 sum = _mm256_maskload_ps((const float *)SUM_ROW(net, sums_base, t) + i, tail);
+            __m256 fire = _mm256_cmp_ps(vm, vt, _CMP_GE_OQ);
+#if (LIF)
+            __m256 next = _mm256_fmadd_ps(vd, vm, sum);
+#else
+            __m256 next = _mm256_add_ps(vm, sum);
+#endif
+            vm = _mm256_blendv_ps(next, _mm256_sub_ps(next, vt), fire);
+            uint8_t out = (uint8_t)_mm256_movemask_ps(fire) & valid;
+            SPIKE_ROW(output, t, stride)[i >> 3] = out;
+            spikes += __builtin_popcount(out);
+            if (events) {
+                append_events(EVENT_ROW(net, events, t), &events->count[t], i, out);
+            }
+        }
+        _mm256_store_ps(mem + i, vm);
+    }
+    return spikes;
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static int fire_layer_f32_avx512(const Snn_Network *net, const sum_t *sums_base, sum_t *membrane,
+                                 uint8_t *output, const Layer *layer, Spike_Events *events) {
+    const float *thresh = (const float *)(net->voltage_thresh + layer->neuron_offset);
+    const float *decay = (const float *)(net->decay_rate + layer->neuron_offset);
+    float *mem = (float *)membrane;
+    int stride = NET_SPIKE_BYTES(net);
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    int spikes = 0;
+    (void)decay;
+
+    for (int i = 0; i < layer->num_neurons; i += 16) {
+        int count = (layer->num_neurons - i < 16) ? layer->num_neurons - i : 16;
+        __mmask16 valid = (__mmask16)((1u << count) - 1);
+        __mmask16 bytes = (__mmask16)((1u << ((count + 7) / 8)) - 1);
+        __m512i index = _mm512_add_epi32(_mm512_set1_epi32(i), lane);
+        __m512 vm = _mm512_load_ps(mem + i);
+        __m512 vt = _mm512_load_ps(thresh + i);
+#if (LIF)
+        __m512 vd = _mm512_load_ps(decay + i);
+#endif
+
+        for (int t = 0; t < NET_TAU(net); t++) {
+            __mmask16 fire = _mm512_cmp_ps_mask(vm, vt, _CMP_GE_OQ) & valid;
+            __m512 sum = _mm512_maskz_loadu_ps(valid, (const float *)SUM_ROW(net, sums_base, t) + i);
+#if (LIF)
+            __m512 next = _mm512_fmadd_ps(vd, vm, sum);
+#else
+            __m512 next = _mm512_add_ps(vm, sum);
+#endif
+            vm = _mm512_mask_sub_ps(next, fire, next, vt);
+            _mm_mask_storeu_epi8(SPIKE_ROW(output, t, stride) + (i >> 3), bytes, _mm_cvtsi32_si128(fire));
+            spikes += __builtin_popcount(fire);
+            if (events) {
+                int *c = &events->count[t];
+                __m256i packed = _mm512_cvtepi32_epi16(_mm512_maskz_compress_epi32(fire, index));
+                _mm256_storeu_si256((__m256i *)(EVENT_ROW(net, events, t) + *c), packed);
+                *c += __builtin_popcount(fire);
+            }
+        }
+        _mm512_store_ps(mem + i, vm);
+    }
+    return spikes;
+}
+#endif
+
+// Float32 layers always take their input from sums
+static int fire_layer(const Snn_Network *net, const sum_t *sums_base, const uint8_t *input,
+                      sum_t *membrane, uint8_t *output, const Layer *layer, Spike_Events *events) {
+    if (layer->precision == PRECISION_FLOAT32) {
+        switch (dsp_active_kernel()) {
+#if SNN_HAVE_X86
+        case DSP_KERNEL_AVX512BW:
+            return fire_layer_f32_avx512(net, sums_base, membrane, output, layer, events);
+        case DSP_KERNEL_AVX2:
+            return fire_layer_f32_avx2(net, sums_base, membrane, output, layer, events);
+#endif
+        default:
+            return fire_layer_f32_scalar(net, sums_base, membrane, output, layer, events);
+        }
+    }
+    switch (dsp_active_kernel()) {
+#if SNN_HAVE_X86
+    case DSP_KERNEL_AVX512BW:
+        return fire_layer_avx512(net, sums_base, input, membrane, output, layer, events);
+    case DSP_KERNEL_AVX2:
+        return fire_layer_avx2(net, sums_base, input, membrane, output, layer, events);
+#endif
+    default:
+        return fire_layer_scalar(net, sums_base, input, membrane, output, layer, events);
+    }
+}
+
+// Whether a layer should also hand its output on as index lists this chunk.
+// The output layer has no consumer, and SPIKES_AUTO goes by the density the
+// layer fired at in its previous chunk.
+static int emit_events(const Snn_Network *net, const Snn_Context *ctx, const Layer *layer) {
+    if (layer->layer_num == net->num_layers - 1) {
+        return 0;
+    }
+    switch (layer->spike_mode) {
+    case SPIKES_SPARSE:
+        return 1;
+    case SPIKES_AUTO:
+        return ctx->layer_spikes[layer->layer_num] * 100
+             < SPARSE_DENSITY_PCT * layer->num_neurons * NET_TAU(net);
+    default:
+        return 0;
+    }
+}
+
+#if (SNN_STATS)
+// Counts one layer-chunk from its input and output bitmasks. Rows are one per
+// input spike, except that the IF popcount path passes each active input once.
+static void record_layer_stats(const Snn_Network *net, Snn_Stats *stats, int chunk, const Layer *layer,
+                               const uint8_t *input, const uint8_t *output, int spikes,
+                               int sparse_input, int by_popcount) {
+    int tau = NET_TAU(net);
+    int stride = NET_SPIKE_BYTES(net);
+    Snn_Layer_Stats delta = {0};
+
+    delta.chunks = 1;
+    delta.input_spikes = stats_count_spikes(input, stride, tau, layer->input_size);
+    delta.input_slots = (uint64_t)layer->input_size * tau;
+    if (layer->layer_num == 0) {
+        delta.synaptic_ops = delta.input_spikes;
+    } else {
+        delta.row_ops = by_popcount ? stats_count_active(input, stride, tau, layer->input_size)
+                                    : delta.input_spikes;
+        delta.synaptic_ops = delta.row_ops * layer->num_neurons;
+    }
+    delta.spikes = spikes;
+    delta.active_neurons = stats_count_active(output, stride, tau, layer->num_neurons);
+    delta.neuron_slots = (uint64_t)layer->num_neurons * tau;
+    delta.sparse_chunks = sparse_input;
+    stats_add(stats, layer->layer_num, chunk, &delta);
+    if (layer->layer_num == net->first_layer && chunk == 0) {
+        stats->samples++;
+    }
+}
+#endif
+
+// One layer for one chunk on a context's scratch and neuron state. in_events
+// and out_events are the index lists paired with input and output, or NULL
+// when the buffers are not the context's own (dense only).
+static void process_layer(const Snn_Network *net, Snn_Context *ctx, const uint8_t *input,
+                          uint8_t *output, const Spike_Events *in_events, Spike_Events *out_events,
+                          const Layer *layer) {
+    int N = layer->layer_num;
+    sum_t *sums = ctx->sums;
+    sum_t *membrane = ctx->membrane + layer->neuron_offset;
+    Spike_Events *emit = NULL;
+    int sparse_input = 0;
+    int by_popcount = 0;
+
+    if (out_events) {
+        out_events->valid = emit_events(net, ctx, layer);
+        if (out_events->valid) {
+            emit = out_events;
+            memset(emit->count, 0, NET_TAU(net) * sizeof(int));
+        }
+    }
+    // printf("Layer %d: num_neurons = %d, input_size = %d\n", layer->layer_num, layer->num_neurons, layer->input_size);
+
+    if (N > 0) {
+        accumulate_bias(net, sums, layer);
+
+        // Sum over presynaptic spikes
+#if (IF) && !(LIF)
+        if (layer->precision == PRECISION_Q07 && layer->popcount_mode != IF_POPCOUNT_OFF
+            && accumulate_popcount(net, input, membrane, sums, ctx->chunk_sums, layer)) {
+            by_popcount = 1;
+        } else
+#endif
+        if (uses_tiles(layer)) {
+            sparse_input = in_events && in_events->valid;
+            accumulate_tiled(net, input, sparse_input ? in_events : NULL, ctx->active, sums, layer);
+        } else if (in_events && in_events->valid) {
+            accumulate_events(net, in_events, sums, layer);
+            sparse_input = 1;
+        } else if (layer->traversal == TRAVERSE_ROW_REUSE) {
+            accumulate_row_reuse(net, input, sums, layer);
+        } else {
+            accumulate_step_major(net, input, sums, layer);
+        }
+        ctx->layer_spikes[N] = fire_layer(net, sums, NULL, membrane, output, layer, emit);
+    } else if (layer->precision == PRECISION_Q07) {
+        ctx->layer_spikes[N] = fire_layer(net, NULL, input, membrane, output, layer, emit);
+    } else {
+        accumulate_input_layer(net, input, sums, layer);
+        ctx->layer_spikes[N] = fire_layer(net, sums, NULL, membrane, output, layer, emit);
+    }
+
+#if (SNN_STATS)
+    if (ctx->stats) {
+        record_layer_stats(net, ctx->stats, ctx->chunk_index, layer, input, output, ctx->layer_spikes[N],
+                           sparse_input, by_popcount);
+    }
+#endif
+    (void)sparse_input;
+    (void)by_popcount;
+}
+
+// The network's own buffers seen as a context, for the single-threaded API
+static void network_context_view(Snn_Network *net, Snn_Context *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->net = net;
+    ctx->membrane = net->membrane;
+    ctx->ping_pong[0] = net->ping_pong[0];
+    ctx->ping_pong[1] = net->ping_pong[1];
+    ctx->sums = net->sums;
+    ctx->chunk_sums = net->chunk_sums;
+    ctx->active = net->active;
+    ctx->firing_counts = net->firing_counts;
+    ctx->firing_rows = net->firing_rows;
+    ctx->events[0] = net->events[0];
+    ctx->events[1] = net->events[1];
+    ctx->layer_spikes = net->layer_spikes;
+    ctx->stats = net->stats;
+}
+
+// The index lists that belong with one of the context's own ping-pong buffers
+static Spike_Events *paired_events(Snn_Context *ctx, const uint8_t *buffer) {
+    if (buffer == ctx->ping_pong[0]) {
+        return &ctx->events[0];
+    }
+    if (buffer == ctx->ping_pong[1]) {
+        return &ctx->events[1];
+    }
+    return NULL;
+}
+
+void context_update_layer(Snn_Context *ctx, const uint8_t *input, uint8_t *output, int layer_index) {
+    // The first layer's input comes from outside, so its lists would be stale
+    const Spike_Events *in_events = layer_index > ctx->net->first_layer ? paired_events(ctx, input) : NULL;
+    process_layer(ctx->net, ctx, input, output, in_events, paired_events(ctx, output),
+                  &ctx->net->layers[layer_index]);
+}
+
+// Function to update the entire layer based on the buffer and bias
+void update_layer(Snn_Network *net, const uint8_t *input, uint8_t *output, Layer *layer) {
+    Snn_Context view;
+    network_context_view(net, &view);
+    process_layer(net, &view, input, output, NULL, NULL, layer);
+}
+
+// int8 copy of neurons first..first + width - 1 of packed row j; first is a
+// multiple of 32 like in add_weight_segment
+static void unpack_weight_segment(const Layer *layer, int j, int first, int width, int8_t *out) {
+    const uint8_t *row = layer->weights_packed + (size_t)j * layer->packed_stride;
+    if (layer->weight_format == WEIGHTS_INT4) {
+        for (int g = 0; g < width; g += 32) {
+            // Group sizes come from the whole row, so the last group may be short
+            int size = layer->num_neurons - (first + g) < 32 ? layer->num_neurons - (first + g) : 32;
+            int half = (size + 1) / 2;
+            const uint8_t *codes = row + (first + g) / 2;
+            for (int k = 0; k < half; k++) {
+                out[g + k] = layer->weight_lut[codes[k] & 0x0F];
+            }
+            for (int k = half; k < size; k++) {
+                out[g + k] = layer->weight_lut[codes[k - half] >> 4];
+            }
+        }
+        return;
+    }
+    const uint8_t *pos = row + first / 8;
+    const uint8_t *neg = row + layer->packed_stride / 2 + first / 8;
+    int8_t scale = layer->weight_lut[1];
+    for (int i = 0; i < width; i++) {
+        out[i] = (int8_t)(scale * (((pos[i >> 3] >> (i & 7)) & 1) - ((neg[i >> 3] >> (i & 7)) & 1)));
+    }
+}
+
+// Sample b's index lists within a batch's [batch][tau] lists
+static inline Spike_Events sample_lists(const Snn_Network *net, const Spike_Events *lists, int b) {
+    Spike_Events view = {lists->index + (size_t)b * NET_TAU(net) * EVENT_STRIDE(net),
+                         lists->count + (size_t)b * NET_TAU(net), lists->valid};
+    return view;
+}
+
+// Tiled traversal across a batch. The producer's lists of every (sample,
+// step) are used when it wrote them, else the set bits are listed once; then
+// each tile is walked by every list in turn, so it is loaded from memory once
+// per batch and not once per sample.
+static void accumulate_tiled_batch(const Snn_Network *net, Snn_Batch *batch, const uint8_t *input,
+                                   Spike_Events *lists, size_t input_stride, size_t sums_stride, int count,
+                                   const Layer *layer) {
+    int tau = NET_TAU(net);
+
+    if (!lists->valid) {
+        for (int b = 0; b < count; b++) {
+            Spike_Events sample = sample_lists(net, lists, b);
+            for (int t = 0; t < tau; t++) {
+                sample.count[t] = list_active_inputs(SPIKE_ROW(input + b * input_stride, t, NET_SPIKE_BYTES(net)),
+                                                     layer->input_size, EVENT_ROW(net, &sample, t));
+            }
+        }
+        lists->valid = 1;
+    }
+
+    for (int first = 0; first < layer->num_neurons; first += Q7_TILE_NEURONS) {
+        int width = layer->num_neurons - first;
+        if (width > Q7_TILE_NEURONS) {
+            width = Q7_TILE_NEURONS;
+        }
+        for (int b = 0; b < count; b++) {
+            Spike_Events sample = sample_lists(net, lists, b);
+            for (int t = 0; t < tau; t++) {
+                if (sample.count[t] > 0) {
+                    gather_tile(layer, first, width, EVENT_ROW(net, &sample, t), sample.count[t],
+                                SUM_ROW(net, batch->sums + b * sums_stride, t));
+                }
+            }
+        }
+    }
+}
+
+// Row reuse across a batch. The chunk's spikes are first gathered into an
+// event list grouped by presynaptic neuron (one sums-row offset per firing
+// (sample, step)); the list is then replayed one tile of output neurons at a
+// time so the batch's sums tile stays in L1 while each weight row segment is
+// loaded once and added into every sample that has that neuron firing.
+static void accumulate_row_reuse_batch(const Snn_Network *net, Snn_Batch *batch,
+                                       const uint8_t *input, size_t input_stride,
+                                       size_t sums_stride, int count, const Layer *layer) {
+    int input_size = layer->input_size;
+    int num_bytes = (input_size + 7) / 8;
+    int stride = NET_SPIKE_BYTES(net);
+    int tau = NET_TAU(net);
+    int num_groups = 0;
+    uint32_t num_events = 0;
+
+    for (int byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
+        uint8_t any = 0;
+        for (int b = 0; b < count; b++) {
+            for (int t = 0; t < tau; t++) {
+                any |= SPIKE_ROW(input + b * input_stride, t, stride)[byte_idx];
+            }
+        }
+        int base_idx = byte_idx * 8;
+
+        while (any) {
+            int bit = __builtin_ctz(any);
+            int j = base_idx + bit;
+            if (j < input_size) {
+                batch->event_neuron[num_groups] = j;
+                batch->event_start[num_groups] = num_events;
+                for (int b = 0; b < count; b++) {
+                    const uint8_t *sample_input = input + b * input_stride;
+                    for (int t = 0; t < tau; t++) {
+                        if ((SPIKE_ROW(sample_input, t, stride)[byte_idx] >> bit) & 1) {
+                            batch->events[num_events++] = (uint32_t)(b * sums_stride + (size_t)t * NET_SUM_STRIDE(net));
+                        }
+                    }
+                }
+                num_groups++;
+            }
+            any &= any - 1;  // Clear least significant set bit
+        }
+    }
+    batch->event_start[num_groups] = num_events;
+
+    for (int tile = 0; tile < layer->num_neurons; tile += BATCH_TILE_NEURONS) {
+        int width = layer->num_neurons - tile;
+        if (width > BATCH_TILE_NEURONS) {
+            width = BATCH_TILE_NEURONS;
+        }
+        sum_t *sums_tile = batch->sums + tile;
+
+        for (int g = 0; g < num_groups; g++) {
+            uint32_t first = batch->event_start[g];
+            if (layer->precision == PRECISION_FLOAT32) {
+                const float *row = layer->weights_f32 + (size_t)batch->event_neuron[g] * layer->f32_stride + tile;
+                for (uint32_t e = first; e < batch->event_start[g + 1]; e++) {
+                    float_add_to_float_kernel(row, (float *)(sums_tile + batch->events[e]), width);
+                }
+                continue;
+            }
+            if (layer->sum_width == SUMS_INT16) {
+                // int16 rows start where the int32 rows do, the tile offset is in int16s
+                const int8_t *row = weight_line(layer, batch->event_neuron[g], tile);
+                for (uint32_t e = first; e < batch->event_start[g + 1]; e++) {
+                    q7_add_to_q15_kernel(row, (int16_t *)(batch->sums + batch->events[e]) + tile, width);
+                }
+                continue;
+            }
+            int8_t decoded[BATCH_TILE_NEURONS];
+            const int8_t *row = decoded;
+            if (layer->weight_format == WEIGHTS_INT8) {
+                row = weight_line(layer, batch->event_neuron[g], tile);
+            } else {
+                // Packed rows are decoded once per tile and reused by every event
+                unpack_weight_segment(layer, batch->event_neuron[g], tile, width, decoded);
+            }
+            q7_add_to_q31_multi_kernel(row, sums_tile, batch->events + first,
+                                       batch->event_start[g + 1] - first, width);
+        }
+    }
+}
+
+// A neuron whose weights are scaled by s keeps its membrane in steps of s / 128,
+// so its threshold in those steps is the Q0.7 threshold divided by s. Leak and
+// spikes are scale-free, and the hot loop keeps adding raw int8 codes.
+static float fold_threshold_f(const Snn_Network_Desc *desc, float scale) {
+    int thresh = desc->voltage_thresh ? desc->voltage_thresh : VOLTAGE_THRESH_FP7;
+    return thresh / scale;
+}
+
+static int validate_desc(const Snn_Network_Desc *desc) {
+    if (desc->num_layers < 1 || desc->tau < 1 || desc->time_window < desc->tau
+        || desc->time_window % desc->tau != 0) {
+        fprintf(stderr, "Error: invalid topology (%d layers, tau %d, time window %d)\n",
+                desc->num_layers, desc->tau, desc->time_window);
+        return 1;
+    }
+    if (desc->input_mode == INPUT_DIRECT && desc->num_layers < 2) {
+        fprintf(stderr, "Error: direct input needs at least one layer after the input layer\n");
+        return 1;
+    }
+    if (desc->voltage_thresh < 0 || desc->voltage_thresh > INT16_MAX
+        || desc->decay_rate < 0 || desc->decay_rate > (1 << DECAY_SHIFT)) {
+        fprintf(stderr, "Error: invalid neuron parameters (threshold %d, decay %d)\n",
+                desc->voltage_thresh, desc->decay_rate);
+        return 1;
+    }
+    for (int l = 0; l < desc->num_layers; l++) {
+        const Snn_Layer_Desc *ld = &desc->layers[l];
+        if (ld->num_neurons < 1) {
+            fprintf(stderr, "Error: layer %d has %d neurons\n", l, ld->num_neurons);
+            return 1;
+        }
+        if (l > 0 && (!ld->weights || !ld->bias)) {
+            fprintf(stderr, "Error: layer %d is missing weights or bias\n", l);
+            return 1;
+        }
+        if (l == 0 && ld->scales) {
+            fprintf(stderr, "Error: the input layer has no weights to scale\n");
+            return 1;
+        }
+        for (int i = 0; ld->scales && i < ld->num_neurons; i++) {
+            float folded = fold_threshold_f(desc, ld->scales[i]);
+            if (!(folded >= 1.0f && folded <= MAX_FOLDED_THRESH)) {
+                fprintf(stderr, "Error: layer %d neuron %d scale %g folds the threshold out of range\n",
+                        l, i, ld->scales[i]);
+                return 1;
+            }
+        }
+    }
+#if (SNN_FIXED_TOPOLOGY)
+    if (desc->num_layers > MAX_LAYERS || desc->tau != TAU || desc->time_window != TIME_WINDOW) {
+        fprintf(stderr, "Error: model does not match the fixed topology build "
+                "(max %d layers, tau %d, time window %d)\n", MAX_LAYERS, TAU, TIME_WINDOW);
+        return 1;
+    }
+    for (int l = 0; l < desc->num_layers; l++) {
+        if (desc->layers[l].num_neurons > MAX_NEURONS) {
+            fprintf(stderr, "Error: layer %d exceeds MAX_NEURONS (%d)\n", l, MAX_NEURONS);
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+// |bias_i| + sum_j |W[j][i]| bounds every step's sum of neuron i however its
+// inputs fire, so a layer whose largest bound fits int16 can accumulate in
+// int16 without ever saturating. Called whenever weights or precision change.
+static void update_sum_width(Layer *layer) {
+    int32_t bound = 0;
+    int32_t max_weight = INT32_MIN;
+    if (layer->weights_tiled) {
+        for (int i = 0; i < layer->num_neurons; i++) {
+            int32_t total = abs(layer->bias[i]);
+            for (int j = 0; j < layer->input_size; j++) {
+                int32_t w = layer_weight(layer, j, i);
+                total += abs(w);
+                max_weight = w > max_weight ? w : max_weight;
+            }
+            if (total > bound) {
+                bound = total;
+            }
+        }
+    }
+    layer->sum_bound = bound;
+    layer->max_weight = layer->weights_tiled ? max_weight : 0;
+    layer->sum_width = (INT16_SUMS && layer->weights_tiled && layer->precision == PRECISION_Q07
+                        && layer->weight_format == WEIGHTS_INT8 && bound <= INT16_MAX)
+                       ? SUMS_INT16 : SUMS_INT32;
+}
+
+static size_t weight_tile_bytes(int num_neurons, int input_size) {
+    return (size_t)input_size * ALIGN_TILE_NEURONS(num_neurons);
+}
+
+// Cuts the descriptor's [input_size][num_neurons] rows into the layer's tiles
+static void fill_weight_tiles(Layer *layer, const int8_t *rows) {
+    memset(layer->weights_tiled, 0, weight_tile_bytes(layer->num_neurons, layer->input_size));
+    for (int j = 0; j < layer->input_size; j++) {
+        for (int first = 0; first < layer->num_neurons; first += Q7_TILE_NEURONS) {
+            memcpy((int8_t *)weight_line(layer, j, first), rows + (size_t)j * layer->num_neurons + first,
+                   line_width(first, layer->num_neurons - first));
+        }
+    }
+}
+
+// Lays out every buffer of a network in one block, in build order: tables,
+// neuron state, spike buffers, scratch, then every layer's int8 weight
+// tiles. Strides follow the build (fixed or sized to the
+// model). With a NULL arena base it only measures, so planning and placing
+// share this one description of the storage.
+static void layout_network(Snn_Network *net, const Snn_Network_Desc *desc, Snn_Arena *arena,
+                           Snn_Memory_Plan *plan) {
+    memset(net, 0, sizeof(*net));
+    memset(plan, 0, sizeof(*plan));
+    net->num_layers = desc->num_layers;
+    net->tau = desc->tau;
+    net->time_window = desc->time_window;
+    net->first_layer = desc->input_mode == INPUT_DIRECT ? 1 : 0;
+    net->early_exit.mode = DEFAULT_EARLY_EXIT;
+    net->early_exit.margin = EARLY_EXIT_MARGIN_SPIKES;
+    net->early_exit.confidence_pct = EARLY_EXIT_CONFIDENCE_PCT;
+    net->early_exit.min_chunks = EARLY_EXIT_MIN_CHUNKS;
+
+    for (int l = 0; l < desc->num_layers; l++) {
+        int n = desc->layers[l].num_neurons;
+        if (n > net->max_neurons) {
+            net->max_neurons = n;
+        }
+        net->total_neurons += ALIGN_NEURONS(n);
+    }
+#if (SNN_FIXED_TOPOLOGY)
+    net->max_neurons = MAX_NEURONS;
+    net->spike_bytes = FIXED_SPIKE_BYTES;
+#else
+    net->spike_bytes = (net->max_neurons + 7) / 8;
+#endif
+    int num_outputs = desc->layers[desc->num_layers - 1].num_neurons;
+    int num_chunks = desc->time_window / desc->tau;
+    size_t state_bytes = (size_t)net->total_neurons * sizeof(sum_t);
+
+    net->layers = arena_take(arena, desc->num_layers * sizeof(Layer), &plan->tables);
+    net->firing_counts = arena_take(arena, (size_t)num_outputs * num_chunks * sizeof(int), &plan->tables);
+    net->firing_rows = arena_take(arena, num_outputs * sizeof(int *), &plan->tables);
+    net->layer_spikes = arena_take(arena, desc->num_layers * sizeof(int), &plan->tables);
+    net->membrane = arena_take(arena, state_bytes, &plan->neuron_state);
+    net->voltage_thresh = arena_take(arena, state_bytes, &plan->neuron_state);
+    net->decay_rate = arena_take(arena, state_bytes, &plan->neuron_state);
+    for (int k = 0; k < 2; k++) {
+        net->ping_pong[k] = arena_take(arena, (size_t)net->tau * net->spike_bytes, &plan->spikes);
+        net->events[k].index = arena_take(arena, (size_t)net->tau * EVENT_STRIDE(net) * sizeof(uint16_t),
+                                          &plan->spikes);
+        net->events[k].count = arena_take(arena, net->tau * sizeof(int), &plan->spikes);
+    }
+    net->sums = arena_take(arena, (size_t)net->tau * net->max_neurons * sizeof(sum_t), &plan->scratch);
+    net->chunk_sums = arena_take(arena, net->max_neurons * sizeof(int32_t), &plan->scratch);
+    net->active = arena_take(arena, net->max_neurons * sizeof(uint16_t), &plan->scratch);
+    for (int l = 1; l < desc->num_layers; l++) {
+        size_t bytes = weight_tile_bytes(desc->layers[l].num_neurons, desc->layers[l - 1].num_neurons);
+        int8_t *tiles = arena_take(arena, bytes, &plan->weight_tiles);
+        if (net->layers) {
+            net->layers[l].weights_tiled = tiles;
+        }
+    }
+    plan->total = arena->used;
+}
+
+// Wires a laid-out network to its descriptor: weight tiles, layer fields and
+// neuron parameters, then the define.h starting formats
+static int init_network(Snn_Network *net, const Snn_Network_Desc *desc) {
+    int num_outputs = desc->layers[desc->num_layers - 1].num_neurons;
+    int num_chunks = desc->time_window / desc->tau;
+    int total_neurons = net->total_neurons;
+
+    for (int i = 0; i < num_outputs; i++) {
+        net->firing_rows[i] = net->firing_counts + (size_t)i * num_chunks;
+    }
+    memset(net->membrane, 0, total_neurons * sizeof(sum_t));
+    memset(net->voltage_thresh, 0, total_neurons * sizeof(sum_t));
+    memset(net->decay_rate, 0, total_neurons * sizeof(sum_t));
+
+    int neuron_offset = 0;
+    for (int l = 0; l < net->num_layers; l++) {
+        Layer *layer = &net->layers[l];
+        const Snn_Layer_Desc *ld = &desc->layers[l];
 
-static int8_t *fc1_pointer_table[INPUT_SIZE];
-static int8_t *fc2_pointer_table[HIDDEN_LAYER_1];
+        layer->layer_num = l;
+        layer->num_neurons = ld->num_neurons;
+        layer->input_size = (l == 0) ? ld->num_neurons : desc->layers[l - 1].num_neurons;
+        layer->neuron_offset = neuron_offset;
+        layer->traversal = DEFAULT_TRAVERSAL;
+        // Spike masks for the popcount path are 32 bits wide
+        layer->popcount_mode = (net->tau <= 32) ? DEFAULT_IF_POPCOUNT : IF_POPCOUNT_OFF;
+        // Index lists hold 16-bit neuron numbers
+        layer->spike_mode = (ld->num_neurons <= UINT16_MAX + 1) ? DEFAULT_SPIKE_MODE : SPIKES_DENSE;
+        layer->precision = PRECISION_Q07;
+        layer->weights_f32 = NULL;
+        layer->bias_f32 = NULL;
+        layer->f32_stride = 0;
+        layer->weight_format = WEIGHTS_INT8;
+        layer->weights_packed = NULL;
+        layer->packed_stride = 0;
+        layer->weight_scale = 1.0f;
+        layer->channel_scale = ld->scales;
+        neuron_offset += ALIGN_NEURONS(ld->num_neurons);
 
-static int8_t *fc1_bias_pointer = NULL;
-static int8_t *fc2_bias_pointer = NULL;
-static int weights_initialized = 0;
+        // The tiles are the network's only copy of the int8 weights
+        if (l > 0) {
+            fill_weight_tiles(layer, ld->weights);
+            layer->bias = (int8_t *)ld->bias;
+        } else {
+            layer->weights_tiled = NULL;
+            layer->bias = NULL;
+        }
 
-// Backing storage for the two ping-pong buffers:
-// Static memory for ping-pong buffers
-// Each neuron has BITMASK_BYTES bytes, and there are MAX_NEURONS neurons
-static uint8_t ping_pong_buffer_storage_1[TAU][INPUT_BYTES] = {0};
-static uint8_t ping_pong_buffer_storage_2[TAU][INPUT_BYTES] = {0};
+        sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+        sum_t *decay = net->decay_rate + layer->neuron_offset;
+        for (int i = 0; i < layer->num_neurons; i++) {
+            thresh[i] = desc->voltage_thresh ? desc->voltage_thresh : VOLTAGE_THRESH_FP7;
+            decay[i] = desc->decay_rate ? desc->decay_rate : DECAY_FP7;
+            if (ld->scales) {
+                thresh[i] = (sum_t)lrintf(fold_threshold_f(desc, ld->scales[i]));
+            }
+        }
+        update_sum_width(layer);
+    }
 
-// Pointers that we can swap:
-static uint8_t (*ping_pong_buffer_1)[INPUT_BYTES] = ping_pong_buffer_storage_1;
-static uint8_t (*ping_pong_buffer_2)[INPUT_BYTES] = ping_pong_buffer_storage_2;
+    // Parameters start as int8 Q0.7; packed rows and float32 layers are converted from them
+    for (int l = 0; l < net->num_layers; l++) {
+        if ((DEFAULT_WEIGHT_FORMAT != WEIGHTS_INT8 && set_layer_weight_format(net, l, DEFAULT_WEIGHT_FORMAT))
+            || (DEFAULT_PRECISION != PRECISION_Q07 && set_layer_precision(net, l, DEFAULT_PRECISION))
+            || set_layer_traversal(net, l, DEFAULT_TRAVERSAL)) {
+            destroy_network(net);
+            return 1;
+        }
+    }
+    return 0;
+}
 
-// Function to update the entire layer based on the buffer and bias
-void update_layer(const uint8_t input[TAU][INPUT_BYTES],
-                  uint8_t output[TAU][INPUT_BYTES],
-                  Layer *layer, int input_size) {
-    int num_bytes = (input_size + 7) / 8;
-    int N = layer->layer_num;
-    // printf("Layer %d: num_neurons = %d, input_size = %d\n", layer->layer_num, layer->num_neurons, input_size);
+static int build_network_arena(Snn_Network *net, const Snn_Network_Desc *desc, void *arena,
+                               size_t arena_bytes, int owned) {
+    Snn_Memory_Plan plan;
+    Snn_Arena measure = {NULL, 0};
+    layout_network(net, desc, &measure, &plan);
+    if (((uintptr_t)arena & 63) != 0 || arena_bytes < plan.total) {
+        fprintf(stderr, "Error: network arena must be 64-byte aligned and hold %zu bytes\n", plan.total);
+        memset(net, 0, sizeof(*net));
+        return 1;
+    }
+    memset(arena, 0, plan.total);
+    Snn_Arena place = {arena, 0};
+    layout_network(net, desc, &place, &plan);
+    net->storage = owned ? arena : NULL;
+    net->owns_storage = owned;
+    return init_network(net, desc);
+}
 
-    // scratch buffers for column and sums
-    for (int t = 0; t < TAU; t++) {
-#if (Q07_FLAG)
-            static int32_t sums[MAX_NEURONS]  __attribute__((aligned(4)));
-            memset(sums, 0, layer->num_neurons * sizeof(int32_t));
-#else
-            static float sums[MAX_NEURONS]  __attribute__((aligned(4)));
-            memset(sums, 0, layer->num_neurons * sizeof(float));
-#endif
+int plan_network_memory(const Snn_Network_Desc *desc, Snn_Memory_Plan *plan) {
+    if (validate_desc(desc)) {
+        return 1;
+    }
+    Snn_Network net;
+    Snn_Arena measure = {NULL, 0};
+    layout_network(&net, desc, &measure, plan);
+    return 0;
+}
 
-            if (N > 0) {
-                // Hidden or output layer: sum over presynaptic spikes
-#if (Q07_FLAG)
-                vectorize_q7_add_to_q31(
-                    layer->bias,
-                    sums,
-                    layer->num_neurons
-                );
-#else
-                for (int j=0 ; j < input_size; j++) {
-                    sums[j] = dequantize_q07(layer->bias[j]);
-                }
-#endif
-                for (int byte_idx = 0; byte_idx < num_bytes; byte_idx++) {
-                    uint8_t byte = input[t][byte_idx];
-                    int base_idx = byte_idx * 8;
-
-                    while (byte) {
-                        int bit = __builtin_ctz(byte);
-                        int j = base_idx + bit;
-                        if (j < input_size) {
-                            // print weight row for neuron j
-                            // printf("Neuron %d: ", j);
-                            // for (int k = 0; k < layer->num_neurons; k++) {
-                            //     printf("%d ", layer->weights[j][k]);
-                            // }
-                            // printf("\n");
-                            // exit(EXIT_SUCCESS);
-
-#if (Q07_FLAG)
-                            vectorize_q7_add_to_q31(
-                                layer->weights[j],
-                                sums,
-                                layer->num_neurons
-                            );
-                            // sum += layer->weights[i][j];
+int build_network_in(Snn_Network *net, const Snn_Network_Desc *desc, void *arena, size_t arena_bytes) {
+    if (validate_desc(desc)) {
+        return 1;
+    }
+    // Bind the synaptic accumulate to the widest SIMD kernel this CPU has
+    dsp_init_dispatch();
+    return build_network_arena(net, desc, arena, arena_bytes, 0);
+}
+
+int build_network(Snn_Network *net, const Snn_Network_Desc *desc) {
+    if (validate_desc(desc)) {
+        return 1;
+    }
+
+    // Bind the synaptic accumulate to the widest SIMD kernel this CPU has
+    dsp_init_dispatch();
+
+    Snn_Memory_Plan plan;
+    Snn_Arena measure = {NULL, 0};
+    layout_network(net, desc, &measure, &plan);
+#if (SNN_FIXED_TOPOLOGY)
+    // Sizes and strides from the plan, storage from the define.h statics
+    memset(static_layers, 0, sizeof(static_layers));
+    net->layers = static_layers;
+    int8_t *tiles = static_weight_tiles;
+    for (int l = 1; l < desc->num_layers; l++) {
+        net->layers[l].weights_tiled = tiles;
+        tiles += weight_tile_bytes(desc->layers[l].num_neurons, desc->layers[l - 1].num_neurons);
+    }
+    net->ping_pong[0] = &ping_pong_buffer_storage_1[0][0];
+    net->ping_pong[1] = &ping_pong_buffer_storage_2[0][0];
+    net->sums = static_sums;
+    net->chunk_sums = static_chunk_sums;
+    net->active = static_active;
+    net->firing_counts = static_firing_counts;
+    net->firing_rows = static_firing_rows;
+    for (int k = 0; k < 2; k++) {
+        net->events[k].index = static_event_index[k];
+        net->events[k].count = static_event_count[k];
+    }
+    net->layer_spikes = static_layer_spikes;
+    net->membrane = static_membrane;
+    net->voltage_thresh = static_voltage_thresh;
+    net->decay_rate = static_decay_rate;
+    return init_network(net, desc);
 #else
-                        for (int i=0 ; i < input_size; i++) {
-                            sums[i] = dequantize_q07(layer->weights[i][j]);
-                        }
+    // Everything in one block, laid out exactly as the plan
+    void *block = aligned_alloc(64, plan.total);
+    if (!block) {
+        perror("Failed to allocate network");
+        memset(net, 0, sizeof(*net));
+        return 1;
+    }
+    return build_network_arena(net, desc, block, plan.total, 1);
 #endif
-                        }
-                        byte &= byte - 1;  // Clear least significant set bit
-                    }
-                }
+}
 
-            } else {
-                // Input layer: spike from self (i-th input neuron only)
-                // This is a bit of a hack, but it works for the input layer
-                // and is a bit faster than the alternative of using a separate
-                // function to handle the input layer.
-                for (int i = 0; i < layer->num_neurons; i++) {
-                if (GET_BIT(input[t], i)) {
-#if (Q07_FLAG)
-                    sums[i] += (1 << DECAY_SHIFT);  // Q0.7 equivalent of +1
-#else               
-                    sums[i] += 1.0f;
-#endif
-                }
+void reset_network(Snn_Network *net) {
+    memset(net->membrane, 0, net->total_neurons * sizeof(sum_t));
+}
+
+int set_layer_traversal(Snn_Network *net, int layer_index, Traversal_Mode traversal) {
+    if (layer_index < 0 || layer_index >= net->num_layers) {
+        fprintf(stderr, "Error: no layer %d to set the traversal of\n", layer_index);
+        return 1;
+    }
+    net->layers[layer_index].traversal = traversal;
+    return 0;
+}
+
+int set_layer_precision(Snn_Network *net, int layer_index, Layer_Precision precision) {
+    if (layer_index < 0 || layer_index >= net->num_layers) {
+        fprintf(stderr, "Error: no layer %d to set the precision of\n", layer_index);
+        return 1;
+    }
+    Layer *layer = &net->layers[layer_index];
+    if (layer->precision == precision) {
+        return 0;
+    }
+
+    sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+    sum_t *decay = net->decay_rate + layer->neuron_offset;
+    if (precision == PRECISION_FLOAT32) {
+        int stride = ALIGN_NEURONS(layer->num_neurons);
+        size_t row_bytes = (size_t)stride * sizeof(float);
+        // Rows of whole cache lines, so every row starts 64-byte aligned
+        float *weights = layer_index > 0 ? aligned_alloc(64, layer->input_size * row_bytes) : NULL;
+        float *bias = layer_index > 0 ? aligned_alloc(64, row_bytes) : NULL;
+        if (layer_index > 0 && (!weights || !bias)) {
+            perror("Failed to allocate float32 weights");
+            free(weights);
+            free(bias);
+            return 1;
+        }
+        for (int j = 0; j < layer->input_size && weights; j++) {
+            float *row = weights + (size_t)j * stride;
+            for (int i = 0; i < stride; i++) {
+                row[i] = i < layer->num_neurons ? dequantize_q07(layer_weight(layer, j, i)) : 0.0f;
+            }
+        }
+        for (int i = 0; i < stride && bias; i++) {
+            bias[i] = i < layer->num_neurons ? dequantize_q07(layer->bias[i]) : 0.0f;
+        }
+        layer->weights_f32 = weights;
+        layer->bias_f32 = bias;
+        layer->f32_stride = stride;
+        for (int i = 0; i < layer->num_neurons; i++) {
+            float t = dequantize_q07(thresh[i]);
+            float d = dequantize_q07(decay[i]);
+            memcpy(&thresh[i], &t, sizeof(float));
+            memcpy(&decay[i], &d, sizeof(float));
+        }
+    } else {
+        free(layer->weights_f32);
+        free(layer->bias_f32);
+        layer->weights_f32 = NULL;
+        layer->bias_f32 = NULL;
+        layer->f32_stride = 0;
+        for (int i = 0; i < layer->num_neurons; i++) {
+            float t;
+            float d;
+            memcpy(&t, &thresh[i], sizeof(float));
+            memcpy(&d, &decay[i], sizeof(float));
+            thresh[i] = (sum_t)lrintf(t * Q07_SCALE);
+            decay[i] = (sum_t)lrintf(d * Q07_SCALE);
+        }
+    }
+    layer->precision = precision;
+    update_sum_width(layer);
+    // Membranes of the old precision mean nothing in the new one
+    memset(net->membrane + layer->neuron_offset, 0, layer->num_neurons * sizeof(sum_t));
+    return 0;
+}
+
+// Least-squares int4 scale: codes -7..7 times scale, rounded into the int8
+// table. Candidates sweep from max|w| / 7 (no clipping) down to half that,
+// trading clipped outliers for finer steps, and are scored on the layer's
+// weight histogram.
+static float fit_int4_scale(const uint32_t hist[256], int max_abs) {
+    float best_scale = max_abs / 7.0f;
+    double best_error = -1.0;
+    for (int k = 0; k <= 32; k++) {
+        float scale = max_abs / 7.0f * (1.0f - k / 64.0f);
+        if (scale <= 0.0f) {
+            break;
+        }
+        double error = 0.0;
+        for (int w = -128; w < 128; w++) {
+            if (!hist[w + 128]) {
+                continue;
+            }
+            long code = lrintf(w / scale);
+            code = code < -7 ? -7 : code > 7 ? 7 : code;
+            long q = lrintf(code * scale);
+            q = q < Q07_MIN_INT8 ? Q07_MIN_INT8 : q > Q07_MAX_INT8 ? Q07_MAX_INT8 : q;
+            error += (double)hist[w + 128] * (double)(w - q) * (double)(w - q);
+        }
+        if (best_error < 0.0 || error < best_error) {
+            best_error = error;
+            best_scale = scale;
+        }
+    }
+    return best_scale;
+}
+
+// Least-squares ternary quantizer: weights with |w| > delta become +-scale,
+// scale being their mean magnitude; every delta is tried. Returns the scale
+// and sets delta.
+static int fit_ternary_scale(const uint32_t hist[256], int max_abs, int *delta) {
+    int best_scale = 1;
+    double best_error = -1.0;
+    *delta = max_abs;
+    for (int d = 0; d < max_abs; d++) {
+        double kept = 0.0;
+        double magnitude = 0.0;
+        for (int w = -128; w < 128; w++) {
+            if (abs(w) > d) {
+                kept += hist[w + 128];
+                magnitude += (double)hist[w + 128] * abs(w);
+            }
+        }
+        int scale = (int)lrint(magnitude / kept);
+        scale = scale < 1 ? 1 : scale > Q07_MAX_INT8 ? Q07_MAX_INT8 : scale;
+        double error = 0.0;
+        for (int w = -128; w < 128; w++) {
+            double q = abs(w) > d ? (w > 0 ? scale : -scale) : 0;
+            error += (double)hist[w + 128] * (w - q) * (w - q);
+        }
+        if (best_error < 0.0 || error < best_error) {
+            best_error = error;
+            best_scale = scale;
+            *delta = d;
+        }
+    }
+    return best_scale;
+}
+
+// Where neuron i of an n-neuron int4 row lives (see q4_add_to_q31_fn): groups
+// of 32 neurons in 16 bytes, the first half of a group in the low nibbles
+static void int4_position(int n, int i, int *byte, int *shift) {
+    int group = i & ~31;
+    int width = n - group < 32 ? n - group : 32;
+    int half = (width + 1) / 2;
+    int k = i - group;
+    *byte = group / 2 + (k < half ? k : k - half);
+    *shift = k < half ? 0 : 4;
+}
+
+int set_layer_weight_format(Snn_Network *net, int layer_index, Weight_Format format) {
+    if (layer_index < 0 || layer_index >= net->num_layers) {
+        fprintf(stderr, "Error: no layer %d to set the weight format of\n", layer_index);
+        return 1;
+    }
+    Layer *layer = &net->layers[layer_index];
+    if (layer_index == 0 || layer->weight_format == format) {
+        return 0;
+    }
+    // Float32 rows are built from the stored weights, so rebuild them after repacking
+    Layer_Precision precision = layer->precision;
+    if (precision != PRECISION_Q07 && set_layer_precision(net, layer_index, PRECISION_Q07)) {
+        return 1;
+    }
+
+    free(layer->weights_packed);
+    layer->weights_packed = NULL;
+    layer->packed_stride = 0;
+    layer->weight_scale = 1.0f;
+    layer->weight_format = WEIGHTS_INT8;
+    memset(layer->weight_lut, 0, sizeof(layer->weight_lut));
+
+    if (format != WEIGHTS_INT8) {
+        int n = layer->num_neurons;
+        uint32_t hist[256] = {0};
+        int max_abs = 1;
+        for (int j = 0; j < layer->input_size; j++) {
+            for (int i = 0; i < n; i++) {
+                int w = *weight_line(layer, j, i);
+                hist[w + 128]++;
+                if (abs(w) > max_abs) {
+                    max_abs = abs(w);
                 }
             }
+        }
 
-            for (int i = 0; i < layer->num_neurons; i++) {
-            int reset_signal = HEAVISIDE(layer->neurons[i].membrane_potential,
-                                         layer->neurons[i].voltage_thresh);
-#if (LIF)
-    #if (Q07_FLAG)
-            int32_t new_mem = ((DECAY_FP7 * layer->neurons[i].membrane_potential) >> DECAY_SHIFT)
-                      + sums[i]
-                      - reset_signal * layer->neurons[i].voltage_thresh;
-    #else
-            float new_mem = (int32_t)(layer->neurons[i].decay_rate * (float)layer->neurons[i].membrane_potential)
-                      + sums[i]
-                      - reset_signal * layer->neurons[i].voltage_thresh;
-    #endif
-#elif (IF)
-    #if (Q07_FLAG)
-            int32_t new_mem = layer->neurons[i].membrane_potential
-                      + sums[i]
-                      - reset_signal * layer->neurons[i].voltage_thresh;
-    #else
-            float new_mem = (int32_t)((float)layer->neurons[i].membrane_potential + (float)sums[i])
-                      - reset_signal * layer->neurons[i].voltage_thresh;
-    #endif
-#endif
+        int plane_bytes = (n + 7) / 8;
+        int stride = format == WEIGHTS_INT4 ? (n + 1) / 2 : 2 * plane_bytes;
+        size_t bytes = ((size_t)layer->input_size * stride + 63) & ~(size_t)63;
+        uint8_t *packed = aligned_alloc(64, bytes);
+        if (!packed) {
+            perror("Failed to allocate packed weights");
+            set_layer_precision(net, layer_index, precision);
+            return 1;
+        }
+        memset(packed, 0, bytes);
 
-            layer->neurons[i].membrane_potential = new_mem;
-            SET_BIT(output[t], i, reset_signal);
+        if (format == WEIGHTS_INT4) {
+            float scale = fit_int4_scale(hist, max_abs);
+            for (int code = -8; code < 8; code++) {
+                long q = lrintf(code * scale);
+                layer->weight_lut[code & 0x0F] = (int8_t)(q < Q07_MIN_INT8 ? Q07_MIN_INT8 : q > Q07_MAX_INT8 ? Q07_MAX_INT8 : q);
+            }
+            for (int j = 0; j < layer->input_size; j++) {
+                uint8_t *row = packed + (size_t)j * stride;
+                for (int i = 0; i < n; i++) {
+                    long code = lrintf(*weight_line(layer, j, i) / scale);
+                    code = code < -7 ? -7 : code > 7 ? 7 : code;
+                    int byte;
+                    int shift;
+                    int4_position(n, i, &byte, &shift);
+                    row[byte] |= (uint8_t)((code & 0x0F) << shift);
+                }
+            }
+            layer->weight_scale = scale;
+        } else {
+            int delta;
+            int scale = fit_ternary_scale(hist, max_abs, &delta);
+            layer->weight_lut[1] = (int8_t)scale;
+            layer->weight_lut[15] = (int8_t)-scale;
+            for (int j = 0; j < layer->input_size; j++) {
+                uint8_t *pos = packed + (size_t)j * stride;
+                uint8_t *neg = pos + plane_bytes;
+                for (int i = 0; i < n; i++) {
+                    int w = *weight_line(layer, j, i);
+                    if (w > delta) {
+                        SET_BIT(pos, i, 1);
+                    } else if (w < -delta) {
+                        SET_BIT(neg, i, 1);
+                    }
+                }
+            }
+            layer->weight_scale = (float)scale;
         }
+        layer->weights_packed = packed;
+        layer->packed_stride = stride;
+        layer->weight_format = format;
+    }
+    update_sum_width(layer);
 
+    if (precision != PRECISION_Q07) {
+        return set_layer_precision(net, layer_index, precision);
     }
+    return 0;
 }
 
-void initialize_network(int neurons_per_layer[],
-     const int8_t weights_fc1[INPUT_SIZE][HIDDEN_LAYER_1], const int8_t weights_fc2[HIDDEN_LAYER_1][NUM_CLASSES],
-     const int8_t *bias_fc1, const int8_t *bias_fc2) {
-    snn_network.layers = static_layers;
+int8_t layer_weight(const Layer *layer, int j, int i) {
+    if (layer->weight_format == WEIGHTS_INT4) {
+        const uint8_t *row = layer->weights_packed + (size_t)j * layer->packed_stride;
+        int byte;
+        int shift;
+        int4_position(layer->num_neurons, i, &byte, &shift);
+        return layer->weight_lut[(row[byte] >> shift) & 0x0F];
+    }
+    if (layer->weight_format == WEIGHTS_TERNARY) {
+        const uint8_t *pos = layer->weights_packed + (size_t)j * layer->packed_stride;
+        const uint8_t *neg = pos + layer->packed_stride / 2;
+        return GET_BIT(pos, i) ? layer->weight_lut[1] : GET_BIT(neg, i) ? layer->weight_lut[15] : 0;
+    }
+    return *weight_line(layer, j, i);
+}
 
-    if (!weights_initialized) {
-        for (int i = 0; i < INPUT_SIZE; i++) {
-            fc1_pointer_table[i] = (int8_t *)weights_fc1[i];
+// One name for every layer, or a comma-separated list with one name per layer.
+// values receives each layer's index into names. Returns 0 on success.
+static int parse_layer_list(const char *text, const char *const *names, int num_names, int *values,
+                            int num_layers) {
+    int count = 0;
+    for (;;) {
+        const char *comma = strchr(text, ',');
+        size_t len = comma ? (size_t)(comma - text) : strlen(text);
+        int found = -1;
+        for (int k = 0; k < num_names; k++) {
+            if (strlen(names[k]) == len && strncmp(text, names[k], len) == 0) {
+                found = k;
+            }
+        }
+        if (found < 0 || count == num_layers) {
+            return 1;
         }
-        for (int i = 0; i < HIDDEN_LAYER_1; i++) {
-            fc2_pointer_table[i] = (int8_t *)weights_fc2[i];
+        values[count++] = found;
+        if (!comma) {
+            break;
+        }
+        text = comma + 1;
+    }
+    // One name applies to every layer, a list must name them all
+    if (count == 1) {
+        for (int l = 1; l < num_layers; l++) {
+            values[l] = values[0];
         }
+        return 0;
+    }
+    return count != num_layers;
+}
 
-        fc1_bias_pointer = (int8_t *)bias_fc1;
-        fc2_bias_pointer = (int8_t *)bias_fc2;
+static const char *const precision_names[] = {"q07", "float32"};
+static const char *const weight_format_names[] = {"int8", "int4", "ternary"};
+
+const char *precision_name(Layer_Precision precision) {
+    return (precision >= PRECISION_Q07 && precision <= PRECISION_FLOAT32) ? precision_names[precision] : "unknown";
+}
 
-        weights_initialized = 1;
+int precision_parse(const char *text, Layer_Precision *precisions, int num_layers) {
+    int values[num_layers];
+    if (parse_layer_list(text, precision_names, 2, values, num_layers)) {
+        return 1;
     }
+    for (int l = 0; l < num_layers; l++) {
+        precisions[l] = (Layer_Precision)values[l];
+    }
+    return 0;
+}
 
-    for (int l = 0; l < snn_network.num_layers; l++) {
-        snn_network.layers[l].layer_num = l;
-        snn_network.layers[l].num_neurons = neurons_per_layer[l];
-        snn_network.layers[l].neurons = static_neurons[l];
+const char *weight_format_name(Weight_Format format) {
+    return (format >= WEIGHTS_INT8 && format <= WEIGHTS_TERNARY) ? weight_format_names[format] : "unknown";
+}
 
-        if (l == 1) {
-            snn_network.layers[l].weights = fc1_pointer_table;
-            snn_network.layers[l].bias = fc1_bias_pointer;
-        } else if (l == 2) {
-            snn_network.layers[l].weights = fc2_pointer_table;
-            snn_network.layers[l].bias = fc2_bias_pointer;
-        } else {
-            snn_network.layers[l].weights = NULL;
-            snn_network.layers[l].bias = NULL;
+int weight_format_parse(const char *text, Weight_Format *formats, int num_layers) {
+    int values[num_layers];
+    if (parse_layer_list(text, weight_format_names, 3, values, num_layers)) {
+        return 1;
+    }
+    for (int l = 0; l < num_layers; l++) {
+        formats[l] = (Weight_Format)values[l];
+    }
+    return 0;
+}
+
+void destroy_network(Snn_Network *net) {
+    for (int l = 0; net->layers && l < net->num_layers; l++) {
+        free(net->layers[l].weights_f32);
+        free(net->layers[l].bias_f32);
+        free(net->layers[l].weights_packed);
+    }
+    if (net->owns_storage) {
+        free(net->storage);
+    }
+    memset(net, 0, sizeof(*net));
+}
+
+// Context buffers in one block, measured when the arena base is NULL
+static void layout_context(Snn_Context *ctx, const Snn_Network *net, Snn_Arena *arena) {
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_chunks = net->time_window / net->tau;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->net = net;
+    ctx->membrane = arena_take(arena, net->total_neurons * sizeof(sum_t), NULL);
+    for (int k = 0; k < 2; k++) {
+        ctx->ping_pong[k] = arena_take(arena, (size_t)net->tau * net->spike_bytes, NULL);
+        ctx->events[k].index = arena_take(arena, (size_t)net->tau * EVENT_STRIDE(net) * sizeof(uint16_t), NULL);
+        ctx->events[k].count = arena_take(arena, net->tau * sizeof(int), NULL);
+    }
+    ctx->sums = arena_take(arena, (size_t)net->tau * net->max_neurons * sizeof(sum_t), NULL);
+    ctx->chunk_sums = arena_take(arena, net->max_neurons * sizeof(int32_t), NULL);
+    ctx->active = arena_take(arena, net->max_neurons * sizeof(uint16_t), NULL);
+    ctx->firing_counts = arena_take(arena, (size_t)num_outputs * num_chunks * sizeof(int), NULL);
+    ctx->firing_rows = arena_take(arena, num_outputs * sizeof(int *), NULL);
+    ctx->layer_spikes = arena_take(arena, net->num_layers * sizeof(int), NULL);
+}
+
+size_t context_memory_size(const Snn_Network *net) {
+    Snn_Context ctx;
+    Snn_Arena measure = {NULL, 0};
+    layout_context(&ctx, net, &measure);
+    return measure.used;
+}
+
+static int create_context_arena(Snn_Context *ctx, const Snn_Network *net, void *arena,
+                                size_t arena_bytes, int owned) {
+    size_t bytes = context_memory_size(net);
+    if (((uintptr_t)arena & 63) != 0 || arena_bytes < bytes) {
+        fprintf(stderr, "Error: context arena must be 64-byte aligned and hold %zu bytes\n", bytes);
+        memset(ctx, 0, sizeof(*ctx));
+        return 1;
+    }
+    memset(arena, 0, bytes);
+    Snn_Arena place = {arena, 0};
+    layout_context(ctx, net, &place);
+    ctx->storage = owned ? arena : NULL;
+    ctx->owns_storage = owned;
+
+    // Thresholds and decay are read from the network, membrane state is private
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_chunks = net->time_window / net->tau;
+    for (int i = 0; i < num_outputs; i++) {
+        ctx->firing_rows[i] = ctx->firing_counts + (size_t)i * num_chunks;
+    }
+    reset_context(ctx);
+    return 0;
+}
+
+int create_context(Snn_Context *ctx, const Snn_Network *net) {
+    size_t bytes = context_memory_size(net);
+    void *block = aligned_alloc(64, bytes);
+    if (!block) {
+        perror("Failed to allocate context");
+        memset(ctx, 0, sizeof(*ctx));
+        return 1;
+    }
+    return create_context_arena(ctx, net, block, bytes, 1);
+}
+
+int create_context_in(Snn_Context *ctx, const Snn_Network *net, void *arena, size_t arena_bytes) {
+    return create_context_arena(ctx, net, arena, arena_bytes, 0);
+}
+
+void reset_context(Snn_Context *ctx) {
+    memset(ctx->membrane, 0, ctx->net->total_neurons * sizeof(sum_t));
+}
+
+void destroy_context(Snn_Context *ctx) {
+    if (ctx->owns_storage) {
+        free(ctx->storage);
+    }
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int create_batch(Snn_Batch *batch, const Snn_Network *net, int batch_size) {
+    memset(batch, 0, sizeof(*batch));
+    if (batch_size < 1) {
+        fprintf(stderr, "Error: batch size must be at least 1\n");
+        return 1;
+    }
+
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_chunks = net->time_window / net->tau;
+    size_t sample_bytes = (size_t)net->tau * net->spike_bytes;
+    size_t sums_bytes = (size_t)batch_size * net->tau * net->max_neurons * sizeof(sum_t);
+
+    batch->net = net;
+    batch->batch_size = batch_size;
+    batch->membrane = aligned_alloc(64, (size_t)batch_size * net->total_neurons * sizeof(sum_t));
+    batch->ping_pong[0] = calloc((size_t)batch_size * sample_bytes, 1);
+    batch->ping_pong[1] = calloc((size_t)batch_size * sample_bytes, 1);
+    batch->sums = aligned_alloc(64, (sums_bytes + 63) & ~(size_t)63);
+    batch->firing_counts = calloc((size_t)batch_size * num_outputs * num_chunks, sizeof(int));
+    batch->firing_rows = calloc(num_outputs, sizeof(int *));
+    batch->events = malloc((size_t)batch_size * net->tau * net->max_neurons * sizeof(uint32_t));
+    batch->event_neuron = malloc(net->max_neurons * sizeof(int));
+    batch->event_start = malloc((net->max_neurons + 1) * sizeof(uint32_t));
+    for (int k = 0; k < 2; k++) {
+        batch->lists[k].index = malloc((size_t)batch_size * net->tau * EVENT_STRIDE(net) * sizeof(uint16_t));
+        batch->lists[k].count = malloc((size_t)batch_size * net->tau * sizeof(int));
+    }
+    batch->slot_sample = malloc(batch_size * sizeof(int));
+    batch->encoders = aligned_alloc(64, batch_size * sizeof(Spike_Encoder));
+    if (!batch->membrane || !batch->ping_pong[0] || !batch->ping_pong[1] || !batch->sums
+        || !batch->firing_counts || !batch->firing_rows || !batch->events || !batch->event_neuron
+        || !batch->event_start || !batch->lists[0].index || !batch->lists[0].count || !batch->lists[1].index
+        || !batch->lists[1].count || !batch->slot_sample || !batch->encoders) {
+        perror("Failed to allocate batch");
+        destroy_batch(batch);
+        return 1;
+    }
+    return 0;
+}
+
+void destroy_batch(Snn_Batch *batch) {
+    free(batch->membrane);
+    free(batch->ping_pong[0]);
+    free(batch->ping_pong[1]);
+    free(batch->sums);
+    free(batch->firing_counts);
+    free(batch->firing_rows);
+    free(batch->events);
+    free(batch->event_neuron);
+    free(batch->event_start);
+    for (int k = 0; k < 2; k++) {
+        free(batch->lists[k].index);
+        free(batch->lists[k].count);
+    }
+    free(batch->slot_sample);
+    free(batch->encoders);
+    memset(batch, 0, sizeof(*batch));
+}
+
+// Point firing_rows at the output counts of the sample in slot b
+static void point_slot_rows(Snn_Batch *batch, int b, int num_outputs, int num_chunks) {
+    int *counts = batch->firing_counts + (size_t)b * num_outputs * num_chunks;
+    for (int i = 0; i < num_outputs; i++) {
+        batch->firing_rows[i] = counts + (size_t)i * num_chunks;
+    }
+}
+
+// Input chunks come from spikes, or from one encoder per slot over samples
+// first.. of src when spikes is NULL
+static void run_batch(Snn_Batch *batch, const uint8_t *spikes, int spike_bytes, const Spike_Source *src,
+                      int first, int count, int *classifications, int *chunks_used) {
+    const Snn_Network *net = batch->net;
+    int tau = NET_TAU(net);
+    int stride = NET_SPIKE_BYTES(net);
+    int num_chunks = net->time_window / tau;
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int input_bytes = (net->layers[0].num_neurons + 7) / 8;
+    size_t sample_bytes = (size_t)tau * stride;
+    size_t sums_stride = (size_t)tau * NET_SUM_STRIDE(net);
+    size_t spikes_stride = (size_t)net->time_window * spike_bytes;
+    uint8_t *ping = batch->ping_pong[0];
+    uint8_t *pong = batch->ping_pong[1];
+    Spike_Events *ping_lists = &batch->lists[0];
+    Spike_Events *pong_lists = &batch->lists[1];
+
+    if (count > batch->batch_size) {
+        count = batch->batch_size;
+    }
+
+    memset(batch->membrane, 0, (size_t)count * net->total_neurons * sizeof(sum_t));
+    memset(batch->firing_counts, 0, (size_t)count * num_outputs * num_chunks * sizeof(int));
+    for (int b = 0; b < count; b++) {
+        batch->slot_sample[b] = b;
+        if (!spikes) {
+            source_begin(src, &batch->encoders[b], first + b);
         }
+    }
 
-        for (int i = 0; i < snn_network.layers[l].num_neurons; i++) {
-#if (Q07_FLAG)
-            snn_network.layers[l].neurons[i].membrane_potential = 0;
-            snn_network.layers[l].neurons[i].voltage_thresh = VOLTAGE_THRESH_FP7;
-            snn_network.layers[l].neurons[i].decay_rate = DECAY_FP7;
-            snn_network.layers[l].neurons[i].delayed_reset = 0;
-#else
-            snn_network.layers[l].neurons[i].membrane_potential = 0.0f;
-            snn_network.layers[l].neurons[i].voltage_thresh = VOLTAGE_THRESH;
-            snn_network.layers[l].neurons[i].decay_rate = DECAY_RATE;
-            snn_network.layers[l].neurons[i].delayed_reset = 0.0f;
+    // Samples that exit early are swapped out of the batch, so the slots
+    // [0, count) always hold the samples still running
+    for (int chunk = 0; chunk < net->time_window && count > 0; chunk += tau) {
+        int chunk_index = chunk / tau;
+        for (int b = 0; b < count; b++) {
+            if (!spikes) {
+                encoder_next_chunk(&batch->encoders[b], ping + b * sample_bytes, tau, stride);
+                continue;
+            }
+            for (int t = 0; t < tau; t++) {
+                memcpy(SPIKE_ROW(ping + b * sample_bytes, t, stride),
+                       spikes + batch->slot_sample[b] * spikes_stride + (size_t)(chunk + t) * spike_bytes,
+                       input_bytes);
+            }
+        }
+        ping_lists->valid = 0;
+
+        for (int l = net->first_layer; l < net->num_layers; l++) {
+            const Layer *layer = &net->layers[l];
+            size_t neuron_offset = layer->neuron_offset;
+            // Lists are only worth writing for a layer that gathers from them
+            pong_lists->valid = l + 1 < net->num_layers && uses_tiles(&net->layers[l + 1]);
+
+            if (l == 0 && layer->precision == PRECISION_Q07) {
+                for (int b = 0; b < count; b++) {
+                    sum_t *membrane = batch->membrane + (size_t)b * net->total_neurons + neuron_offset;
+                    Spike_Events emit = sample_lists(net, pong_lists, b);
+                    if (emit.valid) {
+                        memset(emit.count, 0, tau * sizeof(int));
+                    }
+                    int spikes = fire_layer(net, NULL, ping + b * sample_bytes, membrane, pong + b * sample_bytes,
+                                            layer, emit.valid ? &emit : NULL);
+#if (SNN_STATS)
+                    if (batch->stats) {
+                        record_layer_stats(net, batch->stats, chunk_index, layer, ping + b * sample_bytes,
+                                           pong + b * sample_bytes, spikes, 0, 0);
+                    }
+#endif
+                    (void)spikes;
+                }
+                uint8_t *temp = ping;
+                ping = pong;
+                pong = temp;
+                Spike_Events *temp_lists = ping_lists;
+                ping_lists = pong_lists;
+                pong_lists = temp_lists;
+                continue;
+            }
+            for (int b = 0; b < count; b++) {
+                if (l > 0) {
+                    accumulate_bias(net, batch->sums + b * sums_stride, layer);
+                } else {
+                    accumulate_input_layer(net, ping + b * sample_bytes, batch->sums + b * sums_stride, layer);
+                }
+            }
+            if (l > 0 && uses_tiles(layer)) {
+                accumulate_tiled_batch(net, batch, ping, ping_lists, sample_bytes, sums_stride, count, layer);
+            } else if (l > 0) {
+                accumulate_row_reuse_batch(net, batch, ping, sample_bytes, sums_stride, count, layer);
+            }
+            for (int b = 0; b < count; b++) {
+                sum_t *membrane = batch->membrane + (size_t)b * net->total_neurons + neuron_offset;
+                Spike_Events emit = sample_lists(net, pong_lists, b);
+                if (emit.valid) {
+                    memset(emit.count, 0, tau * sizeof(int));
+                }
+                int spikes = fire_layer(net, batch->sums + b * sums_stride, NULL, membrane, pong + b * sample_bytes,
+                                        layer, emit.valid ? &emit : NULL);
+#if (SNN_STATS)
+                if (batch->stats) {
+                    record_layer_stats(net, batch->stats, chunk_index, layer, ping + b * sample_bytes,
+                                       pong + b * sample_bytes, spikes, 0, 0);
+                }
 #endif
+                (void)spikes;
+            }
+
+            // Swap pointers
+            uint8_t *temp = ping;
+            ping = pong;
+            pong = temp;
+            Spike_Events *temp_lists = ping_lists;
+            ping_lists = pong_lists;
+            pong_lists = temp_lists;
+        }
+
+        for (int b = 0; b < count; b++) {
+            int *counts = batch->firing_counts + (size_t)b * num_outputs * num_chunks;
+            for (int i = 0; i < num_outputs; i++) {
+                for (int t = 0; t < tau; t++) {
+                    if (GET_BIT(SPIKE_ROW(ping + b * sample_bytes, t, stride), i)) {
+                        counts[i * num_chunks + chunk_index]++;
+                    }
+                }
+            }
+        }
+
+        int steps_left = net->time_window - chunk - tau;
+        for (int b = 0; b < count && steps_left > 0 && net->early_exit.mode != EARLY_EXIT_OFF;) {
+            point_slot_rows(batch, b, num_outputs, num_chunks);
+            if (!early_exit_check(&net->early_exit, batch->firing_rows, num_outputs, num_chunks, chunk_index + 1,
+                                  steps_left)) {
+                b++;
+                continue;
+            }
+            int sample = batch->slot_sample[b];
+            classifications[sample] = classify_inference(batch->firing_rows, num_outputs, num_chunks);
+            if (chunks_used) {
+                chunks_used[sample] = chunk_index + 1;
+            }
+            // Move the last running sample into the freed slot
+            if (b != --count) {
+                size_t counts_bytes = (size_t)num_outputs * num_chunks * sizeof(int);
+                memcpy(batch->membrane + (size_t)b * net->total_neurons,
+                       batch->membrane + (size_t)count * net->total_neurons, net->total_neurons * sizeof(sum_t));
+                memcpy(batch->firing_counts + (size_t)b * num_outputs * num_chunks,
+                       batch->firing_counts + (size_t)count * num_outputs * num_chunks, counts_bytes);
+                batch->slot_sample[b] = batch->slot_sample[count];
+                if (!spikes) {
+                    batch->encoders[b] = batch->encoders[count];
+                }
+            }
         }
     }
-}
 
-void zero_network() {
-    for (int l = 0; l < snn_network.num_layers; l++) {
-        for (int i = 0; i < snn_network.layers[l].num_neurons; i++) {
-            snn_network.layers[l].neurons[i].membrane_potential = 0;
-            snn_network.layers[l].neurons[i].delayed_reset = 0;
+    for (int b = 0; b < count; b++) {
+        int sample = batch->slot_sample[b];
+        point_slot_rows(batch, b, num_outputs, num_chunks);
+        classifications[sample] = classify_inference(batch->firing_rows, num_outputs, num_chunks);
+        if (chunks_used) {
+            chunks_used[sample] = num_chunks;
         }
     }
 }
 
+void batch_inference(Snn_Batch *batch, const uint8_t *spikes, int spike_bytes, int count,
+                     int *classifications, int *chunks_used) {
+    run_batch(batch, spikes, spike_bytes, NULL, 0, count, classifications, chunks_used);
+}
+
+void batch_inference_stream(Snn_Batch *batch, const Spike_Source *src, int first, int count,
+                            int *classifications, int *chunks_used) {
+    run_batch(batch, NULL, 0, src, first, count, classifications, chunks_used);
+}
+
+void initialize_network(int neurons_per_layer[],
+     const int8_t weights_fc1[INPUT_SIZE][HIDDEN_LAYER_1], const int8_t weights_fc2[HIDDEN_LAYER_1][NUM_CLASSES],
+     const int8_t *bias_fc1, const int8_t *bias_fc2) {
+    Snn_Layer_Desc layers[NUM_LAYERS] = {
+        { neurons_per_layer[0], NULL, NULL, NULL },
+        { neurons_per_layer[1], &weights_fc1[0][0], bias_fc1, NULL },
+        { neurons_per_layer[2], &weights_fc2[0][0], bias_fc2, NULL },
+    };
+    Snn_Network_Desc desc = { NUM_LAYERS, TAU, TIME_WINDOW, layers, 0, 0, INPUT_LIF, NULL, 0 };
+
+    destroy_network(&snn_network);
+    if (build_network(&snn_network, &desc)) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+void zero_network() {
+    reset_network(&snn_network);
+}
+
+void free_network() {
+    destroy_network(&snn_network);
+}
+
 int classify_inference(int **firing_counts, int num_neurons, int num_chunks){
     int max_firing_count = 0;
     int classification = -1;
@@ -213,58 +2116,182 @@ int classify_inference(int **firing_counts, int num_neurons, int num_chunks){
     return classification;
 }
 
-int inference(const uint8_t input[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES], int sample_idx){
-    zero_network();
-    static int firing_counts_data[NUM_CLASSES][TIME_WINDOW / TAU] = {0};
-    int* firing_counts[NUM_CLASSES];
-    for (int i = 0; i < NUM_CLASSES; i++) {
-        firing_counts[i] = firing_counts_data[i];
-        for (int j = 0; j < TIME_WINDOW / TAU; j++) {
-            firing_counts[i][j] = 0;
+int early_exit_check(const Early_Exit_Policy *policy, int **firing_counts, int num_neurons,
+                     int num_chunks, int chunks_run, int steps_left) {
+    if (policy->mode == EARLY_EXIT_OFF || chunks_run < policy->min_chunks) {
+        return 0;
+    }
+
+    // Leader exactly as classify_inference picks it: first highest nonzero total
+    int leader = -1;
+    int leader_total = 0;
+    int all_total = 0;
+    for (int i = 0; i < num_neurons; i++) {
+        int total = 0;
+        for (int j = 0; j < num_chunks; j++) {
+            total += firing_counts[i][j];
+        }
+        all_total += total;
+        if (total > leader_total) {
+            leader_total = total;
+            leader = i;
         }
     }
+    if (leader < 0) {
+        return 0;
+    }
+
+    // A rival can gain at most one spike per step left; an earlier neuron also wins a tie
+    int runner_up = 0;
+    int catchable = 0;
+    for (int i = 0; i < num_neurons; i++) {
+        if (i == leader) {
+            continue;
+        }
+        int total = 0;
+        for (int j = 0; j < num_chunks; j++) {
+            total += firing_counts[i][j];
+        }
+        if (total > runner_up) {
+            runner_up = total;
+        }
+        if (total + steps_left > leader_total || (total + steps_left == leader_total && i < leader)) {
+            catchable = 1;
+        }
+    }
+
+    switch (policy->mode) {
+    case EARLY_EXIT_MARGIN:
+        return !catchable || leader_total - runner_up >= policy->margin;
+    case EARLY_EXIT_CONFIDENCE:
+        return !catchable || leader_total * 100 >= policy->confidence_pct * all_total;
+    default:
+        return !catchable;
+    }
+}
 
-    // printf("Sparsity is the percentage of neurons that are firing in the layer\n");
-    for (int chunk = 0; chunk < TIME_WINDOW; chunk += TAU) {
-        int chunk_index = chunk / TAU;
-        for (int t = 0; t < TAU; t++) {
-            for (int i = 0; i < snn_network.layers[0].num_neurons; i++) {
-                int in_spike = get_input_spike(input, sample_idx, chunk + t, i);
-                // set_bit(ping_pong_buffer_1, i, t, in_spike);
-                SET_BIT(ping_pong_buffer_1[t], i, in_spike);
+static const char *early_exit_names[] = {"off", "decided", "margin", "confidence"};
+
+const char *early_exit_name(Early_Exit_Mode mode) {
+    return (mode >= EARLY_EXIT_OFF && mode <= EARLY_EXIT_CONFIDENCE) ? early_exit_names[mode] : "unknown";
+}
+
+int early_exit_parse(const char *text, Early_Exit_Policy *policy) {
+    const char *colon = strchr(text, ':');
+    size_t name_len = colon ? (size_t)(colon - text) : strlen(text);
+    for (int m = EARLY_EXIT_OFF; m <= EARLY_EXIT_CONFIDENCE; m++) {
+        if (strlen(early_exit_names[m]) != name_len || strncmp(text, early_exit_names[m], name_len) != 0) {
+            continue;
+        }
+        if (colon) {
+            char *end;
+            long value = strtol(colon + 1, &end, 10);
+            if (*end || end == colon + 1 || value < 1
+                || (m == EARLY_EXIT_CONFIDENCE && value > 100)
+                || (m != EARLY_EXIT_MARGIN && m != EARLY_EXIT_CONFIDENCE)) {
+                return 1;
+            }
+            if (m == EARLY_EXIT_MARGIN) {
+                policy->margin = (int)value;
+            } else {
+                policy->confidence_pct = (int)value;
             }
         }
-        for (int l = 0; l < snn_network.num_layers; l++) {
-            int input_size = (l == 0) ? snn_network.layers[l].num_neurons : snn_network.layers[l - 1].num_neurons;
+        policy->mode = (Early_Exit_Mode)m;
+        return 0;
+    }
+    return 1;
+}
 
-            // float layer_sparsity[TAU];
-            // compute_buffer_sparsity(ping_pong_buffer_1, input_size, layer_sparsity);
+// Input chunks come from spikes, or from enc when spikes is NULL
+static int run_inference(Snn_Context *ctx, const uint8_t *spikes, int spike_bytes, Spike_Encoder *enc) {
+    const Snn_Network *net = ctx->net;
+    reset_context(ctx);
 
-            // printf("Layer %d input sparsity:", l);
-            // for (int t = 0; t < TAU; t++) {
-            //     printf(" %.2f", layer_sparsity[t]);
-            // }
-            // printf("\n");
+    int tau = NET_TAU(net);
+    int stride = NET_SPIKE_BYTES(net);
+    int num_chunks = net->time_window / tau;
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int input_bytes = (net->layers[0].num_neurons + 7) / 8;
+    uint8_t *ping = ctx->ping_pong[0];
+    uint8_t *pong = ctx->ping_pong[1];
+    Spike_Events *ping_events = &ctx->events[0];
+    Spike_Events *pong_events = &ctx->events[1];
 
-            update_layer(ping_pong_buffer_1, ping_pong_buffer_2, &snn_network.layers[l], input_size);
+    memset(ctx->firing_counts, 0, (size_t)num_outputs * num_chunks * sizeof(int));
+
+    for (int chunk = 0; chunk < net->time_window; chunk += tau) {
+        int chunk_index = chunk / tau;
+        if (spikes) {
+            for (int t = 0; t < tau; t++) {
+                memcpy(SPIKE_ROW(ping, t, stride), spikes + (size_t)(chunk + t) * spike_bytes, input_bytes);
+            }
+        } else {
+            encoder_next_chunk(enc, ping, tau, stride);
+        }
+        // Encoder spikes arrive as a bitmask only
+        ping_events->valid = 0;
+        ctx->chunk_index = chunk_index;
+        for (int l = net->first_layer; l < net->num_layers; l++) {
+            process_layer(net, ctx, ping, pong, ping_events, pong_events, &net->layers[l]);
 
             // Swap pointers
-            uint8_t (*temp)[INPUT_BYTES] = ping_pong_buffer_1;
-            ping_pong_buffer_1 = ping_pong_buffer_2;
-            ping_pong_buffer_2 = temp;
+            uint8_t *temp = ping;
+            ping = pong;
+            pong = temp;
+            Spike_Events *temp_events = ping_events;
+            ping_events = pong_events;
+            pong_events = temp_events;
         }
 
-        for (int i = 0; i < snn_network.layers[snn_network.num_layers - 1].num_neurons; i++) {
-            for (int t = 0; t < TAU; t++) {
-                // if (get_bit(ping_pong_buffer_1, i, t)) {
-                if (GET_BIT(ping_pong_buffer_1[t], i)) {
-                    firing_counts[i][chunk_index]++;
+        for (int i = 0; i < num_outputs; i++) {
+            for (int t = 0; t < tau; t++) {
+                if (GET_BIT(SPIKE_ROW(ping, t, stride), i)) {
+                    ctx->firing_rows[i][chunk_index]++;
                 }
             }
         }
+
+        ctx->chunks_used = chunk_index + 1;
+        int steps_left = net->time_window - chunk - tau;
+        if (steps_left > 0 && early_exit_check(&net->early_exit, ctx->firing_rows, num_outputs, num_chunks,
+                                               chunk_index + 1, steps_left)) {
+            break;
+        }
     }
 
-    return classify_inference(firing_counts, snn_network.layers[snn_network.num_layers - 1].num_neurons, TIME_WINDOW / TAU);
+    // Chunks that never ran still hold zero counts
+    return classify_inference(ctx->firing_rows, num_outputs, num_chunks);
+}
+
+int context_inference(Snn_Context *ctx, const uint8_t *spikes, int spike_bytes) {
+    return run_inference(ctx, spikes, spike_bytes, NULL);
+}
+
+int context_inference_stream(Snn_Context *ctx, Spike_Encoder *enc) {
+    return run_inference(ctx, NULL, 0, enc);
+}
+
+int network_inference_stream(Snn_Network *net, Spike_Encoder *enc) {
+    Snn_Context view;
+    network_context_view(net, &view);
+    int classification = run_inference(&view, NULL, 0, enc);
+    net->chunks_used = view.chunks_used;
+    return classification;
+}
+
+int network_inference(Snn_Network *net, const uint8_t *spikes, int spike_bytes) {
+    Snn_Context view;
+    network_context_view(net, &view);
+    int classification = context_inference(&view, spikes, spike_bytes);
+    net->chunks_used = view.chunks_used;
+    return classification;
+}
+
+// The legacy spike tensor is [NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES], so the
+// global network must not be wider or longer than the define.h model.
+int inference(const uint8_t input[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES], int sample_idx){
+    return network_inference(&snn_network, &input[sample_idx][0][0], INPUT_BYTES);
 }
 
 void set_input_spike(uint8_t buffer[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES],
@@ -303,13 +2330,41 @@ float dequantize_q07(int32_t q) {
     return ((float)q) * Q07_INV_SCALE;
 }
 
-void compute_buffer_sparsity(const uint8_t buffer[TAU][INPUT_BYTES],
+void quantize_per_channel(const float *weights, const float *bias, int input_size, int num_neurons,
+                          int8_t *q_weights, int8_t *q_bias, float *scales) {
+    // Below this the folded threshold of a Q0.7 INT16_MAX threshold would pass MAX_FOLDED_THRESH
+    const float min_scale = (float)INT16_MAX / MAX_FOLDED_THRESH;
+    for (int i = 0; i < num_neurons; i++) {
+        float max_abs = fabsf(bias[i]);
+        for (int j = 0; j < input_size; j++) {
+            float w = fabsf(weights[(size_t)j * num_neurons + i]);
+            max_abs = w > max_abs ? w : max_abs;
+        }
+        float scale = max_abs > 0.0f ? max_abs * Q07_SCALE / Q07_MAX_INT8 : 1.0f;
+        scales[i] = scale > min_scale ? scale : min_scale;
+
+        // The largest magnitude lands on 127; the clamp only catches float rounding
+        float inv_step = Q07_SCALE / scales[i];
+        for (int j = 0; j <= input_size; j++) {
+            float x = j < input_size ? weights[(size_t)j * num_neurons + i] : bias[i];
+            long code = lrintf(x * inv_step);
+            code = code < -Q07_MAX_INT8 ? -Q07_MAX_INT8 : code > Q07_MAX_INT8 ? Q07_MAX_INT8 : code;
+            if (j < input_size) {
+                q_weights[(size_t)j * num_neurons + i] = (int8_t)code;
+            } else {
+                q_bias[i] = (int8_t)code;
+            }
+        }
+    }
+}
+
+void compute_buffer_sparsity(const uint8_t *buffer, int spike_bytes, int tau,
                              int num_neurons,
-                             float sparsity[TAU]) {
-    for (int t = 0; t < TAU; t++) {
+                             float *sparsity) {
+    for (int t = 0; t < tau; t++) {
         int active_spike_count = 0;
         for (int byte = 0; byte < (num_neurons + 7) / 8; byte++) {
-            uint8_t val = buffer[t][byte];
+            uint8_t val = SPIKE_ROW(buffer, t, spike_bytes)[byte];
             while (val) {
                 val &= (val - 1);  // Clear the least significant set bit
                 active_spike_count++;
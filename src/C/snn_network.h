@@ -2,48 +2,314 @@
 #define SNN_NETWORK_H
 
 #include "define.h"
+#include "rate_encoding.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// How update_layer walks the presynaptic spikes of a chunk
+typedef enum {
+    TRAVERSE_STEP_MAJOR = 0,  // rescan the input bitmask once per time step
+    TRAVERSE_ROW_REUSE,       // one pass per presynaptic neuron, row added to every step it fired in
+    TRAVERSE_TILED            // per step, each tile of sums stays in registers while the active inputs'
+                              // rows stream from a contiguous weight tile (int8 Q0.7 layers, else row reuse)
+} Traversal_Mode;
+
+// Arithmetic of one layer's synaptic sums and membranes (see DEFAULT_PRECISION)
+typedef enum {
+    PRECISION_Q07 = 0,  // int32 Q0.7 state, int8 weight rows
+    PRECISION_FLOAT32   // float32 state, weight rows and parameters dequantized from Q0.7
+} Layer_Precision;
+
+// How a layer stores its synaptic weight rows (see DEFAULT_WEIGHT_FORMAT). The
+// packed formats are converted from the int8 tables with one scale per layer;
+// their codes map to Q0.7 weights through weight_lut, so sums, thresholds and
+// membranes stay Q0.7 whatever the storage.
+typedef enum {
+    WEIGHTS_INT8 = 0,   // the int8 Q0.7 tables as given, one byte per weight
+    WEIGHTS_INT4,       // 4-bit codes, two per byte in groups of 32 neurons, code c -> weight_lut[c & 15]
+    WEIGHTS_TERNARY     // {-1, 0, +1} x scale as a positive and a negative bitplane per row
+} Weight_Format;
+
+// Width of a layer's per-step synaptic sums scratch (see INT16_SUMS). Chosen
+// from sum_bound whenever the layer's weights or precision change: int16 when
+// no step can leave int16, so the narrow sums are exact, int32 otherwise.
+typedef enum {
+    SUMS_INT32 = 0,
+    SUMS_INT16          // int8 Q0.7 layers only; packed and float32 layers stay int32. IF
+                        // popcount chunks total in int32 and spread into int16 rows too.
+} Sum_Width;
+
+// IF-only chunk accumulation from per-neuron spike counts (ignored for LIF builds
+// and float32 layers)
+typedef enum {
+    IF_POPCOUNT_OFF = 0,  // always use the layer traversal
+    IF_POPCOUNT_EXACT,    // APPROX for chunks proven to fire no neuron, else traversal
+    IF_POPCOUNT_APPROX    // one count-weighted row pass, total input spread evenly over TAU
+} If_Popcount_Mode;
+
+// What layer 0 does with the encoder spikes
+typedef enum {
+    INPUT_LIF = 0,  // layer 0 is an input LIF driven by +1 per input spike
+    INPUT_DIRECT    // encoder spikes are the layer-1 input, layer 0 is skipped
+} Input_Mode;
+
+// How a layer hands its spikes to the next one
+typedef enum {
+    SPIKES_DENSE = 0,  // packed [tau][spike_bytes] bitmask only
+    SPIKES_SPARSE,     // bitmask plus per-step lists of the neurons that fired
+    SPIKES_AUTO        // sparse while the last chunk was below SPARSE_DENSITY_PCT
+} Spike_Mode;
+
+// Address-event form of one chunk, written next to the dense bitmask: the
+// neurons that fired in each step, ascending. Consumers walk the lists
+// directly instead of scanning every byte of the bitmask.
+typedef struct {
+    uint16_t *index;        // [tau][event stride]
+    int *count;             // [tau]
+    int valid;              // 0 when the producer wrote the bitmask only
+} Spike_Events;
+
+// When a sample stops before time_window, checked after every chunk. Every
+// mode stops once the leading output cannot be caught in the steps left (an
+// output fires at most once per step), which never changes the result.
+typedef enum {
+    EARLY_EXIT_OFF = 0,     // always run every chunk
+    EARLY_EXIT_DECIDED,     // only when the leader can no longer be overtaken
+    EARLY_EXIT_MARGIN,      // also once the leader is margin spikes ahead of the runner-up
+    EARLY_EXIT_CONFIDENCE   // also once the leader holds confidence_pct of all output spikes
+} Early_Exit_Mode;
+
 typedef struct {
-#if (Q07_FLAG)
-    int32_t membrane_potential;
-    int32_t delayed_reset;
-    int16_t voltage_thresh;
-    int16_t decay_rate;
-#else
-    float membrane_potential;
-    float voltage_thresh;
-    float decay_rate;
-    float delayed_reset;
-#endif
-} Neuron;
+    Early_Exit_Mode mode;
+    int margin;             // EARLY_EXIT_MARGIN lead, in output spikes
+    int confidence_pct;     // EARLY_EXIT_CONFIDENCE share, 1..100
+    int min_chunks;         // chunks always run before a sample may stop
+} Early_Exit_Policy;
+
+struct Snn_Stats;
+
+// One 4-byte slot per neuron for membranes, thresholds, decay and synaptic
+// sums. PRECISION_Q07 layers keep int32 Q0.7 values in their slots and
+// PRECISION_FLOAT32 layers keep float32, so a layer changes precision
+// without changing any buffer layout.
+typedef int32_t sum_t;
+_Static_assert(sizeof(float) == sizeof(sum_t), "float32 state shares the sum_t slots");
 
 typedef struct {
-    Neuron *neurons;
-    int8_t **weights;
     int8_t *bias;
     int num_neurons;
+    int input_size;
+    int neuron_offset;      // first neuron of this layer in the neuron arrays, 64-byte aligned
     int layer_num;
+    Traversal_Mode traversal;
+    If_Popcount_Mode popcount_mode;
+    Spike_Mode spike_mode;  // representation of this layer's output spikes
+    Layer_Precision precision;
+    float *weights_f32;     // [input_size][f32_stride] dequantized rows, float32 layers only
+    float *bias_f32;        // [num_neurons] dequantized bias, float32 layers only
+    int f32_stride;         // floats per row, padded to 64 bytes
+    Weight_Format weight_format;
+    uint8_t *weights_packed; // [input_size][packed_stride] int4 or ternary rows, NULL for int8
+    int packed_stride;      // bytes per packed row; ternary rows are two planes of half that
+    int8_t weight_lut[16];  // Q0.7 weight of each int4 code; ternary uses [1] = +scale, [15] = -scale
+    float weight_scale;     // Q0.7 units per code step, as chosen by the converter
+    const float *channel_scale; // [num_neurons] weight steps folded into the thresholds, NULL for Q0.7
+    int32_t sum_bound;      // largest |bias| + sum of |w| over the neurons, bounds every step's sum
+    int32_t max_weight;     // largest w in the layer, bounds what one input spike adds (IF popcount)
+    Sum_Width sum_width;
+    int8_t *weights_tiled;  // [tiles][input_size][Q7_TILE_NEURONS] the only copy of the int8 weights, NULL for layer 0
 } Layer;
 
 typedef struct {
     Layer *layers;
     int num_layers;
+    int tau;                // time steps per chunk
+    int time_window;        // time steps per sample, a multiple of tau
+    int first_layer;        // first layer run per chunk, 1 for INPUT_DIRECT
+    int max_neurons;        // widest layer, row stride of the sums scratch
+    int spike_bytes;        // bytes per time step in the ping-pong buffers
+    Early_Exit_Policy early_exit; // shared by every engine on this network
+    int chunks_used;        // chunks the last single-sample inference ran
+
+    // Storage sized to the real layer widths by build_network
+    uint8_t *ping_pong[2];  // [tau][spike_bytes] each
+    sum_t *sums;            // [tau][max_neurons]
+    int32_t *chunk_sums;    // [max_neurons]
+    uint16_t *active;       // [max_neurons] inputs listed per step by TRAVERSE_TILED
+    int *firing_counts;     // [output neurons][time_window / tau]
+    int **firing_rows;
+    Spike_Events events[2]; // index lists paired with ping_pong[0] and [1]
+    int *layer_spikes;      // [num_layers] spikes each layer fired in its last chunk
+    struct Snn_Stats *stats; // counters for the single-sample path, NULL when off
+    // Neurons as separate arrays, layers back to back at neuron_offset
+    int total_neurons;      // array length, each layer padded to 64 bytes
+    sum_t *membrane;        // [total_neurons] state of the single-sample path
+    sum_t *voltage_thresh;  // [total_neurons] shared, read-only during inference
+    sum_t *decay_rate;      // [total_neurons]
+    void *storage;          // block holding everything above when build_network allocated it
+    int owns_storage;
 } Snn_Network;
 
+// Re-entrant inference state: one per thread. Owns neuron state, ping-pong
+// buffers and scratch; topology and weights are shared read-only through net.
+typedef struct {
+    const Snn_Network *net;
+    sum_t *membrane;        // [net->total_neurons], thresholds and decay stay in net
+    uint8_t *ping_pong[2];  // [tau][spike_bytes] each
+    sum_t *sums;            // [tau][max_neurons]
+    int32_t *chunk_sums;    // [max_neurons]
+    uint16_t *active;       // [max_neurons] inputs listed per step by TRAVERSE_TILED
+    int *firing_counts;     // [output neurons][time_window / tau]
+    int **firing_rows;
+    Spike_Events events[2]; // index lists paired with ping_pong[0] and [1]
+    int *layer_spikes;      // [num_layers] spike counts that drive SPIKES_AUTO
+    struct Snn_Stats *stats; // recorded into when built with SNN_STATS, NULL when off
+    int chunk_index;        // chunk of the sample being processed, for stats
+    int chunks_used;        // chunks the last inference ran before it stopped
+    void *storage;          // block holding every buffer above when create_context allocated it
+    int owns_storage;
+} Snn_Context;
+
+// Batched engine: B samples advance through each layer together so every
+// weight tile (or, for untiled layers, row) loaded serves all samples that
+// need it. Weights and neuron parameters are shared with the network.
+typedef struct {
+    const Snn_Network *net;
+    int batch_size;
+    sum_t *membrane;        // [batch][net->total_neurons]
+    uint8_t *ping_pong[2];  // [batch][tau][spike_bytes] each
+    sum_t *sums;            // [batch][tau][max_neurons]
+    int *firing_counts;     // [batch][output neurons][time_window / tau]
+    int **firing_rows;      // [output neurons], re-pointed per sample
+    uint32_t *events;       // sums-row offsets of every firing (sample, step), grouped by input neuron
+    int *event_neuron;      // presynaptic neuron of each group
+    uint32_t *event_start;  // first event of each group, plus one end marker
+    Spike_Events lists[2];  // [batch][tau] index lists paired with ping_pong[0] and [1], for TRAVERSE_TILED layers
+    int *slot_sample;       // [batch] sample in each slot; finished samples leave the batch
+    Spike_Encoder *encoders; // [batch] stream of the sample in each slot, for batch_inference_stream
+    struct Snn_Stats *stats; // recorded into when built with SNN_STATS, NULL when off
+} Snn_Batch;
+
+// Network descriptor: everything build_network needs to size and wire a model
+typedef struct {
+    int num_neurons;
+    const int8_t *weights;  // [input_size][num_neurons] Q0.7, NULL for the input layer
+    const int8_t *bias;     // [num_neurons] Q0.7, NULL for the input layer
+    const float *scales;    // [num_neurons] per-neuron weight step in Q0.7 steps, NULL for all 1
+} Snn_Layer_Desc;
+
+typedef struct {
+    int num_layers;
+    int tau;
+    int time_window;
+    Snn_Layer_Desc *layers;
+    int voltage_thresh;     // Q0.7 firing threshold, 0 selects VOLTAGE_THRESH
+    int decay_rate;         // Q0.7 LIF leak factor, 0 selects DECAY_RATE
+    Input_Mode input_mode;
+    void *mapping;          // model file mapping the layer blobs point into, if any
+    size_t mapping_bytes;
+} Snn_Network_Desc;
+
+// Bytes of a network's storage by role, sized from the topology alone. Every
+// buffer starts on a 64-byte line; biases and scales stay in the descriptor.
+typedef struct {
+    size_t tables;          // layer table, firing counts and per-layer counters
+    size_t neuron_state;    // membranes, thresholds and decay, each layer padded to a line
+    size_t spikes;          // ping-pong bitmasks and their index lists
+    size_t scratch;         // per-step synaptic sums, IF chunk sums and the tiled active list
+    size_t weight_tiles;    // int8 weight tiles of every layer
+    size_t total;
+} Snn_Memory_Plan;
+
+// Build a network of any depth/width from a descriptor. Weights are copied into
+// the network's tiles; bias and scale memory stays owned by the descriptor and
+// must outlive the network. Returns 0 on
+// success, 1 if the descriptor is invalid (or does not fit a fixed-topology build).
+int build_network(Snn_Network *net, const Snn_Network_Desc *desc);
+// Exact storage a descriptor needs (build_network allocates plan.total in one
+// block). Returns 0 on success, 1 if build_network would reject the descriptor.
+int plan_network_memory(const Snn_Network_Desc *desc, Snn_Memory_Plan *plan);
+// build_network inside a caller-owned arena: 64-byte aligned, at least
+// plan.total bytes, outliving the network. Only later layer conversions
+// (precision, weight format, traversal) allocate; destroy_network leaves the
+// arena alone.
+int build_network_in(Snn_Network *net, const Snn_Network_Desc *desc, void *arena, size_t arena_bytes);
+void reset_network(Snn_Network *net);
+void destroy_network(Snn_Network *net);
+// Switches one layer between Q0.7 and float32: converts its threshold and
+// decay slots and builds or frees its float32 weight rows. Call between
+// inferences, before contexts, batches, pools or pipelines run. Returns 0 on success.
+int set_layer_precision(Snn_Network *net, int layer_index, Layer_Precision precision);
+// Sets how one layer walks its input spikes. Every mode reads the same weight
+// tiles, so nothing is allocated. Same calling rules as set_layer_precision.
+// Returns 0 on success.
+int set_layer_traversal(Snn_Network *net, int layer_index, Traversal_Mode traversal);
+// "q07" or "float32" for every layer, or a comma-separated list with one per layer
+int precision_parse(const char *text, Layer_Precision *precisions, int num_layers);
+const char *precision_name(Layer_Precision precision);
+// Repacks one layer's weight rows from its int8 tiles: int8 drops the packed
+// rows, int4 and ternary pick a per-layer scale by least squared error against
+// the int8 weights and pack with it. Layer 0 has no weights and stays int8.
+// Same calling rules as set_layer_precision. Returns 0 on success.
+int set_layer_weight_format(Snn_Network *net, int layer_index, Weight_Format format);
+// "int8", "int4" or "ternary" for every layer, or a comma-separated list with one per layer
+int weight_format_parse(const char *text, Weight_Format *formats, int num_layers);
+const char *weight_format_name(Weight_Format format);
+// Q0.7 weight from presynaptic neuron j to neuron i, whatever the storage format
+int8_t layer_weight(const Layer *layer, int j, int i);
+
+// Layer 0 input is [time_window][spike_bytes] packed bits for one sample
+int network_inference(Snn_Network *net, const uint8_t *spikes, int spike_bytes);
+
+int create_context(Snn_Context *ctx, const Snn_Network *net);
+// Bytes one context of net needs; create_context allocates them in one block
+size_t context_memory_size(const Snn_Network *net);
+// create_context inside a caller-owned, 64-byte aligned arena of at least
+// context_memory_size(net) bytes
+int create_context_in(Snn_Context *ctx, const Snn_Network *net, void *arena, size_t arena_bytes);
+void reset_context(Snn_Context *ctx);
+void destroy_context(Snn_Context *ctx);
+int context_inference(Snn_Context *ctx, const uint8_t *spikes, int spike_bytes);
+// Same, but each chunk of layer-0 input is generated by enc straight into the
+// ping buffer; the caller has already started the sample with encoder_begin
+int context_inference_stream(Snn_Context *ctx, Spike_Encoder *enc);
+int network_inference_stream(Snn_Network *net, Spike_Encoder *enc);
+// One chunk of one layer on a context; buffers are [tau][net->spike_bytes].
+// When both are the context's own ping_pong buffers, the layer also hands
+// spikes on as index lists like the whole-sample path does.
+void context_update_layer(Snn_Context *ctx, const uint8_t *input, uint8_t *output, int layer_index);
+
+int create_batch(Snn_Batch *batch, const Snn_Network *net, int batch_size);
+void destroy_batch(Snn_Batch *batch);
+// Runs count <= batch_size samples laid out back to back as [time_window][spike_bytes].
+// Always accumulates exactly, so IF_POPCOUNT_APPROX layers are not approximated here.
+// chunks_used, if not NULL, receives the chunks each sample ran.
+void batch_inference(Snn_Batch *batch, const uint8_t *spikes, int spike_bytes, int count,
+                     int *classifications, int *chunks_used);
+// Same for samples first .. first + count - 1 of src, each slot encoding its
+// sample chunk by chunk; classifications[b] is sample first + b
+void batch_inference_stream(Snn_Batch *batch, const Spike_Source *src, int first, int count,
+                            int *classifications, int *chunks_used);
+
+void update_layer(Snn_Network *net, const uint8_t *input, uint8_t *output, Layer *layer);
+
+// Fixed MNIST model wrappers over the global snn_network
 void initialize_network(int neurons_per_layer[],const int8_t weights_fc1[INPUT_SIZE][HIDDEN_LAYER_1],
     const int8_t weights_fc2[HIDDEN_LAYER_1][NUM_CLASSES],const int8_t *bias_fc1, const int8_t *bias_fc2);
 void zero_network();
 void free_network();
 
-void update_layer(const uint8_t input[TAU][INPUT_BYTES],
-                  uint8_t output[TAU][INPUT_BYTES],
-                  Layer *layer, int input_size);
-
 int inference(const uint8_t input[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES], int sample_idx);
 int classify_inference(int **firing_counts, int num_neurons, int num_chunks);
+// 1 when policy lets a sample stop after chunks_run chunks, with steps_left time
+// steps still to go. Totals are summed over num_chunks columns of firing_counts.
+int early_exit_check(const Early_Exit_Policy *policy, int **firing_counts, int num_neurons,
+                     int num_chunks, int chunks_run, int steps_left);
+// "off", "decided", "margin[:N]" or "confidence[:P]"; returns 0 on success
+int early_exit_parse(const char *text, Early_Exit_Policy *policy);
+const char *early_exit_name(Early_Exit_Mode mode);
 
 int get_input_spike(const uint8_t buffer[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES],
                     int sample, int t, int neuron_idx);
@@ -52,8 +318,14 @@ void set_input_spike(uint8_t buffer[NUM_SAMPLES][TIME_WINDOW][INPUT_BYTES],
 
 int8_t quantize_q07(float x); 
 float dequantize_q07(int32_t q);
+// Per-output-channel quantization of one float layer ([input_size][num_neurons]
+// weights, [num_neurons] bias): neuron i gets scales[i] so that its largest
+// magnitude maps to 127, and real value = code * scales[i] / Q07_SCALE. Nothing
+// clips, whatever the range; build_network folds the scales into thresholds.
+void quantize_per_channel(const float *weights, const float *bias, int input_size, int num_neurons,
+                          int8_t *q_weights, int8_t *q_bias, float *scales);
 
-void compute_buffer_sparsity(const uint8_t buffer[TAU][INPUT_BYTES],
+void compute_buffer_sparsity(const uint8_t *buffer, int spike_bytes, int tau,
                              int num_neurons,
-                             float sparsity[TAU]);
+                             float *sparsity);
 #endif // NETWORK_H
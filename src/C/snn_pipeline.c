@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "snn_pipeline.h"
+
+// Chunk header padded to a cache line so the spikes behind it stay aligned
+#define CHUNK_HEADER_BYTES 64
+
+static int ring_init(Spike_Ring *ring, size_t slot_bytes) {
+    ring->slot_bytes = (slot_bytes + 63) & ~(size_t)63;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->slots = aligned_alloc(64, PIPELINE_RING_SLOTS * ring->slot_bytes);
+    return ring->slots == NULL;
+}
+
+// Producer: next free slot, or NULL if the ring is full
+static uint8_t *ring_reserve(Spike_Ring *ring) {
+    unsigned tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (ring->head - tail == PIPELINE_RING_SLOTS) {
+        return NULL;
+    }
+    return ring->slots + (ring->head % PIPELINE_RING_SLOTS) * ring->slot_bytes;
+}
+
+static void ring_commit(Spike_Ring *ring) {
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Consumer: oldest filled slot, or NULL if the ring is empty
+static uint8_t *ring_peek(Spike_Ring *ring) {
+    unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == ring->tail) {
+        return NULL;
+    }
+    return ring->slots + (ring->tail % PIPELINE_RING_SLOTS) * ring->slot_bytes;
+}
+
+static void ring_release(Spike_Ring *ring) {
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+static uint8_t *ring_wait_reserve(Spike_Ring *ring) {
+    uint8_t *slot;
+    while (!(slot = ring_reserve(ring))) {
+        sched_yield();
+    }
+    return slot;
+}
+
+static uint8_t *ring_wait_peek(Spike_Ring *ring) {
+    uint8_t *slot;
+    while (!(slot = ring_peek(ring))) {
+        sched_yield();
+    }
+    return slot;
+}
+
+static void emit_result(Pipeline_Stage *stage, const Chunk_Header *hdr, const uint8_t *output) {
+    const Snn_Network *net = stage->pipe->net;
+    Snn_Context *ctx = &stage->ctx;
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+
+    // Streams may outlast the time window, so counts accumulate in one column
+    for (int i = 0; i < num_outputs; i++) {
+        for (int t = 0; t < net->tau; t++) {
+            const uint8_t *row = output + (size_t)t * net->spike_bytes;
+            if (GET_BIT(row, i)) {
+                ctx->firing_rows[i][0]++;
+            }
+        }
+    }
+
+    int steps_left = (net->time_window / net->tau - 1 - hdr->chunk_index) * net->tau;
+    Chunk_Result *result = (Chunk_Result *)ring_wait_reserve(&stage->pipe->results);
+    result->sample_id = hdr->sample_id;
+    result->chunk_index = hdr->chunk_index;
+    result->last_chunk = hdr->last_chunk;
+    result->classification = classify_inference(ctx->firing_rows, num_outputs, 1);
+    result->decided = steps_left > 0 && early_exit_check(&net->early_exit, ctx->firing_rows, num_outputs, 1,
+                                                         hdr->chunk_index + 1, steps_left);
+    ring_commit(&stage->pipe->results);
+}
+
+static void *stage_main(void *arg) {
+    Pipeline_Stage *stage = (Pipeline_Stage *)arg;
+    const Snn_Network *net = stage->pipe->net;
+    Snn_Context *ctx = &stage->ctx;
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+
+    while (1) {
+        uint8_t *slot = ring_wait_peek(stage->in);
+        Chunk_Header hdr = *(const Chunk_Header *)slot;
+
+        if (hdr.shutdown) {
+            if (stage->out) {
+                *(Chunk_Header *)ring_wait_reserve(stage->out) = hdr;
+                ring_commit(stage->out);
+            } else {
+                // Marker result telling destroy_pipeline the stream is drained
+                Chunk_Result *result = (Chunk_Result *)ring_wait_reserve(&stage->pipe->results);
+                memset(result, 0, sizeof(*result));
+                result->sample_id = -1;
+                ring_commit(&stage->pipe->results);
+            }
+            ring_release(stage->in);
+            break;
+        }
+
+        if (hdr.chunk_index == 0) {
+            reset_context(ctx);
+            for (int i = 0; i < num_outputs; i++) {
+                ctx->firing_rows[i][0] = 0;
+            }
+        }
+
+        ctx->chunk_index = hdr.chunk_index;
+        uint8_t *out_slot = stage->out ? ring_wait_reserve(stage->out) : NULL;
+        const uint8_t *input = slot + CHUNK_HEADER_BYTES;
+        for (int l = stage->first_layer; l <= stage->last_layer; l++) {
+            uint8_t *output = (l == stage->last_layer && out_slot) ? out_slot + CHUNK_HEADER_BYTES
+                                                                   : ctx->ping_pong[(l - stage->first_layer) & 1];
+            context_update_layer(ctx, input, output, l);
+            input = output;
+        }
+        ring_release(stage->in);
+
+        if (out_slot) {
+            *(Chunk_Header *)out_slot = hdr;
+            ring_commit(stage->out);
+        } else {
+            emit_result(stage, &hdr, input);
+        }
+    }
+    return NULL;
+}
+
+int create_pipeline(Snn_Pipeline *pipe, const Snn_Network *net, int num_stages) {
+    memset(pipe, 0, sizeof(*pipe));
+    if (num_stages < 1) {
+        num_stages = 1;
+    }
+    int run_layers = net->num_layers - net->first_layer;
+    if (num_stages > run_layers) {
+        num_stages = run_layers;
+    }
+
+    size_t chunk_bytes = CHUNK_HEADER_BYTES + (size_t)net->tau * net->spike_bytes;
+    pipe->net = net;
+    pipe->stages = calloc(num_stages, sizeof(Pipeline_Stage));
+    pipe->rings = calloc(num_stages, sizeof(Spike_Ring));
+    if (!pipe->stages || !pipe->rings || ring_init(&pipe->results, sizeof(Chunk_Result))) {
+        perror("Failed to allocate pipeline");
+        destroy_pipeline(pipe);
+        return 1;
+    }
+    for (int s = 0; s < num_stages; s++) {
+        if (ring_init(&pipe->rings[s], chunk_bytes)) {
+            perror("Failed to allocate pipeline");
+            destroy_pipeline(pipe);
+            return 1;
+        }
+        pipe->num_rings++;
+    }
+
+    for (int s = 0; s < num_stages; s++) {
+        Pipeline_Stage *stage = &pipe->stages[s];
+        stage->pipe = pipe;
+        stage->first_layer = net->first_layer + s * run_layers / num_stages;
+        stage->last_layer = net->first_layer + (s + 1) * run_layers / num_stages - 1;
+        stage->in = &pipe->rings[s];
+        stage->out = (s + 1 < num_stages) ? &pipe->rings[s + 1] : NULL;
+        if (create_context(&stage->ctx, net)) {
+            while (--s >= 0) {
+                destroy_context(&pipe->stages[s].ctx);
+            }
+            destroy_pipeline(pipe);
+            return 1;
+        }
+    }
+    pipe->num_stages = num_stages;
+
+    // Start from the last stage so a failure leaves a running tail that the
+    // shutdown message can still drain
+    for (int s = num_stages - 1; s >= 0; s--) {
+        if (pthread_create(&pipe->stages[s].thread, NULL, stage_main, &pipe->stages[s]) != 0) {
+            fprintf(stderr, "Error: failed to start pipeline stage %d\n", s);
+            destroy_pipeline(pipe);
+            return 1;
+        }
+        pipe->num_running++;
+    }
+    return 0;
+}
+
+// Producer: heads the next free input slot and returns its spike rows, or
+// NULL if the ring is full. The caller fills the rows and commits the slot.
+static uint8_t *try_reserve_chunk(Snn_Pipeline *pipe, int sample_id, int chunk_index, int last_chunk) {
+    uint8_t *slot = ring_reserve(&pipe->rings[0]);
+    if (!slot) {
+        return NULL;
+    }
+
+    Chunk_Header *hdr = (Chunk_Header *)slot;
+    hdr->sample_id = sample_id;
+    hdr->chunk_index = chunk_index;
+    hdr->last_chunk = last_chunk;
+    hdr->shutdown = 0;
+    return slot + CHUNK_HEADER_BYTES;
+}
+
+static void copy_chunk(const Snn_Network *net, uint8_t *rows, const uint8_t *chunk, int spike_bytes) {
+    int input_bytes = (net->layers[0].num_neurons + 7) / 8;
+    for (int t = 0; t < net->tau; t++) {
+        memcpy(rows + (size_t)t * net->spike_bytes, chunk + (size_t)t * spike_bytes, input_bytes);
+    }
+}
+
+static int try_push_chunk(Snn_Pipeline *pipe, const uint8_t *chunk, int spike_bytes,
+                          int sample_id, int chunk_index, int last_chunk) {
+    uint8_t *rows = try_reserve_chunk(pipe, sample_id, chunk_index, last_chunk);
+    if (!rows) {
+        return 0;
+    }
+    copy_chunk(pipe->net, rows, chunk, spike_bytes);
+    ring_commit(&pipe->rings[0]);
+    return 1;
+}
+
+void pipeline_push_chunk(Snn_Pipeline *pipe, const uint8_t *chunk, int spike_bytes,
+                         int sample_id, int chunk_index, int last_chunk) {
+    while (!try_push_chunk(pipe, chunk, spike_bytes, sample_id, chunk_index, last_chunk)) {
+        sched_yield();
+    }
+}
+
+int pipeline_try_pop_result(Snn_Pipeline *pipe, Chunk_Result *result) {
+    uint8_t *slot = ring_peek(&pipe->results);
+    if (!slot) {
+        return 0;
+    }
+    *result = *(const Chunk_Result *)slot;
+    ring_release(&pipe->results);
+    return 1;
+}
+
+void pipeline_pop_result(Snn_Pipeline *pipe, Chunk_Result *result) {
+    *result = *(const Chunk_Result *)ring_wait_peek(&pipe->results);
+    ring_release(&pipe->results);
+}
+
+// Takes the first final or decided result of each sample
+static void collect_result(const Chunk_Result *result, uint8_t *done, int *classifications, int *chunks_used) {
+    if ((!result->last_chunk && !result->decided) || done[result->sample_id]) {
+        return;
+    }
+    done[result->sample_id] = 1;
+    classifications[result->sample_id] = result->classification;
+    if (chunks_used) {
+        chunks_used[result->sample_id] = result->chunk_index + 1;
+    }
+}
+
+// Input chunks come from spikes, or from an encoder over src when spikes is NULL
+static void run_pipeline(Snn_Pipeline *pipe, const uint8_t *spikes, int spike_bytes, const Spike_Source *src,
+                         int num_samples, int *classifications, int *chunks_used) {
+    const Snn_Network *net = pipe->net;
+    int num_chunks = net->time_window / net->tau;
+    size_t sample_stride = (size_t)net->time_window * spike_bytes;
+    Spike_Encoder encoder;
+    int pushed = 0;
+    int popped = 0;
+    Chunk_Result result;
+    uint8_t *done = calloc(num_samples, 1);
+    if (!done) {
+        perror("Failed to allocate pipeline results");
+        exit(EXIT_FAILURE);
+    }
+
+    // The caller is both producer and consumer, so drain results whenever the
+    // input ring is full instead of blocking on it. Chunks already queued for a
+    // sample that was decided early still run; every result is drained so none
+    // is left behind for the next call.
+    for (int d = 0; d < num_samples; d++) {
+        if (!spikes) {
+            source_begin(src, &encoder, d);
+        }
+        for (int c = 0; c < num_chunks && !done[d]; c++) {
+            uint8_t *rows;
+            while (!(rows = try_reserve_chunk(pipe, d, c, c == num_chunks - 1))) {
+                if (pipeline_try_pop_result(pipe, &result)) {
+                    popped++;
+                    collect_result(&result, done, classifications, chunks_used);
+                } else {
+                    sched_yield();
+                }
+            }
+            if (spikes) {
+                copy_chunk(net, rows, spikes + d * sample_stride + (size_t)c * net->tau * spike_bytes, spike_bytes);
+            } else {
+                encoder_next_chunk(&encoder, rows, net->tau, net->spike_bytes);
+            }
+            ring_commit(&pipe->rings[0]);
+            pushed++;
+        }
+    }
+    while (popped < pushed) {
+        pipeline_pop_result(pipe, &result);
+        popped++;
+        collect_result(&result, done, classifications, chunks_used);
+    }
+    free(done);
+}
+
+void pipeline_inference(Snn_Pipeline *pipe, const uint8_t *spikes, int spike_bytes, int num_samples,
+                        int *classifications, int *chunks_used) {
+    run_pipeline(pipe, spikes, spike_bytes, NULL, num_samples, classifications, chunks_used);
+}
+
+void pipeline_inference_stream(Snn_Pipeline *pipe, const Spike_Source *src, int num_samples,
+                               int *classifications, int *chunks_used) {
+    run_pipeline(pipe, NULL, 0, src, num_samples, classifications, chunks_used);
+}
+
+void destroy_pipeline(Snn_Pipeline *pipe) {
+    if (pipe->num_running > 0) {
+        // Shutdown travels through every running stage; drop any results still queued
+        Spike_Ring *entry = pipe->stages[pipe->num_stages - pipe->num_running].in;
+        Chunk_Header *hdr;
+        while (!(hdr = (Chunk_Header *)ring_reserve(entry))) {
+            Chunk_Result pending;
+            if (!pipeline_try_pop_result(pipe, &pending)) {
+                sched_yield();
+            }
+        }
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->shutdown = 1;
+        ring_commit(entry);
+
+        Chunk_Result result;
+        do {
+            pipeline_pop_result(pipe, &result);
+        } while (result.sample_id >= 0);
+        for (int s = pipe->num_stages - pipe->num_running; s < pipe->num_stages; s++) {
+            pthread_join(pipe->stages[s].thread, NULL);
+        }
+    }
+    for (int s = 0; s < pipe->num_stages; s++) {
+        destroy_context(&pipe->stages[s].ctx);
+    }
+    for (int s = 0; s < pipe->num_rings; s++) {
+        free(pipe->rings[s].slots);
+    }
+    free(pipe->results.slots);
+    free(pipe->stages);
+    free(pipe->rings);
+    memset(pipe, 0, sizeof(*pipe));
+}
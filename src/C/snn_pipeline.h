@@ -0,0 +1,86 @@
+#ifndef SNN_PIPELINE_H
+#define SNN_PIPELINE_H
+
+#include <pthread.h>
+#include "snn_network.h"
+
+// Chunks in flight between two stages
+#define PIPELINE_RING_SLOTS 8
+
+// Single-producer/single-consumer ring of fixed-size slots. head is only
+// written by the producer and tail only by the consumer.
+typedef struct {
+    uint8_t *slots;         // [PIPELINE_RING_SLOTS][slot_bytes]
+    size_t slot_bytes;
+    unsigned head;
+    unsigned tail;
+} Spike_Ring;
+
+// Header at the front of every chunk slot, followed by [tau][spike_bytes] spikes
+typedef struct {
+    int sample_id;
+    int chunk_index;
+    int last_chunk;
+    int shutdown;
+} Chunk_Header;
+
+// One entry per chunk leaving the last stage. A sample_id of -1 marks the
+// end of the stream after shutdown.
+typedef struct {
+    int sample_id;
+    int chunk_index;
+    int last_chunk;
+    int classification;     // running argmax of the output firing counts so far
+    int decided;            // the network's early-exit policy lets the sample stop here
+} Chunk_Result;
+
+struct Snn_Pipeline;
+
+typedef struct {
+    struct Snn_Pipeline *pipe;
+    pthread_t thread;
+    int first_layer;
+    int last_layer;         // inclusive
+    Snn_Context ctx;        // neuron state of this stage's layers plus scratch
+    Spike_Ring *in;
+    Spike_Ring *out;        // NULL for the last stage
+} Pipeline_Stage;
+
+// Streaming execution: each stage runs a contiguous group of layers on its
+// own thread, so chunk k+1 of an early layer overlaps chunk k of a later one
+// and samples flow through back to back.
+typedef struct Snn_Pipeline {
+    const Snn_Network *net;
+    int num_stages;
+    int num_running;        // stage threads started, counted from the last stage
+    Pipeline_Stage *stages;
+    Spike_Ring *rings;      // [num_stages], ring s feeds stage s
+    int num_rings;
+    Spike_Ring results;     // Chunk_Result slots from the last stage
+} Snn_Pipeline;
+
+// Splits the layers into num_stages contiguous groups (at most one stage per layer)
+int create_pipeline(Snn_Pipeline *pipe, const Snn_Network *net, int num_stages);
+void destroy_pipeline(Snn_Pipeline *pipe);
+
+// Producer side: one chunk of layer-0 input, [tau][spike_bytes] packed bits.
+// Blocks while the first ring is full.
+void pipeline_push_chunk(Snn_Pipeline *pipe, const uint8_t *chunk, int spike_bytes,
+                         int sample_id, int chunk_index, int last_chunk);
+// Consumer side: blocks until the next chunk result is available
+void pipeline_pop_result(Snn_Pipeline *pipe, Chunk_Result *result);
+// Non-blocking variant, returns 1 if a result was popped
+int pipeline_try_pop_result(Snn_Pipeline *pipe, Chunk_Result *result);
+
+// Streams num_samples samples ([time_window][spike_bytes] each) through the
+// pipeline and collects the final classification of each. A sample is taken
+// at its first decided result and its remaining chunks are no longer fed in;
+// chunks_used, if not NULL, receives the chunk count that decided each one.
+void pipeline_inference(Snn_Pipeline *pipe, const uint8_t *spikes, int spike_bytes, int num_samples,
+                        int *classifications, int *chunks_used);
+// Same for samples 0 .. num_samples - 1 of src; the producer encodes each
+// chunk straight into its input ring slot
+void pipeline_inference_stream(Snn_Pipeline *pipe, const Spike_Source *src, int num_samples,
+                               int *classifications, int *chunks_used);
+
+#endif // SNN_PIPELINE_H
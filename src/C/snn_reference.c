@@ -0,0 +1,162 @@
+#include "snn_reference.h"
+#include "define.h"
+#include <math.h>
+
+// Spike rows and membranes are laid out exactly like the engines' so tests
+// can compare them directly; everything else here is kept naive on purpose.
+#define REF_ROW(buf, t, stride) ((buf) + (size_t)(t) * (stride))
+
+int create_reference(Snn_Reference *ref, const Snn_Network *net) {
+    memset(ref, 0, sizeof(*ref));
+
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_chunks = net->time_window / net->tau;
+
+    ref->net = net;
+    ref->membrane = calloc(net->total_neurons, sizeof(sum_t));
+    ref->trains = calloc((size_t)net->num_layers * net->time_window * net->spike_bytes, 1);
+    ref->firing_counts = calloc((size_t)num_outputs * num_chunks, sizeof(int));
+    ref->firing_rows = calloc(num_outputs, sizeof(int *));
+    if (!ref->membrane || !ref->trains || !ref->firing_counts || !ref->firing_rows) {
+        perror("Failed to allocate reference engine");
+        destroy_reference(ref);
+        return 1;
+    }
+    for (int i = 0; i < num_outputs; i++) {
+        ref->firing_rows[i] = ref->firing_counts + (size_t)i * num_chunks;
+    }
+    return 0;
+}
+
+void reset_reference(Snn_Reference *ref) {
+    memset(ref->membrane, 0, ref->net->total_neurons * sizeof(sum_t));
+}
+
+void destroy_reference(Snn_Reference *ref) {
+    free(ref->membrane);
+    free(ref->trains);
+    free(ref->firing_counts);
+    free(ref->firing_rows);
+    memset(ref, 0, sizeof(*ref));
+}
+
+// Synaptic input of neuron i in one step, Q0.7
+static int32_t reference_input_q07(const Layer *layer, const uint8_t *row, int i) {
+    if (layer->layer_num == 0) {
+        return GET_BIT(row, i) ? (1 << DECAY_SHIFT) : 0;
+    }
+    int32_t sum = layer->bias[i];
+    for (int j = 0; j < layer->input_size; j++) {
+        if (GET_BIT(row, j)) {
+            sum += layer_weight(layer, j, i);
+        }
+    }
+    return sum;
+}
+
+// The same in float32, from the Q0.7 weights dequantized one at a time
+static float reference_input_f32(const Layer *layer, const uint8_t *row, int i) {
+    if (layer->layer_num == 0) {
+        return GET_BIT(row, i) ? 1.0f : 0.0f;
+    }
+    float sum = dequantize_q07(layer->bias[i]);
+    for (int j = 0; j < layer->input_size; j++) {
+        if (GET_BIT(row, j)) {
+            sum += dequantize_q07(layer_weight(layer, j, i));
+        }
+    }
+    return sum;
+}
+
+void reference_update_layer(Snn_Reference *ref, const uint8_t *input, uint8_t *output, int layer_index) {
+    const Snn_Network *net = ref->net;
+    const Layer *layer = &net->layers[layer_index];
+    sum_t *membrane = ref->membrane + layer->neuron_offset;
+    const sum_t *thresh = net->voltage_thresh + layer->neuron_offset;
+    const sum_t *decay = net->decay_rate + layer->neuron_offset;
+    int stride = net->spike_bytes;
+
+    for (int t = 0; t < net->tau; t++) {
+        const uint8_t *in = REF_ROW(input, t, stride);
+        uint8_t *out = REF_ROW(output, t, stride);
+        memset(out, 0, stride);
+
+        for (int i = 0; i < layer->num_neurons; i++) {
+            int spike;
+            if (layer->precision == PRECISION_FLOAT32) {
+                float m;
+                float th;
+                float d;
+                memcpy(&m, &membrane[i], sizeof(float));
+                memcpy(&th, &thresh[i], sizeof(float));
+                memcpy(&d, &decay[i], sizeof(float));
+                float sum = reference_input_f32(layer, in, i);
+                spike = HEAVISIDE(m, th);
+#if (LIF)
+                m = fmaf(d, m, sum);
+#else
+                m = m + sum;
+#endif
+                if (spike) {
+                    m = m - th;
+                }
+                memcpy(&membrane[i], &m, sizeof(float));
+            } else {
+                int32_t sum = reference_input_q07(layer, in, i);
+                spike = HEAVISIDE(membrane[i], thresh[i]);
+#if (LIF)
+                membrane[i] = ((decay[i] * membrane[i]) >> DECAY_SHIFT) + sum - spike * thresh[i];
+#else
+                membrane[i] = membrane[i] + sum - spike * thresh[i];
+#endif
+            }
+            SET_BIT(out, i, spike);
+        }
+    }
+    (void)decay;
+}
+
+const uint8_t *reference_train(const Snn_Reference *ref, int layer_index) {
+    return ref->trains + (size_t)layer_index * ref->net->time_window * ref->net->spike_bytes;
+}
+
+int reference_inference(Snn_Reference *ref, const uint8_t *spikes, int spike_bytes) {
+    const Snn_Network *net = ref->net;
+    int tau = net->tau;
+    int stride = net->spike_bytes;
+    int num_chunks = net->time_window / tau;
+    int last = net->num_layers - 1;
+    int num_outputs = net->layers[last].num_neurons;
+    int input_bytes = (net->layers[0].num_neurons + 7) / 8;
+    size_t chunk_bytes = (size_t)tau * stride;
+    uint8_t *input = calloc(chunk_bytes, 1);
+
+    if (!input) {
+        perror("Failed to allocate reference input");
+        exit(EXIT_FAILURE);
+    }
+    reset_reference(ref);
+    memset(ref->trains, 0, (size_t)net->num_layers * net->time_window * stride);
+    memset(ref->firing_counts, 0, (size_t)num_outputs * num_chunks * sizeof(int));
+
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+        for (int t = 0; t < tau; t++) {
+            memcpy(REF_ROW(input, t, stride), spikes + (size_t)(chunk * tau + t) * spike_bytes, input_bytes);
+        }
+        // Each layer writes its chunk straight into its own train
+        const uint8_t *layer_input = input;
+        for (int l = net->first_layer; l < net->num_layers; l++) {
+            uint8_t *output = (uint8_t *)reference_train(ref, l) + (size_t)chunk * chunk_bytes;
+            reference_update_layer(ref, layer_input, output, l);
+            layer_input = output;
+        }
+        for (int i = 0; i < num_outputs; i++) {
+            for (int t = 0; t < tau; t++) {
+                ref->firing_rows[i][chunk] += GET_BIT(REF_ROW(layer_input, t, stride), i);
+            }
+        }
+    }
+
+    free(input);
+    return classify_inference(ref->firing_rows, num_outputs, num_chunks);
+}
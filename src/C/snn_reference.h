@@ -0,0 +1,41 @@
+#ifndef SNN_REFERENCE_H
+#define SNN_REFERENCE_H
+
+#include "snn_network.h"
+
+// Deliberately simple reference engine: one time step, one neuron and one
+// synapse at a time, straight from the layer equations. No SIMD, no index
+// lists, no batching and no early exit. Every optimized path must match it
+// bit for bit; tests/test_differential.c checks that they do.
+//
+// Per step t, for neuron i of layer l > 0:
+//   input  = bias[i] + sum over presynaptic j that fired in step t of W[j][i]
+//   spike  = membrane >= thresh          (from the state before the step)
+//   LIF:     membrane = (decay * membrane >> DECAY_SHIFT) + input - spike * thresh
+//   IF:      membrane = membrane + input - spike * thresh
+// Layer 0 adds Q0.7 +1 to neuron i when input neuron i fired. PRECISION_FLOAT32
+// layers use the same equations on dequantized weights, with the leak as one
+// fused multiply-add and no shift. W is read through layer_weight(), so int4
+// and ternary layers are checked against their decoded Q0.7 values.
+typedef struct {
+    const Snn_Network *net;
+    sum_t *membrane;        // [net->total_neurons], same layout as the network
+    uint8_t *trains;        // [num_layers][time_window][spike_bytes] spikes of the last sample
+    int *firing_counts;     // [output neurons][time_window / tau]
+    int **firing_rows;
+} Snn_Reference;
+
+// Thresholds, decay and weights are read from net. Returns 0 on success.
+int create_reference(Snn_Reference *ref, const Snn_Network *net);
+void reset_reference(Snn_Reference *ref);
+void destroy_reference(Snn_Reference *ref);
+
+// One chunk of one layer: input and output are [tau][net->spike_bytes]
+void reference_update_layer(Snn_Reference *ref, const uint8_t *input, uint8_t *output, int layer_index);
+// Whole sample from [time_window][spike_bytes] input, every chunk run. Leaves
+// every layer's full spike train in trains and returns the classification.
+int reference_inference(Snn_Reference *ref, const uint8_t *spikes, int spike_bytes);
+// Spike train of one layer: [time_window][net->spike_bytes]
+const uint8_t *reference_train(const Snn_Reference *ref, int layer_index);
+
+#endif // SNN_REFERENCE_H
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snn_stats.h"
+
+int stats_init(Snn_Stats *stats, const Snn_Network *net) {
+    memset(stats, 0, sizeof(*stats));
+    stats->num_layers = net->num_layers;
+    stats->num_chunks = net->time_window / net->tau;
+    stats->num_neurons = calloc(net->num_layers, sizeof(int));
+    stats->input_size = calloc(net->num_layers, sizeof(int));
+    stats->layers = calloc((size_t)net->num_layers * stats->num_chunks, sizeof(Snn_Layer_Stats));
+    if (!stats->num_neurons || !stats->input_size || !stats->layers) {
+        perror("Failed to allocate stats");
+        stats_free(stats);
+        return 1;
+    }
+    for (int l = 0; l < net->num_layers; l++) {
+        stats->num_neurons[l] = net->layers[l].num_neurons;
+        stats->input_size[l] = net->layers[l].input_size;
+    }
+    return 0;
+}
+
+void stats_reset(Snn_Stats *stats) {
+    stats->samples = 0;
+    memset(stats->layers, 0, (size_t)stats->num_layers * stats->num_chunks * sizeof(Snn_Layer_Stats));
+}
+
+void stats_free(Snn_Stats *stats) {
+    free(stats->num_neurons);
+    free(stats->input_size);
+    free(stats->layers);
+    memset(stats, 0, sizeof(*stats));
+}
+
+static void layer_stats_add(Snn_Layer_Stats *dst, const Snn_Layer_Stats *src) {
+    dst->chunks += src->chunks;
+    dst->input_spikes += src->input_spikes;
+    dst->input_slots += src->input_slots;
+    dst->row_ops += src->row_ops;
+    dst->synaptic_ops += src->synaptic_ops;
+    dst->spikes += src->spikes;
+    dst->active_neurons += src->active_neurons;
+    dst->neuron_slots += src->neuron_slots;
+    dst->sparse_chunks += src->sparse_chunks;
+}
+
+void stats_merge(Snn_Stats *dst, const Snn_Stats *src) {
+    dst->samples += src->samples;
+    for (int i = 0; i < dst->num_layers * dst->num_chunks; i++) {
+        layer_stats_add(&dst->layers[i], &src->layers[i]);
+    }
+}
+
+void stats_add(Snn_Stats *stats, int layer, int chunk, const Snn_Layer_Stats *delta) {
+    layer_stats_add(&stats->layers[(size_t)layer * stats->num_chunks + chunk], delta);
+}
+
+uint64_t stats_count_spikes(const uint8_t *buffer, int stride, int tau, int num_neurons) {
+    int full_bytes = num_neurons / 8;
+    uint8_t tail_mask = (uint8_t)((1u << (num_neurons & 7)) - 1);
+    uint64_t count = 0;
+
+    for (int t = 0; t < tau; t++) {
+        const uint8_t *row = buffer + (size_t)t * stride;
+        for (int i = 0; i < full_bytes; i++) {
+            count += __builtin_popcount(row[i]);
+        }
+        if (tail_mask) {
+            count += __builtin_popcount(row[full_bytes] & tail_mask);
+        }
+    }
+    return count;
+}
+
+uint64_t stats_count_active(const uint8_t *buffer, int stride, int tau, int num_neurons) {
+    int num_bytes = (num_neurons + 7) / 8;
+    uint8_t tail_mask = (num_neurons & 7) ? (uint8_t)((1u << (num_neurons & 7)) - 1) : 0xFF;
+    uint64_t count = 0;
+
+    for (int i = 0; i < num_bytes; i++) {
+        uint8_t any = 0;
+        for (int t = 0; t < tau; t++) {
+            any |= buffer[(size_t)t * stride + i];
+        }
+        if (i == num_bytes - 1) {
+            any &= tail_mask;
+        }
+        count += __builtin_popcount(any);
+    }
+    return count;
+}
+
+static double ratio(uint64_t num, uint64_t den) {
+    return den ? (double)num / (double)den : 0.0;
+}
+
+static void layer_totals(const Snn_Stats *stats, int layer, Snn_Layer_Stats *total) {
+    memset(total, 0, sizeof(*total));
+    for (int c = 0; c < stats->num_chunks; c++) {
+        layer_stats_add(total, &stats->layers[(size_t)layer * stats->num_chunks + c]);
+    }
+}
+
+static void write_json_counters(FILE *file, const Snn_Layer_Stats *s, uint64_t samples) {
+    fprintf(file, "\"chunks\": %llu, \"input_spikes\": %llu, \"input_density\": %.6f, "
+                  "\"row_ops\": %llu, \"synaptic_ops\": %llu, \"synaptic_ops_per_sample\": %.1f, "
+                  "\"spikes\": %llu, \"spike_density\": %.6f, \"active_neurons\": %llu, "
+                  "\"sparse_chunks\": %llu",
+            (unsigned long long)s->chunks, (unsigned long long)s->input_spikes,
+            ratio(s->input_spikes, s->input_slots), (unsigned long long)s->row_ops,
+            (unsigned long long)s->synaptic_ops, ratio(s->synaptic_ops, samples),
+            (unsigned long long)s->spikes, ratio(s->spikes, s->neuron_slots),
+            (unsigned long long)s->active_neurons, (unsigned long long)s->sparse_chunks);
+}
+
+int stats_write_json(const Snn_Stats *stats, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open stats file");
+        return 1;
+    }
+
+    uint64_t total_ops = 0;
+    fprintf(file, "{\n  \"samples\": %llu,\n  \"chunks_per_sample\": %d,\n  \"layers\": [\n",
+            (unsigned long long)stats->samples, stats->num_chunks);
+    for (int l = 0; l < stats->num_layers; l++) {
+        Snn_Layer_Stats total;
+        layer_totals(stats, l, &total);
+        total_ops += total.synaptic_ops;
+
+        fprintf(file, "    {\"layer\": %d, \"neurons\": %d, \"inputs\": %d, ",
+                l, stats->num_neurons[l], stats->input_size[l]);
+        write_json_counters(file, &total, stats->samples);
+        fprintf(file, ",\n     \"per_chunk\": [\n");
+        for (int c = 0; c < stats->num_chunks; c++) {
+            fprintf(file, "       {\"chunk\": %d, ", c);
+            write_json_counters(file, &stats->layers[(size_t)l * stats->num_chunks + c], stats->samples);
+            fprintf(file, "}%s\n", c + 1 < stats->num_chunks ? "," : "");
+        }
+        fprintf(file, "     ]}%s\n", l + 1 < stats->num_layers ? "," : "");
+    }
+    fprintf(file, "  ],\n  \"synaptic_ops\": %llu,\n  \"synaptic_ops_per_sample\": %.1f\n}\n",
+            (unsigned long long)total_ops, ratio(total_ops, stats->samples));
+
+    if (fclose(file)) {
+        perror("Failed to write stats file");
+        return 1;
+    }
+    return 0;
+}
+
+static void write_csv_row(FILE *file, int layer, int chunk, const Snn_Layer_Stats *s) {
+    if (chunk < 0) {
+        fprintf(file, "%d,all,", layer);
+    } else {
+        fprintf(file, "%d,%d,", layer, chunk);
+    }
+    fprintf(file, "%llu,%llu,%.6f,%llu,%llu,%llu,%.6f,%llu,%llu\n",
+            (unsigned long long)s->chunks, (unsigned long long)s->input_spikes,
+            ratio(s->input_spikes, s->input_slots), (unsigned long long)s->row_ops,
+            (unsigned long long)s->synaptic_ops, (unsigned long long)s->spikes,
+            ratio(s->spikes, s->neuron_slots), (unsigned long long)s->active_neurons,
+            (unsigned long long)s->sparse_chunks);
+}
+
+// One row per (layer, chunk position) plus an "all" row per layer
+int stats_write_csv(const Snn_Stats *stats, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        perror("Failed to open stats file");
+        return 1;
+    }
+
+    fprintf(file, "layer,chunk,chunks,input_spikes,input_density,row_ops,synaptic_ops,"
+                  "spikes,spike_density,active_neurons,sparse_chunks\n");
+    for (int l = 0; l < stats->num_layers; l++) {
+        Snn_Layer_Stats total;
+        layer_totals(stats, l, &total);
+        for (int c = 0; c < stats->num_chunks; c++) {
+            write_csv_row(file, l, c, &stats->layers[(size_t)l * stats->num_chunks + c]);
+        }
+        write_csv_row(file, l, -1, &total);
+    }
+
+    if (fclose(file)) {
+        perror("Failed to write stats file");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SNN_STATS_H
+#define SNN_STATS_H
+
+#include <stdint.h>
+#include "snn_network.h"
+
+// Activity counters for one layer over one chunk position, summed over every
+// sample recorded. Densities are spikes / slots.
+typedef struct {
+    uint64_t chunks;          // layer-chunks recorded
+    uint64_t input_spikes;    // presynaptic (neuron, step) spikes seen
+    uint64_t input_slots;     // input_size * tau per chunk
+    uint64_t row_ops;         // int8 weight rows accumulated
+    uint64_t synaptic_ops;    // row_ops * num_neurons; input spikes for the input layer
+    uint64_t spikes;          // output (neuron, step) spikes
+    uint64_t active_neurons;  // neurons that crossed threshold at least once in the chunk
+    uint64_t neuron_slots;    // num_neurons * tau per chunk
+    uint64_t sparse_chunks;   // chunks whose input arrived as index lists
+} Snn_Layer_Stats;
+
+// Per-layer, per-chunk counters for a run. Engines record into it only when
+// built with SNN_STATS; each context, batch or stage owns its own and the
+// caller merges them once the run is over.
+typedef struct Snn_Stats {
+    int num_layers;
+    int num_chunks;
+    uint64_t samples;
+    int *num_neurons;         // [num_layers]
+    int *input_size;          // [num_layers]
+    Snn_Layer_Stats *layers;  // [num_layers][num_chunks]
+} Snn_Stats;
+
+int stats_init(Snn_Stats *stats, const Snn_Network *net);
+void stats_reset(Snn_Stats *stats);
+void stats_free(Snn_Stats *stats);
+// dst += src, both initialised from the same network
+void stats_merge(Snn_Stats *dst, const Snn_Stats *src);
+
+void stats_add(Snn_Stats *stats, int layer, int chunk, const Snn_Layer_Stats *delta);
+// Spike bits set in the first num_neurons bits of each [tau][stride] row,
+// and neurons set in any row
+uint64_t stats_count_spikes(const uint8_t *buffer, int stride, int tau, int num_neurons);
+uint64_t stats_count_active(const uint8_t *buffer, int stride, int tau, int num_neurons);
+
+// Report of every layer, totals plus each chunk position. Returns 0 on success.
+int stats_write_json(const Snn_Stats *stats, const char *filename);
+int stats_write_csv(const Snn_Stats *stats, const char *filename);
+
+#endif // SNN_STATS_H
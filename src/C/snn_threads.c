@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "snn_threads.h"
+
+static void run_shards(Snn_Thread_Pool *pool, Snn_Worker *worker) {
+    const Snn_Network *net = pool->net;
+    size_t sample_stride = (size_t)net->time_window * pool->spike_bytes;
+    int shard = (pool->batch_size > POOL_SHARD_SAMPLES) ? pool->batch_size : POOL_SHARD_SAMPLES;
+    Spike_Encoder encoder;
+
+    while (1) {
+        int first = __atomic_fetch_add(&pool->next_sample, shard, __ATOMIC_RELAXED);
+        if (first >= pool->num_samples) {
+            break;
+        }
+        int last = (first + shard < pool->num_samples) ? first + shard : pool->num_samples;
+
+        if (pool->batch_size > 1) {
+            for (int d = first; d < last; d += pool->batch_size) {
+                int count = (last - d < pool->batch_size) ? last - d : pool->batch_size;
+                int *chunks_used = pool->chunks_used ? pool->chunks_used + d : NULL;
+                if (pool->spikes) {
+                    batch_inference(&worker->batch, pool->spikes + d * sample_stride, pool->spike_bytes,
+                                    count, pool->classifications + d, chunks_used);
+                } else {
+                    batch_inference_stream(&worker->batch, pool->source, d, count, pool->classifications + d,
+                                           chunks_used);
+                }
+            }
+        } else {
+            for (int d = first; d < last; d++) {
+                if (pool->spikes) {
+                    pool->classifications[d] = context_inference(&worker->ctx, pool->spikes + d * sample_stride,
+                                                                 pool->spike_bytes);
+                } else {
+                    source_begin(pool->source, &encoder, d);
+                    pool->classifications[d] = context_inference_stream(&worker->ctx, &encoder);
+                }
+                if (pool->chunks_used) {
+                    pool->chunks_used[d] = worker->ctx.chunks_used;
+                }
+            }
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    Snn_Worker *worker = (Snn_Worker *)arg;
+    Snn_Thread_Pool *pool = worker->pool;
+    int seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_shards(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int create_thread_pool(Snn_Thread_Pool *pool, const Snn_Network *net, int num_threads, int batch_size) {
+    memset(pool, 0, sizeof(*pool));
+    if (num_threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (online > 0) ? (int)online : 1;
+    }
+    if (batch_size < 1) {
+        batch_size = 1;
+    }
+
+    pool->net = net;
+    pool->batch_size = batch_size;
+    pool->workers = calloc(num_threads, sizeof(Snn_Worker));
+    if (!pool->workers) {
+        perror("Failed to allocate thread pool");
+        return 1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (int i = 0; i < num_threads; i++) {
+        Snn_Worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        int err = (batch_size > 1) ? create_batch(&worker->batch, net, batch_size)
+                                   : create_context(&worker->ctx, net);
+        if (err || pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            fprintf(stderr, "Error: failed to start worker %d\n", i);
+            if (!err) {
+                if (batch_size > 1) {
+                    destroy_batch(&worker->batch);
+                } else {
+                    destroy_context(&worker->ctx);
+                }
+            }
+            destroy_thread_pool(pool);
+            return 1;
+        }
+        pool->num_threads++;
+    }
+    return 0;
+}
+
+static void run_job(Snn_Thread_Pool *pool, const uint8_t *spikes, int spike_bytes, const Spike_Source *src,
+                    int num_samples, int *classifications, int *chunks_used) {
+    pthread_mutex_lock(&pool->lock);
+    pool->spikes = spikes;
+    pool->spike_bytes = spike_bytes;
+    pool->source = src;
+    pool->num_samples = num_samples;
+    pool->classifications = classifications;
+    pool->chunks_used = chunks_used;
+    pool->next_sample = 0;
+    pool->active = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_inference(Snn_Thread_Pool *pool, const uint8_t *spikes, int spike_bytes, int num_samples,
+                    int *classifications, int *chunks_used) {
+    run_job(pool, spikes, spike_bytes, NULL, num_samples, classifications, chunks_used);
+}
+
+void pool_inference_stream(Snn_Thread_Pool *pool, const Spike_Source *src, int num_samples,
+                           int *classifications, int *chunks_used) {
+    run_job(pool, NULL, 0, src, num_samples, classifications, chunks_used);
+}
+
+void destroy_thread_pool(Snn_Thread_Pool *pool) {
+    if (!pool->workers) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        if (pool->batch_size > 1) {
+            destroy_batch(&pool->workers[i].batch);
+        } else {
+            destroy_context(&pool->workers[i].ctx);
+        }
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+    free(pool->workers);
+    memset(pool, 0, sizeof(*pool));
+}
@@ -0,0 +1,56 @@
+#ifndef SNN_THREADS_H
+#define SNN_THREADS_H
+
+#include <pthread.h>
+#include "snn_network.h"
+
+// Samples a worker claims at a time; larger shards mean less contention on
+// the shared counter, smaller ones balance better at the end of a run
+#define POOL_SHARD_SAMPLES 16
+
+struct Snn_Thread_Pool;
+
+typedef struct {
+    struct Snn_Thread_Pool *pool;
+    pthread_t thread;
+    Snn_Context ctx;        // used when batch_size == 1
+    Snn_Batch batch;        // used when batch_size > 1
+} Snn_Worker;
+
+// Persistent workers, each with private inference state over one shared,
+// read-only network. Jobs are sharded dynamically across the workers.
+typedef struct Snn_Thread_Pool {
+    const Snn_Network *net;
+    int num_threads;
+    int batch_size;
+    Snn_Worker *workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    int generation;         // bumped for every job
+    int active;             // workers still on the current job
+    int shutdown;
+
+    // Current job
+    const uint8_t *spikes;  // [num_samples][time_window][spike_bytes], or NULL
+    int spike_bytes;
+    const Spike_Source *source; // encodes each sample in its worker when spikes is NULL
+    int num_samples;
+    int *classifications;
+    int *chunks_used;       // NULL when the caller does not want them
+    int next_sample;        // claimed with atomic fetch-add
+} Snn_Thread_Pool;
+
+// num_threads <= 0 uses every online core. Returns 0 on success.
+int create_thread_pool(Snn_Thread_Pool *pool, const Snn_Network *net, int num_threads, int batch_size);
+// chunks_used, if not NULL, receives the chunks each sample ran
+void pool_inference(Snn_Thread_Pool *pool, const uint8_t *spikes, int spike_bytes, int num_samples,
+                    int *classifications, int *chunks_used);
+// Same for samples 0 .. num_samples - 1 of src, encoded chunk by chunk by the
+// worker that claims them, so no spike tensor is ever built
+void pool_inference_stream(Snn_Thread_Pool *pool, const Spike_Source *src, int num_samples,
+                           int *classifications, int *chunks_used);
+void destroy_thread_pool(Snn_Thread_Pool *pool);
+
+#endif // SNN_THREADS_H
@@ -0,0 +1,702 @@
+// Differential test: random topologies, tau, time windows, neuron parameters,
+// traversals, spike representations, layer precisions, weight formats,
+// per-channel weight scales and input densities,
+// run through every optimized path on every DSP level this CPU supports and
+// compared bit for bit with the reference engine (snn_reference.c):
+//   staged single-sample drive  every layer's spikes and membranes after every chunk
+//   context_inference           classification, output firing counts, final membranes
+//   batch_inference             the same for every slot
+//   thread pool, pipeline       classifications, plus the pipeline stages' membranes
+// The batch, pool and pipeline also run from a Spike_Source whose encoder
+// replays the same spikes, and must match the same way.
+// A decided early exit must also leave every classification unchanged.
+//
+// Usage: test_differential [--cases N] [--seed S]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../define.h"
+#include "../dsp_helper.h"
+#include "../snn_network.h"
+#include "../snn_pipeline.h"
+#include "../snn_reference.h"
+#include "../snn_threads.h"
+
+Snn_Network snn_network;
+
+#define MAX_CASE_LAYERS 4
+#define MAX_CASE_SAMPLES 6
+
+typedef struct {
+    int num_layers;
+    int widths[MAX_CASE_LAYERS];
+    int tau;
+    int time_window;
+    int voltage_thresh;
+    int decay_rate;
+    Input_Mode input_mode;
+    Traversal_Mode traversal[MAX_CASE_LAYERS];
+    Spike_Mode spike_mode[MAX_CASE_LAYERS];
+    If_Popcount_Mode popcount_mode[MAX_CASE_LAYERS];
+    Layer_Precision precision[MAX_CASE_LAYERS];
+    Weight_Format weight_format[MAX_CASE_LAYERS];
+    int repack_float;       // set the weight format after the precision, rebuilding float rows
+    int per_channel[MAX_CASE_LAYERS]; // weights quantized from floats with per-neuron scales
+    int int32_sums[MAX_CASE_LAYERS]; // int16-capable layers forced back to int32 sums
+    int in_arena;           // network and single-sample context built in caller arenas of the planned size
+    int density_pct;
+    int num_samples;
+    int batch_size;
+    int num_stages;
+} Diff_Case;
+
+// Reference results for every sample of a case
+typedef struct {
+    int classification[MAX_CASE_SAMPLES];
+    int *firing_counts;     // [samples][outputs][chunks]
+    sum_t *membrane;        // [samples][total_neurons]
+} Diff_Expected;
+
+static uint64_t rng_state;
+
+static uint32_t next_random(void) {
+    // splitmix64, so a seed reproduces the same cases everywhere
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+static int random_range(int lo, int hi) {
+    return lo + (int)(next_random() % (uint32_t)(hi - lo + 1));
+}
+
+static void make_case(Diff_Case *c) {
+    static const int widths[] = {1, 3, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 129, 200, 257};
+    // Wider than the built-in model's MAX_NEURONS and past 1024, so per-step
+    // lists and int32 sum bounds are sized from the network, not the statics
+    static const int wide_widths[] = {785, 1031, 1500};
+    static const int taus[] = {1, 2, 3, 4, 5, 8, 10, 16, 32};
+    int num_widths = sizeof(widths) / sizeof(widths[0]);
+
+    memset(c, 0, sizeof(*c));
+    c->num_layers = random_range(2, MAX_CASE_LAYERS);
+    for (int l = 0; l < c->num_layers; l++) {
+        c->widths[l] = widths[random_range(0, num_widths - 1)];
+        c->traversal[l] = (Traversal_Mode)random_range(TRAVERSE_STEP_MAJOR, TRAVERSE_TILED);
+        c->spike_mode[l] = (Spike_Mode)random_range(SPIKES_DENSE, SPIKES_AUTO);
+        // The approximate popcount path is allowed to differ, so only exact modes here
+        c->popcount_mode[l] = (If_Popcount_Mode)random_range(IF_POPCOUNT_OFF, IF_POPCOUNT_EXACT);
+        c->precision[l] = (Layer_Precision)random_range(PRECISION_Q07, PRECISION_FLOAT32);
+        c->weight_format[l] = (Weight_Format)random_range(WEIGHTS_INT8, WEIGHTS_TERNARY);
+        c->per_channel[l] = l > 0 && random_range(0, 2) == 0;
+        c->int32_sums[l] = random_range(0, 2) == 0;
+    }
+    int wide_layer = random_range(0, 3) == 0 ? random_range(0, c->num_layers - 2) : -1;
+    if (wide_layer >= 0) {
+        // One wide layer per case keeps the run time down; it always feeds another
+        c->widths[wide_layer] = wide_widths[random_range(0, 2)];
+    }
+    c->repack_float = random_range(0, 1);
+    c->tau = taus[random_range(0, (int)(sizeof(taus) / sizeof(taus[0])) - 1)];
+    c->time_window = c->tau * random_range(1, 4);
+    c->voltage_thresh = random_range(0, 3) ? random_range(16, 512) : 0;
+    c->decay_rate = random_range(0, 3) ? random_range(64, 1 << DECAY_SHIFT) : 0;
+    c->input_mode = random_range(0, 3) ? INPUT_LIF : INPUT_DIRECT;
+    c->density_pct = random_range(0, 4) ? random_range(1, 60) : random_range(0, 1) * 100;
+    if (wide_layer == 0) {
+        // Dense enough that a step has more active inputs than MAX_NEURONS
+        c->density_pct = random_range(60, 100);
+    }
+    c->num_samples = random_range(1, MAX_CASE_SAMPLES);
+    c->batch_size = random_range(1, 4);
+    c->num_stages = random_range(1, c->num_layers);
+    c->in_arena = random_range(0, 1);
+#if (SNN_FIXED_TOPOLOGY)
+    // A fixed build only runs its define.h topology, so fold the case onto it
+    c->num_layers = c->num_layers < MAX_LAYERS ? c->num_layers : MAX_LAYERS;
+    for (int l = 0; l < c->num_layers; l++) {
+        c->widths[l] = c->widths[l] < MAX_NEURONS ? c->widths[l] : MAX_NEURONS;
+    }
+    c->tau = TAU;
+    c->time_window = TIME_WINDOW;
+    c->num_stages = c->num_stages < c->num_layers ? c->num_stages : c->num_layers;
+#endif
+}
+
+#if !(SNN_FIXED_TOPOLOGY)
+// More inputs fire in every step than MAX_NEURONS, straight into tiled int8
+// rows, so per-step lists must be sized from the network
+static void make_wide_case(Diff_Case *c) {
+    static const int widths[] = {4000, 16, 4};
+
+    make_case(c);
+    c->num_layers = 3;
+    for (int l = 0; l < c->num_layers; l++) {
+        c->widths[l] = widths[l];
+        c->traversal[l] = TRAVERSE_TILED;
+        c->spike_mode[l] = SPIKES_DENSE;
+        c->precision[l] = PRECISION_Q07;
+        c->weight_format[l] = WEIGHTS_INT8;
+        c->per_channel[l] = 0;
+    }
+    c->input_mode = INPUT_DIRECT;
+    c->density_pct = 100;
+    c->num_stages = c->num_stages < c->num_layers ? c->num_stages : c->num_layers;
+}
+#endif
+
+static void print_case(const Diff_Case *c) {
+    fprintf(stderr, "  layers");
+    for (int l = 0; l < c->num_layers; l++) {
+        fprintf(stderr, " %d(t%d s%d p%d %s %s%s%s)", c->widths[l], c->traversal[l], c->spike_mode[l],
+                c->popcount_mode[l], precision_name(c->precision[l]), weight_format_name(c->weight_format[l]),
+                c->per_channel[l] ? " per-channel" : "", c->int32_sums[l] ? " int32-sums" : "");
+    }
+    fprintf(stderr, ", tau %d, window %d, thresh %d, decay %d, %s input, %d%% density, %d samples%s\n",
+            c->tau, c->time_window, c->voltage_thresh, c->decay_rate,
+            c->input_mode == INPUT_DIRECT ? "direct" : "LIF", c->density_pct, c->num_samples,
+            c->in_arena ? ", in arenas" : "");
+}
+
+// Real neurons of every layer that runs; padding is free to differ
+static int membranes_differ(const Snn_Network *net, const sum_t *got, const sum_t *expected,
+                            int first_layer, int last_layer) {
+    for (int l = first_layer; l <= last_layer; l++) {
+        const Layer *layer = &net->layers[l];
+        if (memcmp(got + layer->neuron_offset, expected + layer->neuron_offset,
+                   layer->num_neurons * sizeof(sum_t))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int spikes_differ(const uint8_t *got, const uint8_t *expected, int stride, int tau, int num_neurons) {
+    for (int t = 0; t < tau; t++) {
+        const uint8_t *got_row = got + (size_t)t * stride;
+        const uint8_t *expected_row = expected + (size_t)t * stride;
+        for (int i = 0; i < num_neurons; i++) {
+            if (GET_BIT(got_row, i) != GET_BIT(expected_row, i)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Packed rows must decode to what the converter meant: the int4 code nearest
+// w / scale, or a ternary weight that never flips the sign of w
+static int check_packed(const Snn_Network *net, const Diff_Case *c, int8_t *const *weights) {
+    for (int l = 1; l < net->num_layers; l++) {
+        const Layer *layer = &net->layers[l];
+        for (int j = 0; j < layer->input_size; j++) {
+            for (int i = 0; i < layer->num_neurons; i++) {
+                int w = weights[l][(size_t)j * layer->num_neurons + i];
+                int q = layer_weight(layer, j, i);
+                int bad = 0;
+                if (layer->weight_format == WEIGHTS_INT4) {
+                    long code = lrintf(w / layer->weight_scale);
+                    code = code < -7 ? -7 : code > 7 ? 7 : code;
+                    bad = q != layer->weight_lut[code & 0x0F];
+                } else if (layer->weight_format == WEIGHTS_TERNARY) {
+                    bad = (q != 0 && q != layer->weight_lut[1] && q != layer->weight_lut[15]) || q * w < 0;
+                } else {
+                    bad = q != w;
+                }
+                if (bad) {
+                    fprintf(stderr, "FAIL: layer %d %s weight [%d][%d] = %d decodes to %d\n", l,
+                            weight_format_name(layer->weight_format), j, i, w, q);
+                    print_case(c);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// int16 sums must only be chosen where no step can leave int16: the layer's
+// bound is its largest |bias| + sum of |w| over the decoded weights
+static int check_sum_width(const Snn_Network *net, const Diff_Case *c) {
+    for (int l = 1; l < net->num_layers; l++) {
+        const Layer *layer = &net->layers[l];
+        int32_t bound = 0;
+        for (int i = 0; i < layer->num_neurons; i++) {
+            int32_t total = abs(layer->bias[i]);
+            for (int j = 0; j < layer->input_size; j++) {
+                total += abs(layer_weight(layer, j, i));
+            }
+            bound = total > bound ? total : bound;
+        }
+        int narrow = INT16_SUMS && layer->precision == PRECISION_Q07 && layer->weight_format == WEIGHTS_INT8
+                     && bound <= INT16_MAX;
+        if (layer->sum_bound != bound || (layer->sum_width == SUMS_INT16) != narrow) {
+            fprintf(stderr, "FAIL: layer %d sum bound %d (expected %d), %s sums\n", l, layer->sum_bound, bound,
+                    layer->sum_width == SUMS_INT16 ? "int16" : "int32");
+            print_case(c);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Per-channel codes never clip: each neuron's largest magnitude lands on 127
+// unless its scale hit the floor, and every code is within half a step of its float
+static int check_per_channel(const float *weights, const float *bias, const int8_t *q_weights,
+                             const int8_t *q_bias, const float *scales, int input_size, int num_neurons) {
+    const float min_scale = (float)INT16_MAX / MAX_FOLDED_THRESH;
+    for (int i = 0; i < num_neurons; i++) {
+        float step = scales[i] * Q07_INV_SCALE;
+        int max_code = abs(q_bias[i]);
+        int bad = fabsf(q_bias[i] * step - bias[i]) > 0.5001f * step;
+        for (int j = 0; j < input_size; j++) {
+            size_t k = (size_t)j * num_neurons + i;
+            max_code = abs(q_weights[k]) > max_code ? abs(q_weights[k]) : max_code;
+            bad |= fabsf(q_weights[k] * step - weights[k]) > 0.5001f * step;
+        }
+        bad |= max_code != Q07_MAX_INT8 && scales[i] > min_scale;
+        if (bad) {
+            fprintf(stderr, "FAIL: per-channel quantization of neuron %d (scale %g, largest code %d)\n",
+                    i, scales[i], max_code);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int report(const char *path, Dsp_Kernel kernel, int sample, const Diff_Case *c) {
+    fprintf(stderr, "FAIL: %s, %s kernel, sample %d\n", path, dsp_kernel_name(kernel), sample);
+    print_case(c);
+    return 1;
+}
+
+// Layer at a time on a context, like bench_stages, checked after every layer and chunk
+static int check_staged(const Snn_Network *net, Snn_Reference *ref, const uint8_t *spikes, int input_bytes,
+                        Dsp_Kernel kernel, const Diff_Case *c) {
+    int stride = net->spike_bytes;
+    size_t chunk_bytes = (size_t)net->tau * stride;
+    uint8_t *ref_ping = calloc(chunk_bytes, 1);
+    uint8_t *ref_pong = calloc(chunk_bytes, 1);
+    Snn_Context ctx;
+    int failures = 0;
+
+    if (!ref_ping || !ref_pong || create_context(&ctx, net)) {
+        perror("Failed to allocate staged drive");
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < c->num_samples && !failures; s++) {
+        const uint8_t *sample = spikes + (size_t)s * net->time_window * input_bytes;
+        reset_context(&ctx);
+        reset_reference(ref);
+        for (int chunk = 0; chunk < net->time_window / net->tau && !failures; chunk++) {
+            uint8_t *ping = ctx.ping_pong[0];
+            uint8_t *pong = ctx.ping_pong[1];
+            uint8_t *ref_in = ref_ping;
+            uint8_t *ref_out = ref_pong;
+            for (int t = 0; t < net->tau; t++) {
+                const uint8_t *row = sample + (size_t)(chunk * net->tau + t) * input_bytes;
+                memcpy(ping + (size_t)t * stride, row, input_bytes);
+                memcpy(ref_in + (size_t)t * stride, row, input_bytes);
+            }
+            ctx.events[0].valid = 0;
+            for (int l = net->first_layer; l < net->num_layers && !failures; l++) {
+                context_update_layer(&ctx, ping, pong, l);
+                reference_update_layer(ref, ref_in, ref_out, l);
+                if (spikes_differ(pong, ref_out, stride, net->tau, net->layers[l].num_neurons)
+                    || membranes_differ(net, ctx.membrane, ref->membrane, l, l)) {
+                    fprintf(stderr, "  layer %d, chunk %d\n", l, chunk);
+                    failures += report("staged drive", kernel, s, c);
+                }
+                uint8_t *temp = ping;
+                ping = pong;
+                pong = temp;
+                temp = ref_in;
+                ref_in = ref_out;
+                ref_out = temp;
+            }
+        }
+    }
+    destroy_context(&ctx);
+    free(ref_ping);
+    free(ref_pong);
+    return failures;
+}
+
+// Caller arena of exactly bytes, followed by a guard line that must survive
+#define ARENA_GUARD 0xA5
+
+static uint8_t *alloc_arena(size_t bytes) {
+    uint8_t *arena = aligned_alloc(64, bytes + 64);
+    if (!arena) {
+        perror("Failed to allocate arena");
+        exit(EXIT_FAILURE);
+    }
+    memset(arena + bytes, ARENA_GUARD, 64);
+    return arena;
+}
+
+static int arena_overrun(const uint8_t *arena, size_t bytes) {
+    for (int i = 0; i < 64; i++) {
+        if (arena[bytes + i] != ARENA_GUARD) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Encoder fill that replays the case's spikes, [time_window][input bytes] per sample
+static void replay_fill(Spike_Encoder *enc, uint8_t *rows, int steps, int stride) {
+    int input_bytes = (enc->num_inputs + 7) / 8;
+    for (int k = 0; k < steps; k++) {
+        memset(rows + (size_t)k * stride, 0, stride);
+        memcpy(rows + (size_t)k * stride, enc->data + (size_t)(enc->step + k) * input_bytes, input_bytes);
+    }
+}
+
+static int check_engines(Snn_Network *net, const Diff_Expected *expected, const uint8_t *spikes,
+                         int input_bytes, Dsp_Kernel kernel, const Diff_Case *c) {
+    int num_outputs = net->layers[net->num_layers - 1].num_neurons;
+    int num_chunks = net->time_window / net->tau;
+    size_t counts_size = (size_t)num_outputs * num_chunks;
+    size_t sample_stride = (size_t)net->time_window * input_bytes;
+    int last = net->num_layers - 1;
+    int classifications[MAX_CASE_SAMPLES];
+    int chunks_used[MAX_CASE_SAMPLES];
+    int failures = 0;
+    Spike_Source src;
+    encoder_init(&src.encoder, ENCODER_RATE, net->layers[0].num_neurons, net->time_window, 0);
+    src.encoder.fill = replay_fill;
+    src.data = spikes;
+    src.sample_stride = sample_stride;
+    src.num_frames = 1;
+
+    // Whole-sample single path
+    Snn_Context ctx;
+    size_t ctx_bytes = context_memory_size(net);
+    uint8_t *ctx_arena = c->in_arena ? alloc_arena(ctx_bytes) : NULL;
+    if (c->in_arena ? create_context_in(&ctx, net, ctx_arena, ctx_bytes) : create_context(&ctx, net)) {
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < c->num_samples; s++) {
+        int classification = context_inference(&ctx, spikes + s * sample_stride, input_bytes);
+        if (classification != expected->classification[s]
+            || memcmp(ctx.firing_counts, expected->firing_counts + s * counts_size, counts_size * sizeof(int))
+            || membranes_differ(net, ctx.membrane, expected->membrane + (size_t)s * net->total_neurons,
+                                net->first_layer, last)) {
+            failures += report("context_inference", kernel, s, c);
+        }
+    }
+
+    // Batched, slots filled in order and the last call partial; then streamed
+    Snn_Batch batch;
+    if (create_batch(&batch, net, c->batch_size)) {
+        exit(EXIT_FAILURE);
+    }
+    for (int streamed = 0; streamed < 2; streamed++) {
+        for (int first = 0; first < c->num_samples; first += c->batch_size) {
+            int count = c->num_samples - first < c->batch_size ? c->num_samples - first : c->batch_size;
+            if (streamed) {
+                batch_inference_stream(&batch, &src, first, count, classifications + first, chunks_used + first);
+            } else {
+                batch_inference(&batch, spikes + first * sample_stride, input_bytes, count, classifications + first,
+                                chunks_used + first);
+            }
+            for (int b = 0; b < count; b++) {
+                int s = first + b;
+                if (classifications[s] != expected->classification[s]
+                    || memcmp(batch.firing_counts + b * counts_size, expected->firing_counts + s * counts_size,
+                              counts_size * sizeof(int))
+                    || membranes_differ(net, batch.membrane + (size_t)b * net->total_neurons,
+                                        expected->membrane + (size_t)s * net->total_neurons, net->first_layer, last)) {
+                    failures += report(streamed ? "batch_inference_stream" : "batch_inference", kernel, s, c);
+                }
+            }
+        }
+    }
+
+    // Thread pool, one sample and one batch per worker, from spikes and streamed
+    Snn_Thread_Pool pool;
+    int pool_batches[2] = {1, c->batch_size};
+    for (int p = 0; p < (c->batch_size > 1 ? 2 : 1); p++) {
+        int batch_size = pool_batches[p];
+        if (create_thread_pool(&pool, net, 2, batch_size)) {
+            exit(EXIT_FAILURE);
+        }
+        for (int streamed = 0; streamed < 2; streamed++) {
+            static const char *names[2][2] = {{"pool_inference", "pool_inference batched"},
+                                              {"pool_inference_stream", "pool_inference_stream batched"}};
+            if (streamed) {
+                pool_inference_stream(&pool, &src, c->num_samples, classifications, NULL);
+            } else {
+                pool_inference(&pool, spikes, input_bytes, c->num_samples, classifications, NULL);
+            }
+            for (int s = 0; s < c->num_samples; s++) {
+                if (classifications[s] != expected->classification[s]) {
+                    failures += report(names[streamed][batch_size > 1], kernel, s, c);
+                }
+            }
+        }
+        destroy_thread_pool(&pool);
+    }
+
+    // Pipeline; each stage's context ends holding the last sample's state of its layers
+    Snn_Pipeline pipe;
+    if (create_pipeline(&pipe, net, c->num_stages)) {
+        exit(EXIT_FAILURE);
+    }
+    for (int streamed = 0; streamed < 2; streamed++) {
+        if (streamed) {
+            pipeline_inference_stream(&pipe, &src, c->num_samples, classifications, NULL);
+        } else {
+            pipeline_inference(&pipe, spikes, input_bytes, c->num_samples, classifications, NULL);
+        }
+        for (int s = 0; s < c->num_samples; s++) {
+            if (classifications[s] != expected->classification[s]) {
+                failures += report(streamed ? "pipeline_inference_stream" : "pipeline_inference", kernel, s, c);
+            }
+        }
+        for (int st = 0; st < pipe.num_stages; st++) {
+            const Pipeline_Stage *stage = &pipe.stages[st];
+            if (membranes_differ(net, stage->ctx.membrane,
+                                 expected->membrane + (size_t)(c->num_samples - 1) * net->total_neurons,
+                                 stage->first_layer, stage->last_layer)) {
+                fprintf(stderr, "  stage %d, layers %d-%d\n", st, stage->first_layer, stage->last_layer);
+                failures += report("pipeline state", kernel, c->num_samples - 1, c);
+            }
+        }
+    }
+    destroy_pipeline(&pipe);
+
+    // A decided early exit never changes a result
+    net->early_exit.mode = EARLY_EXIT_DECIDED;
+    for (int s = 0; s < c->num_samples; s++) {
+        if (context_inference(&ctx, spikes + s * sample_stride, input_bytes) != expected->classification[s]) {
+            failures += report("context_inference, decided exit", kernel, s, c);
+        }
+    }
+    for (int streamed = 0; streamed < 2; streamed++) {
+        for (int first = 0; first < c->num_samples; first += c->batch_size) {
+            int count = c->num_samples - first < c->batch_size ? c->num_samples - first : c->batch_size;
+            if (streamed) {
+                batch_inference_stream(&batch, &src, first, count, classifications + first, chunks_used + first);
+            } else {
+                batch_inference(&batch, spikes + first * sample_stride, input_bytes, count, classifications + first,
+                                chunks_used + first);
+            }
+        }
+        for (int s = 0; s < c->num_samples; s++) {
+            if (classifications[s] != expected->classification[s] || chunks_used[s] < 1
+                || chunks_used[s] > num_chunks) {
+                failures += report(streamed ? "batch_inference_stream, decided exit" : "batch_inference, decided exit",
+                                   kernel, s, c);
+            }
+        }
+    }
+    net->early_exit.mode = EARLY_EXIT_OFF;
+
+    destroy_batch(&batch);
+    destroy_context(&ctx);
+    if (ctx_arena && arena_overrun(ctx_arena, ctx_bytes)) {
+        failures += report("context arena overrun", kernel, 0, c);
+    }
+    free(ctx_arena);
+    return failures;
+}
+
+static int run_case(const Diff_Case *c, int *kernel_runs) {
+    Snn_Layer_Desc layers[MAX_CASE_LAYERS];
+    int8_t *weights[MAX_CASE_LAYERS] = {0};
+    int8_t *bias[MAX_CASE_LAYERS] = {0};
+    float *scales[MAX_CASE_LAYERS] = {0};
+    int failures = 0;
+
+    // Weight spread varies per layer so some cases saturate and some stay quiet
+    for (int l = 0; l < c->num_layers; l++) {
+        layers[l].num_neurons = c->widths[l];
+        layers[l].weights = NULL;
+        layers[l].bias = NULL;
+        layers[l].scales = NULL;
+        if (l == 0) {
+            continue;
+        }
+        int fan_in = c->widths[l - 1];
+        int spread = random_range(4, 128);
+        weights[l] = malloc((size_t)fan_in * c->widths[l]);
+        bias[l] = malloc(c->widths[l]);
+        for (int k = 0; k < fan_in * c->widths[l]; k++) {
+            int w = random_range(-spread, spread - 1) + random_range(0, 8);
+            weights[l][k] = (int8_t)(w > 127 ? 127 : w);
+        }
+        for (int i = 0; i < c->widths[l]; i++) {
+            bias[l][i] = (int8_t)random_range(-32, 48);
+        }
+        layers[l].weights = weights[l];
+        layers[l].bias = bias[l];
+        if (c->per_channel[l]) {
+            // Float weights whose range differs by up to 2^9 between neurons, most far outside Q0.7
+            size_t count = (size_t)fan_in * c->widths[l];
+            float *real = malloc((count + c->widths[l]) * sizeof(float));
+            scales[l] = malloc(c->widths[l] * sizeof(float));
+            if (!real || !scales[l]) {
+                perror("Failed to allocate test case");
+                exit(EXIT_FAILURE);
+            }
+            for (int i = 0; i < c->widths[l]; i++) {
+                float range = ldexpf(random_range(1, 100) / 100.0f, random_range(-6, 3));
+                for (int j = 0; j < fan_in; j++) {
+                    real[(size_t)j * c->widths[l] + i] = range * (random_range(-1000, 1100) / 1000.0f);
+                }
+                real[count + i] = range * (random_range(-250, 375) / 1000.0f);
+            }
+            quantize_per_channel(real, real + count, fan_in, c->widths[l], weights[l], bias[l], scales[l]);
+            failures += check_per_channel(real, real + count, weights[l], bias[l], scales[l], fan_in, c->widths[l]);
+            layers[l].scales = scales[l];
+            free(real);
+        }
+    }
+
+    Snn_Network_Desc desc = {c->num_layers, c->tau, c->time_window, layers, c->voltage_thresh, c->decay_rate,
+                             c->input_mode, NULL, 0};
+    Snn_Memory_Plan plan;
+    uint8_t *arena = NULL;
+    if (c->in_arena && plan_network_memory(&desc, &plan) == 0) {
+        arena = alloc_arena(plan.total);
+    }
+    if (failures || (arena ? build_network_in(&snn_network, &desc, arena, plan.total)
+                           : build_network(&snn_network, &desc))) {
+        for (int l = 1; l < c->num_layers; l++) {
+            free(weights[l]);
+            free(bias[l]);
+            free(scales[l]);
+        }
+        free(arena);
+        if (failures) {
+            print_case(c);
+        }
+        return failures;
+    }
+    Snn_Network *net = &snn_network;
+    net->early_exit.mode = EARLY_EXIT_OFF;
+    for (int l = 0; l < c->num_layers; l++) {
+        net->layers[l].spike_mode = c->spike_mode[l];
+        net->layers[l].popcount_mode = c->tau <= 32 ? c->popcount_mode[l] : IF_POPCOUNT_OFF;
+        int failed = c->repack_float
+            ? set_layer_precision(net, l, c->precision[l]) || set_layer_weight_format(net, l, c->weight_format[l])
+            : set_layer_weight_format(net, l, c->weight_format[l]) || set_layer_precision(net, l, c->precision[l]);
+        failed = failed || set_layer_traversal(net, l, c->traversal[l]);
+        if (failed) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int input_bytes = (c->widths[0] + 7) / 8;
+    size_t sample_stride = (size_t)c->time_window * input_bytes;
+    uint8_t *spikes = calloc((size_t)c->num_samples * sample_stride, 1);
+    for (int s = 0; s < c->num_samples; s++) {
+        for (int t = 0; t < c->time_window; t++) {
+            uint8_t *row = spikes + s * sample_stride + (size_t)t * input_bytes;
+            for (int i = 0; i < c->widths[0]; i++) {
+                SET_BIT(row, i, random_range(0, 99) < c->density_pct);
+            }
+        }
+    }
+
+    int num_outputs = c->widths[c->num_layers - 1];
+    size_t counts_size = (size_t)num_outputs * (c->time_window / c->tau);
+    Diff_Expected expected;
+    Snn_Reference ref;
+    expected.firing_counts = malloc(c->num_samples * counts_size * sizeof(int));
+    expected.membrane = malloc((size_t)c->num_samples * net->total_neurons * sizeof(sum_t));
+    if (!spikes || !expected.firing_counts || !expected.membrane || create_reference(&ref, net)) {
+        perror("Failed to allocate test case");
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < c->num_samples; s++) {
+        expected.classification[s] = reference_inference(&ref, spikes + s * sample_stride, input_bytes);
+        memcpy(expected.firing_counts + s * counts_size, ref.firing_counts, counts_size * sizeof(int));
+        memcpy(expected.membrane + (size_t)s * net->total_neurons, ref.membrane, net->total_neurons * sizeof(sum_t));
+    }
+
+    failures += check_packed(net, c, weights);
+    failures += check_sum_width(net, c);
+    // Most test fan-ins are too small to leave int16, so the int32 kernels
+    // mostly run on int8 layers when forced; int32 sums are always exact
+    for (int l = 0; l < c->num_layers; l++) {
+        if (c->int32_sums[l]) {
+            net->layers[l].sum_width = SUMS_INT32;
+        }
+    }
+    for (int k = 0; k < DSP_KERNEL_COUNT && !failures; k++) {
+        if (dsp_select_kernel((Dsp_Kernel)k)) {
+            continue;
+        }
+        failures += check_staged(net, &ref, spikes, input_bytes, (Dsp_Kernel)k, c);
+        failures += check_engines(net, &expected, spikes, input_bytes, (Dsp_Kernel)k, c);
+        (*kernel_runs)++;
+    }
+
+    destroy_reference(&ref);
+    free(expected.firing_counts);
+    free(expected.membrane);
+    free(spikes);
+    destroy_network(&snn_network);
+    if (arena && arena_overrun(arena, plan.total)) {
+        fprintf(stderr, "FAIL: network arena overrun\n");
+        print_case(c);
+        failures++;
+    }
+    free(arena);
+    for (int l = 1; l < c->num_layers; l++) {
+        free(weights[l]);
+        free(bias[l]);
+        free(scales[l]);
+    }
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    int num_cases = 200;
+    uint64_t seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cases") == 0 && i + 1 < argc) {
+            num_cases = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--cases N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int failed_cases = 0;
+    int kernel_runs = 0;
+#if !(SNN_FIXED_TOPOLOGY)
+    Diff_Case wide;
+    rng_state = seed;
+    make_wide_case(&wide);
+    if (run_case(&wide, &kernel_runs)) {
+        fprintf(stderr, "  wide case of seed %llu\n", (unsigned long long)seed);
+        failed_cases++;
+    }
+#endif
+    for (int n = 0; n < num_cases; n++) {
+        Diff_Case c;
+        // Every case has its own stream, so --cases never changes the earlier ones
+        rng_state = seed * 0x100000001B3ull + (uint64_t)n;
+        make_case(&c);
+        if (run_case(&c, &kernel_runs)) {
+            fprintf(stderr, "  case %d of seed %llu\n", n, (unsigned long long)seed);
+            failed_cases++;
+        }
+    }
+    if (failed_cases) {
+        printf("test_differential: %d of %d cases failed\n", failed_cases, num_cases);
+        return 1;
+    }
+    printf("test_differential: %d cases passed (%d kernel runs, seed %llu)\n", num_cases, kernel_runs,
+           (unsigned long long)seed);
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Equivalence test: the fused LIF kernels (every DSP level this CPU supports)
+// against a per-neuron, per-step reference update. Covers the input layer
+// (+1 in Q0.7 per input spike) and a hidden layer fed from int8 weights.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../define.h"
+#include "../dsp_helper.h"
+#include "../snn_network.h"
+
+Snn_Network snn_network;
+
+#define MAX_TEST_WIDTH 64
+
+// One neuron at a time: synaptic input, then decay, fire and reset-subtract
+static void reference_layer(const uint8_t *input, int stride, int tau, const int8_t *weights,
+                            const int8_t *bias, int input_size, int32_t *membrane,
+                            uint8_t *output, int num_neurons) {
+    for (int t = 0; t < tau; t++) {
+        const uint8_t *in = input + (size_t)t * stride;
+        uint8_t *out = output + (size_t)t * stride;
+        for (int i = 0; i < num_neurons; i++) {
+            int32_t sum = 0;
+            if (weights) {
+                sum = bias[i];
+                for (int j = 0; j < input_size; j++) {
+                    sum += GET_BIT(in, j) ? weights[j * num_neurons + i] : 0;
+                }
+            } else {
+                sum = GET_BIT(in, i) ? (1 << DECAY_SHIFT) : 0;
+            }
+            int reset_signal = HEAVISIDE(membrane[i], VOLTAGE_THRESH_FP7);
+#if (LIF)
+            membrane[i] = ((DECAY_FP7 * membrane[i]) >> DECAY_SHIFT) + sum
+                        - reset_signal * VOLTAGE_THRESH_FP7;
+#else
+            membrane[i] = membrane[i] + sum - reset_signal * VOLTAGE_THRESH_FP7;
+#endif
+            SET_BIT(out, i, reset_signal);
+        }
+    }
+}
+
+// layer 0 drives a num_inputs-wide input layer, layer 1 a num_inputs -> width hidden layer
+static int run_case(int layer_index, int num_inputs, int width, int density_pct, unsigned seed) {
+    static int8_t weights[MAX_TEST_WIDTH * MAX_TEST_WIDTH];
+    static int8_t bias[MAX_TEST_WIDTH];
+    Snn_Layer_Desc layers[2] = {{num_inputs, NULL, NULL, NULL}, {width, weights, bias, NULL}};
+    Snn_Network_Desc desc = {2, TAU, TIME_WINDOW, layers, 0, 0, INPUT_LIF, NULL, 0};
+
+    srand(seed);
+    for (int i = 0; i < num_inputs * width; i++) {
+        weights[i] = (int8_t)(rand() % 256 - 128);
+    }
+    for (int i = 0; i < width; i++) {
+        bias[i] = (int8_t)(rand() % 64 - 32);
+    }
+    if (num_inputs > MAX_TEST_WIDTH || width > MAX_TEST_WIDTH || build_network(&snn_network, &desc)) {
+        return 1;
+    }
+    // These are the int8 Q0.7 kernels, whatever format the build starts layers in
+    for (int l = 0; l < 2; l++) {
+        set_layer_weight_format(&snn_network, l, WEIGHTS_INT8);
+        set_layer_precision(&snn_network, l, PRECISION_Q07);
+    }
+
+    Layer *layer = &snn_network.layers[layer_index];
+    int num_neurons = layer->num_neurons;
+    int32_t *membrane = snn_network.membrane + layer->neuron_offset;
+    int stride = snn_network.spike_bytes;
+    size_t buffer_bytes = (size_t)TAU * stride;
+    uint8_t *input = calloc(buffer_bytes, 1);
+    uint8_t *expected = calloc(buffer_bytes, 1);
+    uint8_t *got = calloc(buffer_bytes, 1);
+    int32_t start[MAX_TEST_WIDTH];
+    int32_t ref[MAX_TEST_WIDTH];
+    int failures = 0;
+
+    for (int t = 0; t < TAU; t++) {
+        uint8_t *row = input + (size_t)t * stride;
+        for (int i = 0; i < num_inputs; i++) {
+            SET_BIT(row, i, rand() % 100 < density_pct);
+        }
+    }
+    for (int i = 0; i < num_neurons; i++) {
+        start[i] = rand() % 400 - 100;
+    }
+
+    for (int chunk = 0; chunk < 3; chunk++) {
+        memcpy(ref, start, num_neurons * sizeof(int32_t));
+        reference_layer(input, stride, TAU, layer_index ? weights : NULL, bias, num_inputs,
+                        ref, expected, num_neurons);
+
+        for (int k = 0; k < DSP_KERNEL_COUNT; k++) {
+            if (dsp_select_kernel((Dsp_Kernel)k)) {
+                continue;
+            }
+            memcpy(membrane, start, num_neurons * sizeof(int32_t));
+            memset(got, 0xA5, buffer_bytes);
+            update_layer(&snn_network, input, got, layer);
+
+            int bad = memcmp(membrane, ref, num_neurons * sizeof(int32_t)) != 0;
+            for (int t = 0; t < TAU && !bad; t++) {
+                const uint8_t *got_row = got + (size_t)t * stride;
+                const uint8_t *expected_row = expected + (size_t)t * stride;
+                for (int i = 0; i < num_neurons; i++) {
+                    bad |= GET_BIT(got_row, i) != GET_BIT(expected_row, i);
+                }
+            }
+            if (bad) {
+                fprintf(stderr, "FAIL: %s kernel, layer %d, %d -> %d, %d%% density, chunk %d\n",
+                        dsp_kernel_name((Dsp_Kernel)k), layer_index, num_inputs, num_neurons,
+                        density_pct, chunk);
+                failures++;
+            }
+        }
+        // Carry the state into the next chunk so resets and leaks compound
+        memcpy(start, ref, num_neurons * sizeof(int32_t));
+    }
+
+    free(input);
+    free(expected);
+    free(got);
+    destroy_network(&snn_network);
+    return failures;
+}
+
+int main(void) {
+    static const int widths[] = {1, 7, 8, 15, 16, 17, 37, 63, 64};
+    static const int densities[] = {0, 5, 30, 100};
+    size_t num_widths = sizeof(widths) / sizeof(widths[0]);
+    int failures = 0;
+    int cases = 0;
+
+    for (size_t w = 0; w < num_widths; w++) {
+        for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+            unsigned seed = (unsigned)(w * 31 + d);
+            failures += run_case(0, widths[w], 5, densities[d], seed);
+            failures += run_case(1, widths[num_widths - 1 - w], widths[w], densities[d], seed);
+            cases += 2;
+        }
+    }
+    if (failures) {
+        printf("test_lif_kernels: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_lif_kernels: %d cases passed\n", cases);
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Binary model container test: a saved model loads back blob for blob, and
+// layer tables whose offsets are out of bounds, including offsets near
+// UINT64_MAX that wrap offset + size back into range, are rejected.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../define.h"
+#include "../snn_network.h"
+#include "../file_operations.h"
+
+Snn_Network snn_network;
+
+// Layout from file_operations.c: a 48-byte header with the version at byte 8,
+// then one entry per layer of num_neurons, flags and the uint64 bias, weights
+// and (version 2 only) scales offsets
+#define HEADER_BYTES   48
+#define VERSION_OFFSET 8
+#define ENTRY_V1_BYTES 24
+#define ENTRY_V2_BYTES 32
+#define BIAS_FIELD     8
+#define WEIGHTS_FIELD  16
+#define SCALES_FIELD   24
+
+#define NUM_INPUTS  100
+#define NUM_HIDDEN  96
+#define NUM_OUTPUTS 10
+
+static int8_t weights1[NUM_INPUTS * NUM_HIDDEN];
+static int8_t bias1[NUM_HIDDEN];
+static int8_t weights2[NUM_HIDDEN * NUM_OUTPUTS];
+static int8_t bias2[NUM_OUTPUTS];
+static float scales2[NUM_OUTPUTS];
+
+static int read_file(const char *path, uint8_t **data, size_t *bytes) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    *bytes = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *data = malloc(*bytes);
+    int failed = !*data || fread(*data, 1, *bytes, file) != *bytes;
+    fclose(file);
+    return failed;
+}
+
+static int write_file(const char *path, const uint8_t *data, size_t bytes) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return 1;
+    }
+    int failed = fwrite(data, 1, bytes, file) != bytes;
+    return fclose(file) != 0 || failed;
+}
+
+static int loads_back(const char *path, const Snn_Network_Desc *saved) {
+    Snn_Network_Desc desc;
+    if (load_model_bin(path, &desc)) {
+        return 0;
+    }
+    int same = desc.num_layers == saved->num_layers;
+    for (int l = 1; same && l < desc.num_layers; l++) {
+        size_t cols = desc.layers[l].num_neurons;
+        size_t rows = desc.layers[l - 1].num_neurons;
+        same = cols == (size_t)saved->layers[l].num_neurons
+            && memcmp(desc.layers[l].bias, saved->layers[l].bias, cols) == 0
+            && memcmp(desc.layers[l].weights, saved->layers[l].weights, rows * cols) == 0
+            && !desc.layers[l].scales == !saved->layers[l].scales
+            && (!desc.layers[l].scales
+                || memcmp(desc.layers[l].scales, saved->layers[l].scales, cols * sizeof(float)) == 0);
+    }
+    free_model_desc(&desc);
+    return same;
+}
+
+// Rewrites one offset field of one layer entry and expects the load to fail
+static int rejects_offset(const char *path, const uint8_t *image, size_t bytes, int layer, int field,
+                          uint64_t offset) {
+    uint8_t *corrupt = malloc(bytes);
+    uint32_t version;
+    memcpy(corrupt, image, bytes);
+    memcpy(&version, corrupt + VERSION_OFFSET, sizeof(version));
+    size_t entry = HEADER_BYTES + (size_t)layer * (version == 1 ? ENTRY_V1_BYTES : ENTRY_V2_BYTES);
+    memcpy(corrupt + entry + field, &offset, sizeof(offset));
+
+    // The loader reports every rejection; keep the expected ones off stderr
+    Snn_Network_Desc desc;
+    int null_fd = open("/dev/null", O_WRONLY);
+    int saved_fd = dup(STDERR_FILENO);
+    fflush(stderr);
+    dup2(null_fd, STDERR_FILENO);
+    int rejected = write_file(path, corrupt, bytes) == 0 && load_model_bin(path, &desc) != 0;
+    fflush(stderr);
+    dup2(saved_fd, STDERR_FILENO);
+    close(saved_fd);
+    close(null_fd);
+    if (!rejected) {
+        printf("  layer %d field %d offset %#llx was accepted\n", layer, field, (unsigned long long)offset);
+        free_model_desc(&desc);
+    }
+    free(corrupt);
+    return rejected;
+}
+
+static int run_model(const char *path, int with_scales) {
+    Snn_Layer_Desc layers[3] = {{NUM_INPUTS, NULL, NULL, NULL},
+                                {NUM_HIDDEN, weights1, bias1, NULL},
+                                {NUM_OUTPUTS, weights2, bias2, with_scales ? scales2 : NULL}};
+    Snn_Network_Desc saved = {3, TAU, TIME_WINDOW, layers, 0, 0, INPUT_LIF, NULL, 0};
+    uint8_t *image = NULL;
+    size_t bytes = 0;
+    int failures = 0;
+
+    if (save_model_bin(path, &saved) || read_file(path, &image, &bytes)) {
+        printf("  could not write %s\n", path);
+        return 1;
+    }
+    if (!loads_back(path, &saved)) {
+        printf("  model with%s scales did not load back\n", with_scales ? "" : "out");
+        failures++;
+    }
+
+    // 64-aligned offsets whose sum with the blob size wraps to a small value
+    uint64_t wrap = UINT64_MAX - 63;
+    for (int l = 1; l < 3; l++) {
+        failures += !rejects_offset(path, image, bytes, l, BIAS_FIELD, wrap);
+        failures += !rejects_offset(path, image, bytes, l, WEIGHTS_FIELD, wrap);
+        failures += !rejects_offset(path, image, bytes, l, WEIGHTS_FIELD, bytes);
+        failures += !rejects_offset(path, image, bytes, l, BIAS_FIELD, 0);
+    }
+    if (with_scales) {
+        failures += !rejects_offset(path, image, bytes, 2, SCALES_FIELD, wrap);
+        failures += !rejects_offset(path, image, bytes, 2, SCALES_FIELD, bytes);
+    }
+    free(image);
+    return failures;
+}
+
+int main(void) {
+    char path[] = "/tmp/test_model_file_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    srand(7);
+    for (size_t i = 0; i < sizeof(weights1); i++) {
+        weights1[i] = (int8_t)(rand() % 256 - 128);
+    }
+    for (size_t i = 0; i < sizeof(weights2); i++) {
+        weights2[i] = (int8_t)(rand() % 256 - 128);
+    }
+    for (int i = 0; i < NUM_HIDDEN; i++) {
+        bias1[i] = (int8_t)(rand() % 64 - 32);
+    }
+    for (int i = 0; i < NUM_OUTPUTS; i++) {
+        bias2[i] = (int8_t)(rand() % 64 - 32);
+        scales2[i] = 0.5f + (float)i / NUM_OUTPUTS;
+    }
+
+    int failures = run_model(path, 0) + run_model(path, 1);
+    unlink(path);
+    if (failures) {
+        printf("test_model_file: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_model_file: 2 models and their corrupt tables passed\n");
+    return 0;
+}